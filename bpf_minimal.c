@@ -4,7 +4,10 @@
 // Include necessary BPF headers
 #include <linux/bpf.h>
 #include <bpf/bpf_helpers.h>
+#include <bpf/bpf_core_read.h>
 #include <bpf/bpf_tracing.h>
+#include "bpf_minimal.h"
+#include "sampling.bpf.h"
 
 // Type definitions
 typedef unsigned int u32;
@@ -13,22 +16,414 @@ typedef int pid_t;
 // Configuration: Set to 0 to track all PIDs, or a specific PID to filter
 #define PID_FILTER 0
 
+// Configuration: Set to 1 to stream sampled events to the ring buffer instead of bpf_printk,
+// unless userspace picks an output through the output map
+#define USE_RINGBUF 0
+#define RINGBUF_SIZE (256 * 1024)
+
+// Layout of the raw_syscalls:sys_enter tracepoint record
+struct sys_enter_args {
+    unsigned long long common; // Common tracepoint fields
+    long id;                   // Syscall number
+    unsigned long args[6];
+};
+
+// Syscalls to trace, filled by userspace with the numbers of the running
+// architecture; one array lookup rejects everything else
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, MAX_SYSCALL_NR);
+    __type(key, u32);
+    __type(value, struct io_syscall);
+} io_syscalls SEC(".maps");
+
+// OUTPUT_* chosen by userspace, OUTPUT_DEFAULT until written
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, u32);
+} output SEC(".maps");
+
+// How processes are identified and filtered, see struct id_config
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct id_config);
+} id_config SEC(".maps");
+
+// Processes whose fd targets userspace has cached, only their closes are reported
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_FD_WATCH);
+    __type(key, u32);
+    __type(value, __u8);
+} fd_watch SEC(".maps");
+
+// Invalidations that did not fit in the ring buffer. Mmapable so that a
+// consumer can check it before every cache lookup without a syscall.
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __uint(map_flags, BPF_F_MMAPABLE);
+    __type(key, u32);
+    __type(value, __u64);
+} fd_lost SEC(".maps");
+
+// Ring buffer carrying write_event records, sampled adaptively (see sampling.bpf.h)
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, RINGBUF_SIZE);
+} events SEC(".maps");
+
+// Bytes written per process and target class, see handle_vfs_write
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_CLASS_KEYS);
+    __type(key, struct class_key);
+    __type(value, struct io_bytes);
+} class_bytes SEC(".maps");
+
+// Bytes written per process and connection, see handle_vfs_write
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_SOCK_KEYS);
+    __type(key, struct sock_key);
+    __type(value, struct io_bytes);
+} sock_bytes SEC(".maps");
+
+// Context fields only allow constant offsets, hence the switch
+static __always_inline unsigned long sys_arg(struct sys_enter_args *ctx, __u8 n)
+{
+    switch (n) {
+    case 0:
+        return ctx->args[0];
+    case 1:
+        return ctx->args[1];
+    case 2:
+        return ctx->args[2];
+    case 3:
+        return ctx->args[3];
+    case 4:
+        return ctx->args[4];
+    case 5:
+        return ctx->args[5];
+    default:
+        return 0;
+    }
+}
+
+static __always_inline u32 output_mode(void)
+{
+    u32 key = 0;
+    u32 *mode = bpf_map_lookup_elem(&output, &key);
+
+    if (mode && *mode)
+        return *mode;
+    return USE_RINGBUF ? OUTPUT_RINGBUF : OUTPUT_PRINTK;
+}
+
+// Identity of the current task as selected by id_config
+struct proc_id {
+    u32 pid;
+    __u64 cgroup;
+};
+
+// Fill id for the current task, return 0 if it is filtered out. Resolved
+// here so that consumers never have to translate host pids themselves.
+static __always_inline int current_id(struct proc_id *id)
+{
+    struct bpf_pidns_info ns;
+    struct id_config *cfg;
+    __u64 cgroup;
+    u32 key = 0;
+
+    id->pid = bpf_get_current_pid_tgid() >> 32;
+    id->cgroup = 0;
+
+    // If PID_FILTER is set and doesn't match the current PID, skip processing
+    if (PID_FILTER && id->pid != PID_FILTER)
+        return 0;
+
+    cfg = bpf_map_lookup_elem(&id_config, &key);
+    if (!cfg)
+        return 0;
+
+    // Fails for tasks whose active namespace is another one, nested ones included
+    if (cfg->flags & ID_F_PIDNS) {
+        if (bpf_get_ns_current_pid_tgid(cfg->pidns_dev, cfg->pidns_ino, &ns, sizeof(ns)))
+            return 0;
+        id->pid = ns.tgid;
+    }
+    if (cfg->pid && id->pid != cfg->pid)
+        return 0;
+
+    if (cfg->cgroup || (cfg->flags & ID_F_CGROUP)) {
+        cgroup = bpf_get_current_cgroup_id();
+        if (cfg->cgroup && cgroup != cfg->cgroup)
+            return 0;
+        if (cfg->flags & ID_F_CGROUP)
+            id->cgroup = cgroup;
+    }
+    return 1;
+}
+
+// Tell userspace that fds first to last (or all fds) of a watched process
+// changed. Shares the events ring buffer so it is ordered with the I/O
+// records, and bypasses the sampler since a lost invalidation would leave a
+// stale entry; one that does not fit is counted in fd_lost, which makes the
+// consumer drop its whole cache.
+static __always_inline int fd_invalidate(u32 pid, u32 first, u32 last, u32 nr)
+{
+    struct write_event *e;
+    u32 key = 0;
+    __u64 *lost;
+
+    if (!bpf_map_lookup_elem(&fd_watch, &pid))
+        return 0;
+    if (nr == NR_FD_INVAL_ALL)
+        bpf_map_delete_elem(&fd_watch, &pid);
+
+    e = bpf_ringbuf_reserve(&events, sizeof(*e), 0);
+    if (!e) {
+        lost = bpf_map_lookup_elem(&fd_lost, &key);
+        if (lost)
+            __sync_fetch_and_add(lost, 1);
+        return 0;
+    }
+    e->ts = bpf_ktime_get_ns();
+    e->pid = pid;
+    e->fd = first;
+    e->count = last;
+    e->weight = 0;
+    e->nr = nr;
+    e->cgroup = 0;
+    bpf_ringbuf_submit(e, 0);
+    return 0;
+}
+
 // License declaration (required for BPF programs)
 char LICENSE[] SEC("license") = "Dual BSD/GPL";
 
-// BPF program attached to the sys_enter_write tracepoint
-SEC("tp/syscalls/sys_enter_write")
-int handle_tp(void *ctx)
+// BPF program attached to every syscall entry, tracing the I/O ones
+SEC("tp/raw_syscalls/sys_enter")
+int handle_tp(struct sys_enter_args *ctx)
 {
-    // Get the current process ID
-    pid_t pid = bpf_get_current_pid_tgid() >> 32;
+    struct io_syscall *sc;
+    struct write_event *e;
+    struct proc_id id;
+    u32 nr = ctx->id;
+    u32 weight;
+    u32 mode;
 
-    // If PID_FILTER is set and doesn't match the current PID, skip processing
-    if (PID_FILTER && pid != PID_FILTER)
+    // Out-of-range and negative ids fail the lookup like untraced ones
+    sc = bpf_map_lookup_elem(&io_syscalls, &nr);
+    if (!sc || !sc->kind)
+        return 0;
+
+    // Get the current process ID, skipping filtered processes
+    if (!current_id(&id))
+        return 0;
+
+    mode = output_mode();
+    if (sc->kind == IO_KIND_CLOSE || sc->kind == IO_KIND_CLOSE_RANGE) {
+        u32 fd = sys_arg(ctx, sc->fd_arg);
+
+        if (mode != OUTPUT_RINGBUF)
+            return 0;
+        return fd_invalidate(id.pid, fd,
+                             sc->kind == IO_KIND_CLOSE ? fd : sys_arg(ctx, sc->count_arg), nr);
+    }
+    if (mode == OUTPUT_NONE)
         return 0;
 
     // Log the triggered syscall with the process ID
-    bpf_printk("BPF triggered sys_enter_write from PID %d.\n", pid);
+    if (mode == OUTPUT_PRINTK) {
+        bpf_printk("BPF triggered syscall %u from PID %d.\n", nr, id.pid);
+        return 0;
+    }
+
+    // Under ring buffer pressure only 1 in N writes is emitted, weighted by N
+    if (!sampler_sample(&weight))
+        return 0;
+
+    e = sampler_reserve(&events, sizeof(*e), weight);
+    if (!e)
+        return 0;
+
+    e->ts = bpf_ktime_get_ns();
+    e->pid = id.pid;
+    e->fd = sys_arg(ctx, sc->fd_arg);
+    e->count = sys_arg(ctx, sc->count_arg);
+    e->weight = weight;
+    e->nr = nr;
+    e->cgroup = id.cgroup;
+    bpf_ringbuf_submit(e, 0);
+
+    return 0;
+}
+
+// Thread group state read by handle_exit, relocated like the types below
+struct signal_struct {
+    struct {
+        int counter;
+    } live; // Threads not exited yet
+} __attribute__((preserve_access_index));
+
+struct task_struct {
+    struct signal_struct *signal;
+} __attribute__((preserve_access_index));
+
+// A process is gone: its fds are released
+SEC("tp/sched/sched_process_exit")
+int handle_exit(void *ctx)
+{
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+    struct proc_id id;
+
+    // Threads exit one by one, in any order, and the fd table goes with
+    // the last; do_exit() has dropped signal->live for this one already
+    if (BPF_CORE_READ(task, signal, live.counter) || !current_id(&id))
+        return 0;
+    return fd_invalidate(id.pid, 0, 0, NR_FD_INVAL_ALL);
+}
+
+// exec closes O_CLOEXEC fds, cheaper to forget them all than to tell which
+SEC("tp/sched/sched_process_exec")
+int handle_exec(void *ctx)
+{
+    struct proc_id id;
+
+    if (!current_id(&id))
+        return 0;
+    return fd_invalidate(id.pid, 0, 0, NR_FD_INVAL_ALL);
+}
+
+// Kernel types read by handle_vfs_write, relocated against the running
+// kernel's BTF so only the fields used need to be declared
+struct inode {
+    unsigned short i_mode;
+} __attribute__((preserve_access_index));
+
+struct file {
+    struct inode *f_inode;
+    void *private_data;
+} __attribute__((preserve_access_index));
+
+struct sock_common {
+    unsigned int skc_daddr;
+    unsigned int skc_rcv_saddr;
+    unsigned short skc_dport;
+    unsigned short skc_num;
+    unsigned short skc_family;
+    struct {
+        __u8 s6_addr[16];
+    } skc_v6_daddr, skc_v6_rcv_saddr;
+} __attribute__((preserve_access_index));
+
+struct sock {
+    struct sock_common __sk_common;
+    unsigned short sk_protocol; // A bitfield before 5.6
+} __attribute__((preserve_access_index));
+
+struct socket {
+    struct sock *sk;
+} __attribute__((preserve_access_index));
+
+#define S_IFMT   00170000
+#define S_IFSOCK 0140000
+#define S_IFREG  0100000
+#define S_IFIFO  0010000
+
+#define AF_INET  2
+#define AF_INET6 10
+
+static __always_inline u32 file_class(struct file *file)
+{
+    switch (BPF_CORE_READ(file, f_inode, i_mode) & S_IFMT) {
+    case S_IFREG:
+        return FILE_CLASS_FILE;
+    case S_IFIFO:
+        return FILE_CLASS_PIPE;
+    case S_IFSOCK:
+        return FILE_CLASS_SOCKET;
+    default:
+        return FILE_CLASS_OTHER;
+    }
+}
+
+// Add one call of ret bytes to the entry for key, creating it if needed
+static __always_inline void io_bytes_add(void *map, void *key, long ret)
+{
+    struct io_bytes zero = {}; // On the stack, BPF_NO_GLOBAL_DATA rules out .rodata
+    struct io_bytes *v;
+
+    v = bpf_map_lookup_elem(map, key);
+    if (!v) {
+        bpf_map_update_elem(map, key, &zero, BPF_NOEXIST);
+        v = bpf_map_lookup_elem(map, key);
+        if (!v)
+            return;
+    }
+    __sync_fetch_and_add(&v->calls, 1);
+    __sync_fetch_and_add(&v->bytes, ret);
+}
+
+// Fill the connection tuple of a socket file, the fd of a socket keeps its
+// struct socket in private_data
+static __always_inline void sock_tuple(struct file *file, struct sock_key *key)
+{
+    struct socket *sock = BPF_CORE_READ(file, private_data);
+    struct sock *sk = BPF_CORE_READ(sock, sk);
+
+    if (!sk)
+        return;
+    key->family = BPF_CORE_READ(sk, __sk_common.skc_family);
+    key->protocol = BPF_CORE_READ_BITFIELD_PROBED(sk, sk_protocol);
+    if (key->family == AF_INET) {
+        bpf_core_read(key->saddr, 4, &sk->__sk_common.skc_rcv_saddr);
+        bpf_core_read(key->daddr, 4, &sk->__sk_common.skc_daddr);
+    } else if (key->family == AF_INET6) {
+        bpf_core_read(key->saddr, 16, &sk->__sk_common.skc_v6_rcv_saddr);
+        bpf_core_read(key->daddr, 16, &sk->__sk_common.skc_v6_daddr);
+    } else {
+        return;
+    }
+    key->sport = BPF_CORE_READ(sk, __sk_common.skc_num);
+    key->dport = __builtin_bswap16(BPF_CORE_READ(sk, __sk_common.skc_dport));
+}
+
+// In-kernel variant of the write tracing: classifies the target through its
+// inode and sums the bytes actually written, per connection for sockets.
+// Only write(2) and kernel writers reach vfs_write(); the vectored and
+// send*() paths bypass it. Not loaded unless userspace asks for it.
+SEC("fexit/vfs_write")
+int BPF_PROG(handle_vfs_write, struct file *file, const char *buf, unsigned long count,
+             long long *pos, long ret)
+{
+    struct class_key ckey;
+    struct sock_key skey;
+    struct proc_id id;
+
+    if (ret <= 0 || !current_id(&id))
+        return 0;
+
+    // Per cgroup keys fold all of its processes together
+    if (id.cgroup)
+        id.pid = 0;
+
+    ckey.cgroup = id.cgroup;
+    ckey.pid = id.pid;
+    ckey.cls = file_class(file);
+    io_bytes_add(&class_bytes, &ckey, ret);
+    if (ckey.cls != FILE_CLASS_SOCKET)
+        return 0;
 
+    __builtin_memset(&skey, 0, sizeof(skey));
+    skey.cgroup = id.cgroup;
+    skey.pid = id.pid;
+    sock_tuple(file, &skey);
+    io_bytes_add(&sock_bytes, &skey, ret);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,105 @@
+// Shared definitions between bpf_minimal.c and its userspace consumers
+#ifndef __BPF_MINIMAL_H
+#define __BPF_MINIMAL_H
+
+// Syscall numbers covered by the io_syscalls filter map
+#define MAX_SYSCALL_NR 1024
+
+// I/O direction of a traced syscall, 0 means the syscall is not traced
+#define IO_KIND_READ  1
+#define IO_KIND_WRITE 2
+#define IO_KIND_SEND  3
+#define IO_KIND_URING 4
+#define IO_KIND_CLOSE 5 // Closes the fd in fd_arg (close, dup2, dup3)
+#define IO_KIND_CLOSE_RANGE 6 // Closes fd_arg up to count_arg (close_range)
+
+// write_event.nr of an invalidation dropping every fd of a process (exit, exec)
+#define NR_FD_INVAL_ALL 0xffffffff
+
+// Processes tracked at once in fd_watch
+#define MAX_FD_WATCH 4096
+
+// io_syscall.count_arg when no argument carries a size
+#define IO_NO_COUNT 0xff
+
+// Value of the single-entry output map, where handle_tp sends what it traces
+#define OUTPUT_DEFAULT 0 // USE_RINGBUF in bpf_minimal.c decides
+#define OUTPUT_PRINTK  1 // bpf_printk() to the trace pipe
+#define OUTPUT_RINGBUF 2 // Sampled write_event records in the events ring buffer
+#define OUTPUT_NONE    3 // Filter only, to measure the cost of being attached
+
+// id_config.flags
+#define ID_F_PIDNS  1 // Report pids as seen in pidns_dev/pidns_ino, skip other tasks
+#define ID_F_CGROUP 2 // Key aggregations by cgroup v2 id instead of pid
+
+// Value of the single-entry id_config map, how processes are identified
+// and filtered; all zero means host pids, no filter
+struct id_config {
+    __u64 pidns_dev; // st_dev of the pid namespace file (/proc/<pid>/ns/pid)
+    __u64 pidns_ino; // st_ino of the same file
+    __u64 cgroup;    // Only trace this cgroup v2 id, 0 for all
+    __u32 pid;       // Only trace this process (in the selected namespace), 0 for all
+    __u32 flags;     // ID_F_*
+};
+
+// Value of the io_syscalls array map, indexed by syscall number
+struct io_syscall {
+    __u8 kind;      // IO_KIND_*, 0 to ignore the syscall
+    __u8 count_arg; // Argument reported as write_event.count, or IO_NO_COUNT
+    __u8 fd_arg;    // Argument holding the fd
+    __u8 pad;
+};
+
+// Record streamed to the ring buffer for each sampled I/O syscall. Records
+// with weight 0 are never sampled: they tell a consumer caching fd targets
+// of a process in fd_watch that fds fd to count (or all fds for
+// NR_FD_INVAL_ALL) changed. Those that did not fit in the ring buffer are
+// counted in the fd_lost map instead.
+struct write_event {
+    __u64 ts;     // bpf_ktime_get_ns() at syscall entry
+    __u32 pid;    // Process ID (tgid), in the id_config namespace
+    __u32 fd;     // File descriptor (ring fd for io_uring_enter)
+    __u64 count;  // Bytes requested, or iovcnt/vlen/to_submit for vectored calls
+    __u32 weight; // Number of syscalls this sample stands for
+    __u32 nr;     // Syscall number
+    __u64 cgroup; // Cgroup v2 id with ID_F_CGROUP, 0 otherwise
+};
+
+// What a vfs_write() target is, from the S_IFMT bits of its inode
+#define FILE_CLASS_OTHER  0 // Character devices, anon inodes, ...
+#define FILE_CLASS_FILE   1
+#define FILE_CLASS_PIPE   2
+#define FILE_CLASS_SOCKET 3
+#define MAX_FILE_CLASSES  4
+
+// Processes x classes and connections aggregated by handle_vfs_write
+#define MAX_CLASS_KEYS 10240
+#define MAX_SOCK_KEYS  10240
+
+// Key of the class_bytes map
+struct class_key {
+    __u64 cgroup; // Cgroup v2 id with ID_F_CGROUP, 0 otherwise
+    __u32 pid;    // Process ID (tgid), 0 with ID_F_CGROUP
+    __u32 cls;    // FILE_CLASS_*
+};
+
+// Key of the sock_bytes map, addresses and ports are zero outside AF_INET(6)
+struct sock_key {
+    __u64 cgroup;    // Cgroup v2 id with ID_F_CGROUP, 0 otherwise
+    __u32 pid;       // Process ID (tgid), 0 with ID_F_CGROUP
+    __u16 family;    // AF_*
+    __u16 protocol;  // IPPROTO_*
+    __u16 sport;     // Local port, host order
+    __u16 dport;     // Remote port, host order
+    __u8 saddr[16];  // Local address, first 4 bytes for AF_INET
+    __u8 daddr[16];  // Remote address, first 4 bytes for AF_INET
+    __u32 pad;
+};
+
+// Value of the class_bytes and sock_bytes maps
+struct io_bytes {
+    __u64 calls; // vfs_write() calls
+    __u64 bytes; // Bytes actually written
+};
+
+#endif /* __BPF_MINIMAL_H */
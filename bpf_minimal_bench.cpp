@@ -0,0 +1,479 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file bpf_minimal_bench.cpp
+ * @brief Cost of bpf_minimal tracing on a write()-heavy workload
+ *
+ * Usage: bpf_minimal_bench [-t threads] [-d secs] [-b bytes] [-T target]
+ *                          [-m modes] [-s rate]
+ *
+ * Each thread calls write() in a loop on its own target (a temporary file,
+ * a pipe, /dev/null or a Unix socket pair; pipe and socket have a reader
+ * thread draining them) and times every call. The loop runs once per mode:
+ *
+ *   off      nothing loaded, the baseline
+ *   none     handle_tp attached, returning after the filters (OUTPUT_NONE)
+ *   printk   handle_tp logging each write with bpf_printk()
+ *   ringbuf  handle_tp streaming sampled events, consumed by a poll thread
+ *   kernel   handle_vfs_write only, summing bytes per class in the kernel
+ *
+ * Tracing is restricted to this process through id_config, by its pid in
+ * its own pid namespace, so the numbers do not depend on what else runs on
+ * the host, container or not. Needs root.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "bpf_minimal.h"
+#include "bpf_minimal.skel.h"
+#include "sampling.h"
+#include "trace_helpers.hpp"
+
+/* Latencies kept across threads for percentiles, a uniform sample of the run */
+#define MAX_LAT_SAMPLES (1 << 22)
+/* A file target is rewound once this much was written to it */
+#define FILE_REWIND_BYTES (64ULL << 20)
+
+using bench_clock = std::chrono::steady_clock;
+
+static struct env {
+    int threads = 1;
+    int duration = 2;
+    size_t size = 4096;
+    const char *target = "null";
+    std::string modes = "off,none,printk,ringbuf,kernel";
+    __u32 sample_rate;
+} env;
+
+struct worker {
+    int fd = -1;
+    int peer = -1; /* Read end for pipe and socket */
+    std::thread writer;
+    std::thread reader;
+    std::vector<__u32> lat;
+    unsigned long long calls = 0;
+    unsigned long long lat_total = 0;
+};
+
+struct result {
+    std::string mode;
+    double calls_per_sec;
+    double mb_per_sec;
+    double avg_ns;
+    __u32 p50_ns;
+    __u32 p99_ns;
+};
+
+static std::atomic<bool> stop;
+static std::atomic<unsigned long long> ring_events, ring_weight;
+
+static const char usage[] =
+    "Usage: bpf_minimal_bench [OPTION...]\n"
+    "Measure write() throughput and latency with bpf_minimal detached and attached.\n"
+    "\n"
+    "  -t, --threads=N           Writer threads (default: 1)\n"
+    "  -d, --duration=SECS       Run time per mode (default: 2)\n"
+    "  -b, --bytes=N             Bytes per write (default: 4096)\n"
+    "  -T, --target=TARGET       file, pipe, null or socket (default: null)\n"
+    "  -m, --modes=LIST          Subset of off,none,printk,ringbuf,kernel\n"
+    "  -s, --sample=N            Fixed 1-in-N sampling in ringbuf mode\n"
+    "                            (default: adaptive)\n"
+    "  -h, --help                Show this help\n";
+
+static const struct option long_opts[] = {
+    { "threads", required_argument, nullptr, 't' },
+    { "duration", required_argument, nullptr, 'd' },
+    { "bytes", required_argument, nullptr, 'b' },
+    { "target", required_argument, nullptr, 'T' },
+    { "modes", required_argument, nullptr, 'm' },
+    { "sample", required_argument, nullptr, 's' },
+    { "help", no_argument, nullptr, 'h' },
+    {},
+};
+
+static int parse_args(int argc, char **argv)
+{
+    unsigned long long val;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "t:d:b:T:m:s:h", long_opts, nullptr)) != -1) {
+        switch (opt) {
+        case 't':
+            if (!parse_ull(optarg, &val) || !val || val > 1024) {
+                fprintf(stderr, "invalid thread count: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.threads = val;
+            break;
+        case 'd':
+            if (!parse_ull(optarg, &val) || !val || val > 3600) {
+                fprintf(stderr, "invalid duration: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.duration = val;
+            break;
+        case 'b':
+            if (!parse_ull(optarg, &val) || !val || val > (1 << 24)) {
+                fprintf(stderr, "invalid write size: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.size = val;
+            break;
+        case 'T':
+            if (strcmp(optarg, "file") && strcmp(optarg, "pipe") && strcmp(optarg, "null") &&
+                strcmp(optarg, "socket")) {
+                fprintf(stderr, "invalid target: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.target = optarg;
+            break;
+        case 'm':
+            env.modes = optarg;
+            break;
+        case 's':
+            if (!parse_ull(optarg, &val) || !val || val > UINT32_MAX) {
+                fprintf(stderr, "invalid sampling rate: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.sample_rate = val;
+            break;
+        case 'h':
+            fputs(usage, stdout);
+            exit(0);
+        default:
+            fputs(usage, stderr);
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+/**
+ * open_target - Open the write end (and read end, if any) of a worker
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+static int open_target(struct worker *w)
+{
+    const char *t = env.target;
+    int fds[2];
+
+    if (!strcmp(t, "null")) {
+        w->fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    } else if (!strcmp(t, "file")) {
+        char path[] = "/tmp/bpf_minimal_bench.XXXXXX";
+
+        w->fd = mkstemp(path);
+        if (w->fd >= 0)
+            unlink(path);
+    } else {
+        if (!strcmp(t, "pipe") ? pipe2(fds, O_CLOEXEC) :
+                                 socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds))
+            return -errno;
+        w->peer = fds[0];
+        w->fd = fds[1];
+    }
+    return w->fd < 0 ? -errno : 0;
+}
+
+static void drain(int fd)
+{
+    std::vector<char> buf(1 << 16);
+
+    while (read(fd, buf.data(), buf.size()) > 0)
+        ;
+}
+
+static void write_loop(struct worker *w)
+{
+    std::vector<char> buf(env.size, 'x');
+    size_t max_lat = MAX_LAT_SAMPLES / env.threads;
+    unsigned long long written = 0;
+    bool is_file = !strcmp(env.target, "file");
+
+    /* Seeded per worker so the threads do not keep the same calls */
+    std::minstd_rand rng(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+    w->lat.reserve(max_lat);
+    while (!stop.load(std::memory_order_relaxed)) {
+        auto start = bench_clock::now();
+        ssize_t ret = write(w->fd, buf.data(), buf.size());
+        __u32 ns = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() -
+                                                                        start).count();
+
+        if (ret < 0) {
+            perror("write");
+            break;
+        }
+        w->calls++;
+        w->lat_total += ns;
+        /* Reservoir sampling, so the percentiles cover the whole run, not its warm-up */
+        if (w->lat.size() < max_lat) {
+            w->lat.push_back(ns);
+        } else {
+            unsigned long long slot = rng() % w->calls;
+
+            if (slot < max_lat)
+                w->lat[slot] = ns;
+        }
+        written += ret;
+        if (is_file && written >= FILE_REWIND_BYTES) {
+            lseek(w->fd, 0, SEEK_SET);
+            written = 0;
+        }
+    }
+}
+
+static int handle_event(void *ctx, void *data, size_t data_sz)
+{
+    const struct write_event *e = (const struct write_event *)data;
+
+    if (data_sz >= sizeof(*e)) {
+        ring_events.fetch_add(1, std::memory_order_relaxed);
+        ring_weight.fetch_add(e->weight, std::memory_order_relaxed);
+    }
+    return 0;
+}
+
+/**
+ * setup_mode - Load and attach bpf_minimal for one mode
+ * @mode: Mode name, "off" loads nothing
+ * @objp: Set to the loaded skeleton, nullptr for "off"
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+static int setup_mode(const std::string &mode, struct bpf_minimal_bpf **objp)
+{
+    struct io_syscall write_cfg = { IO_KIND_WRITE, 2, 0, 0 };
+    struct id_config id = {};
+    struct sampler_ctl ctl = {};
+    struct bpf_minimal_bpf *obj;
+    struct bpf_link *link;
+    struct stat st;
+    bool kernel = mode == "kernel";
+    __u32 out, key = 0, nr = SYS_write;
+    int err;
+
+    *objp = nullptr;
+    if (mode == "off")
+        return 0;
+    if (mode == "none")
+        out = OUTPUT_NONE;
+    else if (mode == "printk")
+        out = OUTPUT_PRINTK;
+    else if (mode == "ringbuf")
+        out = OUTPUT_RINGBUF;
+    else if (kernel)
+        out = OUTPUT_NONE; /* handle_tp is not attached anyway */
+    else
+        return -EINVAL;
+
+    obj = bpf_minimal_bpf__open();
+    if (!obj)
+        return -errno;
+    bpf_program__set_autoload(obj->progs.handle_vfs_write, kernel);
+    err = bpf_minimal_bpf__load(obj);
+    if (err)
+        goto err_out;
+
+    /*
+     * Only this process, so the host's own writes do not skew the results.
+     * getpid() is our pid in our own namespace, which is what the kernel
+     * side reports with ID_F_PIDNS, also inside a container.
+     */
+    if (stat("/proc/self/ns/pid", &st)) {
+        err = -errno;
+        goto err_out;
+    }
+    id.pidns_dev = st.st_dev;
+    id.pidns_ino = st.st_ino;
+    id.flags = ID_F_PIDNS;
+    id.pid = getpid();
+    if (env.sample_rate) {
+        ctl.rate = env.sample_rate;
+        ctl.flags = SAMPLER_F_USER;
+    }
+    err = bpf_map_update_elem(bpf_map__fd(obj->maps.id_config), &key, &id, BPF_ANY);
+    if (!err)
+        err = bpf_map_update_elem(bpf_map__fd(obj->maps.output), &key, &out, BPF_ANY);
+    if (!err)
+        err = bpf_map_update_elem(bpf_map__fd(obj->maps.sampler_ctl), &key, &ctl, BPF_ANY);
+    if (!err)
+        err = bpf_map_update_elem(bpf_map__fd(obj->maps.io_syscalls), &nr, &write_cfg, BPF_ANY);
+    if (err)
+        goto err_out;
+
+    /* Only the program under test, not the exit/exec fd invalidations */
+    if (kernel) {
+        link = bpf_program__attach(obj->progs.handle_vfs_write);
+        obj->links.handle_vfs_write = link;
+    } else {
+        link = bpf_program__attach(obj->progs.handle_tp);
+        obj->links.handle_tp = link;
+    }
+    if (!link) {
+        err = -errno;
+        goto err_out;
+    }
+    *objp = obj;
+    return 0;
+
+err_out:
+    bpf_minimal_bpf__destroy(obj);
+    return err;
+}
+
+static int run_mode(const std::string &mode, struct result *res)
+{
+    std::vector<struct worker> workers(env.threads);
+    struct ring_buffer *rb = nullptr;
+    struct bpf_minimal_bpf *obj;
+    std::thread poller;
+    std::vector<__u32> lat;
+    unsigned long long calls = 0, lat_total = 0;
+    double secs;
+    int err;
+
+    err = setup_mode(mode, &obj);
+    if (err) {
+        fprintf(stderr, "%s: failed to set up BPF: %d\n", mode.c_str(), err);
+        return err;
+    }
+    if (mode == "ringbuf") {
+        rb = ring_buffer__new(bpf_map__fd(obj->maps.events), handle_event, nullptr, nullptr);
+        if (!rb) {
+            err = -errno;
+            fprintf(stderr, "failed to create ring buffer: %d\n", err);
+            goto cleanup;
+        }
+    }
+
+    for (auto &w : workers) {
+        err = open_target(&w);
+        if (err) {
+            fprintf(stderr, "failed to open %s target: %d\n", env.target, err);
+            goto cleanup;
+        }
+    }
+
+    stop = false;
+    ring_events = 0;
+    ring_weight = 0;
+    if (rb)
+        poller = std::thread([rb] {
+            while (!stop.load(std::memory_order_relaxed))
+                ring_buffer__poll(rb, 100);
+            ring_buffer__consume(rb);
+        });
+    for (auto &w : workers) {
+        if (w.peer >= 0)
+            w.reader = std::thread(drain, w.peer);
+    }
+
+    {
+        auto start = bench_clock::now();
+
+        for (auto &w : workers)
+            w.writer = std::thread(write_loop, &w);
+        sleep(env.duration);
+        stop = true;
+        for (auto &w : workers)
+            w.writer.join();
+        secs = std::chrono::duration<double>(bench_clock::now() - start).count();
+    }
+
+    for (auto &w : workers) {
+        close(w.fd); /* EOF for the reader */
+        w.fd = -1;
+        if (w.reader.joinable())
+            w.reader.join();
+        calls += w.calls;
+        lat_total += w.lat_total;
+        lat.insert(lat.end(), w.lat.begin(), w.lat.end());
+    }
+    if (poller.joinable())
+        poller.join();
+
+    std::sort(lat.begin(), lat.end());
+    res->mode = mode;
+    res->calls_per_sec = calls / secs;
+    res->mb_per_sec = calls * env.size / secs / 1e6;
+    res->avg_ns = calls ? (double)lat_total / calls : 0;
+    res->p50_ns = lat.empty() ? 0 : lat[lat.size() / 2];
+    res->p99_ns = lat.empty() ? 0 : lat[lat.size() * 99 / 100];
+    if (rb)
+        printf("%s: %llu events received for %llu writes, weights sum to %llu\n", mode.c_str(),
+               ring_events.load(), calls, ring_weight.load());
+
+cleanup:
+    for (auto &w : workers) {
+        if (w.fd >= 0)
+            close(w.fd);
+        if (w.peer >= 0)
+            close(w.peer);
+    }
+    ring_buffer__free(rb);
+    bpf_minimal_bpf__destroy(obj);
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<struct result> results;
+    const struct result *base = nullptr;
+    size_t pos = 0;
+    int err;
+
+    err = parse_args(argc, argv);
+    if (err)
+        return 1;
+
+    set_libbpf_print(false);
+
+    while (pos <= env.modes.size()) {
+        size_t comma = env.modes.find(',', pos);
+        std::string mode = env.modes.substr(pos, comma == std::string::npos ? comma : comma - pos);
+        struct result res;
+
+        pos = comma == std::string::npos ? env.modes.size() + 1 : comma + 1;
+        if (mode.empty())
+            continue;
+        err = run_mode(mode, &res);
+        if (err)
+            return 1;
+        results.push_back(res);
+    }
+
+    printf("\n%d thread(s), %zu-byte writes to %s, %ds per mode\n", env.threads, env.size,
+           env.target, env.duration);
+    printf("%-8s %14s %10s %10s %8s %8s %12s\n", "MODE", "CALLS/s", "MB/s", "AVG_ns", "P50_ns",
+           "P99_ns", "OVERHEAD_ns");
+    for (const auto &r : results) {
+        if (r.mode == "off")
+            base = &r;
+    }
+    for (const auto &r : results) {
+        printf("%-8s %14.0f %10.1f %10.1f %8u %8u", r.mode.c_str(), r.calls_per_sec,
+               r.mb_per_sec, r.avg_ns, r.p50_ns, r.p99_ns);
+        if (base)
+            printf(" %+12.1f", r.avg_ns - base->avg_ns);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file bpf_minimal_host_bench.cpp
+ * @brief Cost and accuracy of bpf_minimal's program logic, run on the host
+ *
+ * Usage: bpf_minimal_host_bench [calls]
+ *
+ * Drives the programs of bpf_minimal.c, compiled against the host shims in
+ * host/, with synthetic syscalls: one write every 100ns of emulated time,
+ * the ring buffer drained every 4096 calls. Map and helper costs are those
+ * of the emulation, so the timings compare code paths with each other, not
+ * with the kernel; use bpf_minimal_bench for that. Runs need no root and
+ * are deterministic, so the weight estimates can be checked exactly.
+ *
+ * Build:
+ *
+ *     cmake -S host -B build-host && cmake --build build-host
+ *     ctest --test-dir build-host
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "bpf_minimal.h"
+#include "sampling.h"
+#include "host/bpf_host.h"
+#include "host/bpf_minimal_host.h"
+
+#define NS_PER_CALL 100
+#define DRAIN_EVERY 4096
+
+using bench_clock = std::chrono::steady_clock;
+
+struct scenario {
+    const char *name;
+    __u32 output;
+    struct sampler_ctl ctl;
+    struct id_config id;
+    bool untraced; /* Offer a syscall missing from io_syscalls */
+};
+
+struct counts {
+    unsigned long long events;
+    unsigned long long weight;
+};
+
+static int count_event(void *ctx, void *data, size_t size)
+{
+    struct counts *c = (struct counts *)ctx;
+    const struct write_event *e = (const struct write_event *)data;
+
+    c->events++;
+    c->weight += e->weight;
+    return 0;
+}
+
+static void setup(const struct scenario *s)
+{
+    struct io_syscall write_cfg = { IO_KIND_WRITE, 2, 0, 0 };
+    __u32 key = 0, nr = SYS_write;
+
+    bpf_host_reset();
+    bpf_minimal_host_init();
+    bpf_host_set_current(1000, 1000);
+    bpf_host_set_cgroup(42);
+    bpf_host_set_pidns(4, 0xeffffffc, 7, 7);
+    bpf_host_set_cpu(0);
+    bpf_host_set_ktime(1000000000ULL);
+    bpf_host_update("io_syscalls", &nr, &write_cfg, BPF_ANY);
+    bpf_host_update("output", &key, &s->output, BPF_ANY);
+    bpf_host_update("id_config", &key, &s->id, BPF_ANY);
+    bpf_host_update("sampler_ctl", &key, &s->ctl, BPF_ANY);
+}
+
+/* Sum of the per-CPU sampler accounting */
+static struct sampler_stats sampler_totals(void)
+{
+    struct sampler_stats sum = {};
+    __u32 key = 0;
+
+    for (__u32 cpu = 0; cpu < BPF_HOST_MAX_CPUS; cpu++) {
+        auto *st = (struct sampler_stats *)bpf_host_lookup_cpu("sampler_stats", &key, cpu);
+
+        if (!st)
+            continue;
+        sum.seen += st->seen;
+        sum.sampled += st->sampled;
+        sum.dropped += st->dropped;
+        sum.dropped_weight += st->dropped_weight;
+    }
+    return sum;
+}
+
+/**
+ * run_syscalls - Time handle_tp over a scenario
+ *
+ * @return false if an estimate that must be exact is not
+ */
+static bool run_syscalls(const struct scenario *s, size_t calls)
+{
+    unsigned long args[6] = { 3, 0, 4096, 0, 0, 0 };
+    long nr = s->untraced ? SYS_getpid : SYS_write;
+    struct counts c = {};
+    struct sampler_stats st;
+    __u32 key = 0;
+    bool ok = true;
+
+    setup(s);
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < calls; i++) {
+        bpf_host_set_ktime(bpf_host_ktime() + NS_PER_CALL);
+        bpf_minimal_host_sys_enter(nr, args);
+        if (i % DRAIN_EVERY == DRAIN_EVERY - 1)
+            bpf_host_ringbuf_consume("events", count_event, &c);
+    }
+    double secs = std::chrono::duration<double>(bench_clock::now() - start).count();
+    bpf_host_ringbuf_consume("events", count_event, &c);
+    st = sampler_totals();
+
+    printf("%-24s %8.1f %10llu %12llu", s->name, secs * 1e9 / calls, c.events, c.weight);
+    if (s->output == OUTPUT_RINGBUF && !s->untraced) {
+        /* Received plus dropped weight, against what was offered */
+        double est = c.weight + st.dropped_weight;
+
+        printf(" %+9.3f%%", (est - (double)calls) / calls * 100);
+        if (s->ctl.flags & SAMPLER_F_TOKENS) {
+            auto *b = (struct sampler_bucket *)bpf_host_lookup_cpu("sampler_bucket", &key, 0);
+
+            /* Everything seen is either emitted or pending in the bucket */
+            ok = b && c.weight + st.dropped_weight + b->pending == calls;
+        }
+    } else if (s->output == OUTPUT_PRINTK && !s->untraced) {
+        ok = bpf_host_printk_count() == calls;
+    }
+    printf("%s\n", ok ? "" : "  MISMATCH");
+    return ok;
+}
+
+static void run_vfs_write(const char *name, unsigned short mode, unsigned short family,
+                          size_t calls)
+{
+    struct scenario s = { name, OUTPUT_NONE, {}, {}, false };
+    struct in6_addr saddr = IN6ADDR_LOOPBACK_INIT, daddr = IN6ADDR_LOOPBACK_INIT;
+    struct io_bytes *v;
+    struct sock_key skey;
+    struct class_key ckey;
+    unsigned long long keys = 0;
+
+    setup(&s);
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < calls; i++) {
+        /* Spread over 64 connections so the hash lookups miss the cache */
+        bpf_minimal_host_vfs_write(mode, family, IPPROTO_TCP, &saddr, &daddr, 40000 + i % 64,
+                                   443, 4096);
+    }
+    double secs = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    for (const void *prev = nullptr; !bpf_host_get_next_key("sock_bytes", prev, &skey);
+         prev = &skey)
+        keys++;
+    ckey = { 0, 1000, family ? (__u32)FILE_CLASS_SOCKET : (__u32)FILE_CLASS_FILE };
+    v = (struct io_bytes *)bpf_host_lookup("class_bytes", &ckey);
+    printf("%-24s %8.1f %10llu %12llu  (%llu connections)\n", name, secs * 1e9 / calls,
+           v ? (unsigned long long)v->calls : 0ULL, v ? (unsigned long long)v->bytes : 0ULL,
+           keys);
+}
+
+int main(int argc, char **argv)
+{
+    size_t calls = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1 << 22;
+    struct scenario scenarios[] = {
+        { "untraced syscall", OUTPUT_NONE, {}, {}, true },
+        { "write, filter only", OUTPUT_NONE, {}, {}, false },
+        { "write, pidns+cgroup ids", OUTPUT_NONE, {}, {}, false },
+        { "write, printk", OUTPUT_PRINTK, {}, {}, false },
+        { "write, ringbuf adaptive", OUTPUT_RINGBUF, {}, {}, false },
+        { "write, ringbuf 1-in-64", OUTPUT_RINGBUF, {}, {}, false },
+        { "write, ringbuf 10k/s", OUTPUT_RINGBUF, {}, {}, false },
+    };
+    bool ok = true;
+
+    if (!calls) {
+        fprintf(stderr, "invalid call count\n");
+        return 1;
+    }
+
+    scenarios[2].id = { 4, 0xeffffffc, 42, 7, ID_F_PIDNS | ID_F_CGROUP };
+    scenarios[5].ctl.rate = 64;
+    scenarios[5].ctl.flags = SAMPLER_F_USER;
+    scenarios[6].ctl.tokens_per_sec = 10000;
+    scenarios[6].ctl.flags = SAMPLER_F_TOKENS;
+
+    printf("%zu calls, one per %dns of emulated time\n", calls, NS_PER_CALL);
+    printf("%-24s %8s %10s %12s %10s\n", "SCENARIO", "NS/CALL", "EVENTS", "WEIGHT", "EST_ERR");
+    for (const auto &s : scenarios)
+        ok &= run_syscalls(&s, calls);
+
+    printf("\n%-24s %8s %10s %12s\n", "VFS_WRITE", "NS/CALL", "CALLS", "BYTES");
+    run_vfs_write("regular file", S_IFREG, 0, calls);
+    run_vfs_write("tcp6 socket", S_IFSOCK, AF_INET6, calls);
+    return !ok;
+}
@@ -0,0 +1,745 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file bpf_minimal_loader.cpp
+ * @brief Userspace loader for bpf_minimal.c
+ *
+ * Fills the io_syscalls filter with the syscall numbers of the running
+ * architecture, attaches handle_tp to raw_syscalls:sys_enter and prints
+ * the sampled events streamed through the ring buffer, which it selects
+ * through the output map whatever USE_RINGBUF is set to.
+ *
+ * With -f, fds are resolved to paths or socket tuples through FdCache,
+ * which bpf_minimal.c keeps coherent by reporting closes; with -a, events
+ * are summed per process and target and printed every interval.
+ *
+ * With -S, handle_vfs_write is loaded as well and the bytes it sums in the
+ * kernel per file class and per connection are printed every -a interval,
+ * or once at exit.
+ *
+ * -N reports pids as seen in a pid namespace (our own by default, so a
+ * loader run inside a container sees container pids) and -C keys totals by
+ * cgroup; both are resolved in the kernel from the id_config map.
+ *
+ * The sampler in front of the ring buffer is adaptive by default; -s fixes
+ * it to 1-in-N per CPU and -r to a per-CPU token bucket. Either way every
+ * event carries its weight and totals are sums of weights. The adaptive
+ * rate is driven from here by consumer lag (see adapt_rate()), so it rises
+ * before the ring buffer fills rather than after events are lost.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "bpf_minimal.h"
+#include "bpf_minimal.skel.h"
+#include "fd_cache.hpp"
+#include "sampling.h"
+#include "trace_helpers.hpp"
+
+struct io_syscall_def {
+    const char *name;
+    long nr;
+    struct io_syscall cfg;
+    bool bytes; /* write_event.count is a byte count */
+};
+
+/* Numbers come from <sys/syscall.h>, i.e. the architecture built for */
+static const struct io_syscall_def io_syscall_defs[] = {
+    { "read", SYS_read, { IO_KIND_READ, 2, 0, 0 }, true },
+    { "write", SYS_write, { IO_KIND_WRITE, 2, 0, 0 }, true },
+    { "writev", SYS_writev, { IO_KIND_WRITE, 2, 0, 0 }, false },
+    { "pwrite64", SYS_pwrite64, { IO_KIND_WRITE, 2, 0, 0 }, true },
+    { "sendto", SYS_sendto, { IO_KIND_SEND, 2, 0, 0 }, true },
+    { "sendmsg", SYS_sendmsg, { IO_KIND_SEND, IO_NO_COUNT, 0, 0 }, false },
+    { "sendmmsg", SYS_sendmmsg, { IO_KIND_SEND, 2, 0, 0 }, false },
+    { "io_uring_enter", SYS_io_uring_enter, { IO_KIND_URING, 1, 0, 0 }, false },
+};
+
+/* Reported to FdCache only, never selected with -e */
+static const struct io_syscall_def fd_close_defs[] = {
+    { "close", SYS_close, { IO_KIND_CLOSE, IO_NO_COUNT, 0, 0 }, false },
+#ifdef SYS_dup2
+    { "dup2", SYS_dup2, { IO_KIND_CLOSE, IO_NO_COUNT, 1, 0 }, false },
+#endif
+    { "dup3", SYS_dup3, { IO_KIND_CLOSE, IO_NO_COUNT, 1, 0 }, false },
+#ifdef SYS_close_range
+    { "close_range", SYS_close_range, { IO_KIND_CLOSE_RANGE, 1, 0, 0 }, false },
+#endif
+};
+
+static struct env {
+    std::vector<const struct io_syscall_def *> syscalls;
+    bool fds;
+    bool sockets;
+    const char *pidns;
+    const char *cgroup;
+    bool per_cgroup;
+    __u32 pid;
+    __u32 sample_rate;
+    __u32 tokens_per_sec;
+    __u32 burst;
+    int aggregate;
+    bool verbose;
+} env;
+
+struct io_total {
+    unsigned long long calls;
+    unsigned long long bytes;
+};
+
+/* Ring buffer fill, in percent, that doubles the adaptive rate */
+#define LAG_HIGH_PCT 50
+/* Fill under which the rate is halved once nothing was dropped for LAG_IDLE_NS */
+#define LAG_LOW_PCT 12
+#define LAG_IDLE_NS 1000000000ULL
+
+static FdCache *fd_cache;
+static unsigned long long total_weight;
+/* (pid, cgroup id, target), pid is 0 with -C */
+static std::map<std::tuple<__u32, __u64, std::string>, struct io_total> totals;
+
+static const char usage[] =
+    "Usage: bpf_minimal_loader [OPTION...]\n"
+    "Trace data-path I/O syscalls with bpf_minimal.\n"
+    "\n"
+    "  -e, --syscalls=LIST       Comma-separated syscalls to trace (default: all of\n"
+    "                            read,write,writev,pwrite64,sendto,sendmsg,\n"
+    "                            sendmmsg,io_uring_enter)\n"
+    "  -f, --fds                 Resolve fds to file paths and socket tuples\n"
+    "  -a, --aggregate=SECS      Print totals per process and target every SECS\n"
+    "  -S, --sockets             Sum write(2) bytes in the kernel per file class\n"
+    "                            and per connection\n"
+    "  -N, --pidns[=PATH]        Report pids in the pid namespace of PATH (default:\n"
+    "                            /proc/self/ns/pid), skip processes outside it\n"
+    "  -p, --pid=PID             Trace only this process (in the -N namespace)\n"
+    "  -c, --cgroup=PATH         Trace only this cgroup v2 directory\n"
+    "  -C, --per-cgroup          Sum totals per cgroup instead of per process\n"
+    "  -s, --sample=N            Emit 1 in N syscalls per CPU (default: adaptive)\n"
+    "  -r, --rate-limit=N[,B]    Emit at most N syscalls per second per CPU, in\n"
+    "                            bursts of up to B (default: 64)\n"
+    "  -v, --verbose             Verbose debug output\n"
+    "  -h, --help                Show this help\n"
+    "\n"
+    "Examples:\n"
+    "    bpf_minimal_loader                  # all I/O syscalls\n"
+    "    bpf_minimal_loader -e write,writev  # writes only\n"
+    "    bpf_minimal_loader -f -a 5          # bytes per file and socket every 5s\n"
+    "    bpf_minimal_loader -S -e write -a 1 # per-connection write throughput\n"
+    "    bpf_minimal_loader -N -p 1 -f       # pid 1 of this container\n"
+    "    bpf_minimal_loader -C -a 5          # I/O per cgroup every 5s\n"
+    "    bpf_minimal_loader -r 1000 -a 1     # totals from 1000 events/s/CPU\n";
+
+static const struct option long_opts[] = {
+    { "syscalls", required_argument, nullptr, 'e' },
+    { "fds", no_argument, nullptr, 'f' },
+    { "aggregate", required_argument, nullptr, 'a' },
+    { "sockets", no_argument, nullptr, 'S' },
+    { "pidns", optional_argument, nullptr, 'N' },
+    { "pid", required_argument, nullptr, 'p' },
+    { "cgroup", required_argument, nullptr, 'c' },
+    { "per-cgroup", no_argument, nullptr, 'C' },
+    { "sample", required_argument, nullptr, 's' },
+    { "rate-limit", required_argument, nullptr, 'r' },
+    { "verbose", no_argument, nullptr, 'v' },
+    { "help", no_argument, nullptr, 'h' },
+    {},
+};
+
+static const struct io_syscall_def *find_syscall(const char *name)
+{
+    for (const auto &d : io_syscall_defs)
+        if (!strcmp(d.name, name))
+            return &d;
+    return nullptr;
+}
+
+static const struct io_syscall_def *syscall_def(__u32 nr)
+{
+    for (const auto &d : io_syscall_defs)
+        if (d.nr == nr)
+            return &d;
+    return nullptr;
+}
+
+/* Whether @path is the pid namespace this process lives in */
+static bool own_pidns(const char *path)
+{
+    struct stat st, own;
+
+    return !stat(path, &st) && !stat("/proc/self/ns/pid", &own) && st.st_dev == own.st_dev &&
+           st.st_ino == own.st_ino;
+}
+
+static int parse_args(int argc, char **argv)
+{
+    unsigned long long val;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "e:fa:SN::p:c:Cs:r:vh", long_opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'e':
+            for (char *tok = strtok(optarg, ","); tok; tok = strtok(nullptr, ",")) {
+                const struct io_syscall_def *d = find_syscall(tok);
+
+                if (!d) {
+                    fprintf(stderr, "unsupported syscall: %s\n", tok);
+                    return -EINVAL;
+                }
+                env.syscalls.push_back(d);
+            }
+            break;
+        case 'f':
+            env.fds = true;
+            break;
+        case 'a':
+            if (!parse_ull(optarg, &val) || !val || val > 99999999) {
+                fprintf(stderr, "invalid aggregation interval: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.aggregate = val;
+            break;
+        case 'S':
+            env.sockets = true;
+            break;
+        case 'N':
+            env.pidns = optarg ? optarg : "/proc/self/ns/pid";
+            break;
+        case 'p':
+            if (!parse_ull(optarg, &val) || !val || val > UINT32_MAX) {
+                fprintf(stderr, "invalid PID: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.pid = val;
+            break;
+        case 'c':
+            env.cgroup = optarg;
+            break;
+        case 'C':
+            env.per_cgroup = true;
+            break;
+        case 's':
+            if (!parse_ull(optarg, &val) || !val || val > UINT32_MAX) {
+                fprintf(stderr, "invalid sampling rate: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.sample_rate = val;
+            break;
+        case 'r': {
+            char *burst = strchr(optarg, ',');
+
+            if (burst)
+                *burst++ = '\0';
+            if (!parse_ull(optarg, &val) || !val || val > UINT32_MAX) {
+                fprintf(stderr, "invalid rate limit: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.tokens_per_sec = val;
+            if (burst) {
+                if (!parse_ull(burst, &val) || !val || val > UINT32_MAX) {
+                    fprintf(stderr, "invalid burst: %s\n", burst);
+                    return -EINVAL;
+                }
+                env.burst = val;
+            }
+            break;
+        }
+        case 'v':
+            env.verbose = true;
+            break;
+        case 'h':
+            fputs(usage, stdout);
+            exit(0);
+        default:
+            fputs(usage, stderr);
+            return -EINVAL;
+        }
+    }
+    if (optind < argc) {
+        fprintf(stderr, "unrecognized positional argument: %s\n", argv[optind]);
+        return -EINVAL;
+    }
+    if (env.sample_rate && env.tokens_per_sec) {
+        fprintf(stderr, "-s and -r are mutually exclusive\n");
+        return -EINVAL;
+    }
+    /* FdCache reads /proc/<pid>, which only knows the pids of our namespace */
+    if (env.fds && env.pidns && !own_pidns(env.pidns)) {
+        fprintf(stderr, "-f needs -N to name this process' own pid namespace\n");
+        return -EINVAL;
+    }
+    if (env.syscalls.empty())
+        for (const auto &d : io_syscall_defs)
+            env.syscalls.push_back(&d);
+    return 0;
+}
+
+/**
+ * fill_id_config - Select how processes are identified and filtered
+ * @obj: Loaded skeleton
+ *
+ * A pid namespace is named by the device and inode of its nsfs file, a
+ * cgroup v2 by the inode of its directory, which is its id.
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+static int fill_id_config(struct bpf_minimal_bpf *obj)
+{
+    struct id_config cfg = {};
+    struct stat st;
+    __u32 key = 0;
+
+    if (env.pidns) {
+        if (stat(env.pidns, &st)) {
+            fprintf(stderr, "failed to stat pid namespace %s: %s\n", env.pidns,
+                    strerror(errno));
+            return -errno;
+        }
+        cfg.pidns_dev = st.st_dev;
+        cfg.pidns_ino = st.st_ino;
+        cfg.flags |= ID_F_PIDNS;
+    }
+    if (env.cgroup) {
+        if (stat(env.cgroup, &st)) {
+            fprintf(stderr, "failed to stat cgroup %s: %s\n", env.cgroup, strerror(errno));
+            return -errno;
+        }
+        cfg.cgroup = st.st_ino;
+    }
+    if (env.per_cgroup)
+        cfg.flags |= ID_F_CGROUP;
+    cfg.pid = env.pid;
+
+    return bpf_map_update_elem(bpf_map__fd(obj->maps.id_config), &key, &cfg, BPF_ANY);
+}
+
+/**
+ * fill_output - Send events to the ring buffer rather than bpf_printk
+ * @obj: Loaded skeleton
+ */
+static int fill_output(struct bpf_minimal_bpf *obj)
+{
+    __u32 key = 0, out = OUTPUT_RINGBUF;
+
+    return bpf_map_update_elem(bpf_map__fd(obj->maps.output), &key, &out, BPF_ANY);
+}
+
+/**
+ * fill_sampler_ctl - Select the sampling mode
+ * @obj: Loaded skeleton
+ *
+ * The adaptive default starts at 1-in-1 with SAMPLER_F_USER, the program
+ * only records drops and adapt_rate() moves the rate.
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+static int fill_sampler_ctl(struct bpf_minimal_bpf *obj)
+{
+    struct sampler_ctl ctl = {};
+    __u32 key = 0;
+
+    if (env.sample_rate) {
+        ctl.rate = env.sample_rate;
+        ctl.flags = SAMPLER_F_USER;
+    } else if (env.tokens_per_sec) {
+        ctl.tokens_per_sec = env.tokens_per_sec;
+        ctl.burst = env.burst;
+        ctl.flags = SAMPLER_F_TOKENS;
+    } else {
+        ctl.rate = 1;
+        ctl.flags = SAMPLER_F_USER;
+    }
+    return bpf_map_update_elem(bpf_map__fd(obj->maps.sampler_ctl), &key, &ctl, BPF_ANY);
+}
+
+static __u64 monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * adapt_rate - Move the adaptive sampling rate from consumer lag
+ * @obj: Loaded skeleton
+ * @r: The events ring
+ *
+ * Called before each poll: what is left in the ring then was produced while
+ * the previous batch was being handled. Above LAG_HIGH_PCT, or after a
+ * drop, the rate is doubled up to SAMPLER_DEF_MAX_RATE; once the ring stayed
+ * under LAG_LOW_PCT without drops for LAG_IDLE_NS it is halved. Timestamps
+ * are kept in sampler_ctl, in the program's clock, so the drop the program
+ * records and the adjustments made here compare directly.
+ */
+static void adapt_rate(struct bpf_minimal_bpf *obj, struct ring *r)
+{
+    static __u64 seen_drop_ns, busy_ns;
+    int fd = bpf_map__fd(obj->maps.sampler_ctl);
+    struct sampler_ctl ctl;
+    __u64 fill, now;
+    __u32 key = 0, rate;
+
+    if (env.sample_rate || env.tokens_per_sec)
+        return;
+    if (bpf_map_lookup_elem(fd, &key, &ctl))
+        return;
+
+    now = monotonic_ns();
+    fill = ring__avail_data_size(r) * 100 / ring__size(r);
+    rate = ctl.rate ?: 1;
+    if (fill >= LAG_LOW_PCT)
+        busy_ns = now;
+
+    if (fill >= LAG_HIGH_PCT || ctl.last_drop_ns != seen_drop_ns) {
+        seen_drop_ns = ctl.last_drop_ns;
+        if (rate >= SAMPLER_DEF_MAX_RATE)
+            return;
+        rate *= 2;
+    } else if (rate > 1 && now - busy_ns >= LAG_IDLE_NS &&
+               now - ctl.last_drop_ns >= LAG_IDLE_NS &&
+               now - ctl.last_adjust_ns >= LAG_IDLE_NS) {
+        rate /= 2;
+    } else {
+        return;
+    }
+
+    ctl.rate = rate;
+    ctl.last_adjust_ns = now;
+    if (bpf_map_update_elem(fd, &key, &ctl, BPF_ANY))
+        return;
+    if (env.verbose)
+        fprintf(stderr, "sampling rate 1-in-%u (ring %llu%% full)\n", rate,
+                (unsigned long long)fill);
+}
+
+/* PID column, or cgroup path column with -C */
+static std::string owner_name(__u32 pid, __u64 cgroup)
+{
+    return env.per_cgroup ? cgroup_name(cgroup) : std::to_string(pid);
+}
+
+/**
+ * fill_io_syscalls - Enable the selected syscalls in the filter map
+ * @obj: Loaded skeleton
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+static int fill_io_syscalls(struct bpf_minimal_bpf *obj)
+{
+    int fd = bpf_map__fd(obj->maps.io_syscalls);
+    std::vector<const struct io_syscall_def *> defs = env.syscalls;
+    int err;
+
+    if (env.fds)
+        for (const auto &d : fd_close_defs)
+            defs.push_back(&d);
+
+    for (const auto *d : defs) {
+        __u32 nr = d->nr;
+
+        if (nr >= MAX_SYSCALL_NR) {
+            fprintf(stderr, "syscall %s (%u) beyond filter size\n", d->name, nr);
+            return -ERANGE;
+        }
+        err = bpf_map_update_elem(fd, &nr, &d->cfg, BPF_ANY);
+        if (err)
+            return err;
+    }
+    return 0;
+}
+
+static int handle_event(void *ctx, void *data, size_t data_sz)
+{
+    const struct write_event *e = (const struct write_event *)data;
+    const struct io_syscall_def *d;
+    std::string target;
+
+    if (data_sz < sizeof(*e))
+        return 0;
+
+    /* Unsampled fd invalidation */
+    if (!e->weight) {
+        if (!fd_cache)
+            return 0;
+        if (e->nr == NR_FD_INVAL_ALL)
+            fd_cache->invalidate_all(e->pid);
+        else
+            fd_cache->invalidate_range(e->pid, e->fd, e->count);
+        return 0;
+    }
+
+    total_weight += e->weight;
+    d = syscall_def(e->nr);
+    if (fd_cache)
+        target = fd_cache->resolve(e->pid, e->fd);
+    else
+        target = "fd " + std::to_string(e->fd);
+
+    if (env.aggregate) {
+        struct io_total &t = totals[{ env.per_cgroup ? 0 : e->pid, e->cgroup, target }];
+
+        t.calls += e->weight;
+        if (d && d->bytes)
+            t.bytes += e->count * e->weight;
+        return 0;
+    }
+
+    printf("%-16llu %-8u %-16s %-6u %12llu %8u %s%s%s\n", (unsigned long long)e->ts, e->pid,
+           d ? d->name : "?", e->fd, (unsigned long long)e->count, e->weight,
+           env.per_cgroup ? cgroup_name(e->cgroup).c_str() : "",
+           env.per_cgroup && fd_cache ? " " : "", fd_cache ? target.c_str() : "");
+    return 0;
+}
+
+/**
+ * print_totals - Print and reset the per-process, per-target totals
+ *
+ * Totals are weighted, i.e. estimates of all syscalls including the ones
+ * the sampler skipped. Bytes only count syscalls whose size is known.
+ */
+static void print_totals(void)
+{
+    std::vector<std::pair<std::tuple<__u32, __u64, std::string>, struct io_total>> rows(
+        totals.begin(), totals.end());
+    int width = env.per_cgroup ? 32 : 8;
+
+    std::sort(rows.begin(), rows.end(),
+              [](const auto &a, const auto &b) { return a.second.bytes > b.second.bytes; });
+    printf("\n%-*s %-56s %12s %14s\n", width, env.per_cgroup ? "CGROUP" : "PID", "TARGET",
+           "CALLS", "BYTES");
+    for (const auto &r : rows)
+        printf("%-*s %-56s %12llu %14llu\n", width,
+               owner_name(std::get<0>(r.first), std::get<1>(r.first)).c_str(),
+               std::get<2>(r.first).c_str(), r.second.calls, r.second.bytes);
+    totals.clear();
+}
+
+static const char *const class_names[MAX_FILE_CLASSES] = { "other", "file", "pipe", "socket" };
+
+static std::string sock_name(const struct sock_key *k)
+{
+    char saddr[INET6_ADDRSTRLEN], daddr[INET6_ADDRSTRLEN], buf[160];
+    const char *proto = k->protocol == IPPROTO_TCP ? "tcp" :
+                        k->protocol == IPPROTO_UDP ? "udp" : "ip";
+
+    if (k->family == AF_UNIX)
+        return "unix";
+    if (k->family != AF_INET && k->family != AF_INET6)
+        return "family " + std::to_string(k->family);
+    inet_ntop(k->family, k->saddr, saddr, sizeof(saddr));
+    inet_ntop(k->family, k->daddr, daddr, sizeof(daddr));
+    snprintf(buf, sizeof(buf), k->family == AF_INET6 ? "%s [%s]:%u->[%s]:%u" : "%s %s:%u->%s:%u",
+             proto, saddr, k->sport, daddr, k->dport);
+    return buf;
+}
+
+/**
+ * drain_bytes - Read and delete every entry of class_bytes or sock_bytes
+ * @fd: Map
+ * @rows: Filled with the entries, sorted by bytes
+ *
+ * Entries created after the walk passed them survive to the next interval.
+ */
+template <typename K>
+static void drain_bytes(int fd, std::vector<std::pair<K, struct io_bytes>> &rows)
+{
+    K key, next_key, *prev = nullptr;
+    struct io_bytes v;
+
+    while (!bpf_map_get_next_key(fd, prev, &next_key)) {
+        key = next_key;
+        prev = &key;
+        if (!bpf_map_lookup_elem(fd, &next_key, &v))
+            rows.emplace_back(next_key, v);
+    }
+    for (const auto &r : rows)
+        bpf_map_delete_elem(fd, &r.first);
+    std::sort(rows.begin(), rows.end(),
+              [](const auto &a, const auto &b) { return a.second.bytes > b.second.bytes; });
+}
+
+/**
+ * print_writes - Print and reset the handle_vfs_write totals
+ * @obj: Loaded skeleton
+ */
+static void print_writes(struct bpf_minimal_bpf *obj)
+{
+    std::vector<std::pair<struct class_key, struct io_bytes>> classes;
+    std::vector<std::pair<struct sock_key, struct io_bytes>> socks;
+
+    drain_bytes(bpf_map__fd(obj->maps.class_bytes), classes);
+    drain_bytes(bpf_map__fd(obj->maps.sock_bytes), socks);
+
+    const char *owner = env.per_cgroup ? "CGROUP" : "PID";
+    int width = env.per_cgroup ? 32 : 8;
+
+    printf("\n%-*s %-8s %12s %14s\n", width, owner, "CLASS", "WRITES", "BYTES");
+    for (const auto &r : classes)
+        printf("%-*s %-8s %12llu %14llu\n", width,
+               owner_name(r.first.pid, r.first.cgroup).c_str(),
+               r.first.cls < MAX_FILE_CLASSES ? class_names[r.first.cls] : "?",
+               (unsigned long long)r.second.calls, (unsigned long long)r.second.bytes);
+
+    printf("\n%-*s %-64s %12s %14s\n", width, owner, "CONNECTION", "WRITES", "BYTES");
+    for (const auto &r : socks)
+        printf("%-*s %-64s %12llu %14llu\n", width,
+               owner_name(r.first.pid, r.first.cgroup).c_str(), sock_name(&r.first).c_str(),
+               (unsigned long long)r.second.calls, (unsigned long long)r.second.bytes);
+}
+
+static void print_sampler_stats(struct bpf_minimal_bpf *obj)
+{
+    int ncpus = libbpf_num_possible_cpus();
+    std::vector<struct sampler_stats> stats(ncpus > 0 ? ncpus : 0);
+    struct sampler_stats sum = {};
+    __u32 key = 0;
+
+    if (stats.empty() ||
+        bpf_map_lookup_elem(bpf_map__fd(obj->maps.sampler_stats), &key, stats.data()))
+        return;
+    for (const auto &s : stats) {
+        sum.seen += s.seen;
+        sum.sampled += s.sampled;
+        sum.dropped += s.dropped;
+        sum.dropped_weight += s.dropped_weight;
+    }
+    fprintf(stderr, "%llu syscalls seen, %llu sampled, %llu dropped (weight %llu)\n",
+            (unsigned long long)sum.seen, (unsigned long long)sum.sampled,
+            (unsigned long long)sum.dropped, (unsigned long long)sum.dropped_weight);
+    /* Short of seen by dropped weight, records left queued and with -r the
+     * events after each CPU's last emitted one */
+    fprintf(stderr, "%llu syscalls estimated from received weights\n", total_weight);
+}
+
+int main(int argc, char **argv)
+{
+    struct ring_buffer *rb = nullptr;
+    struct bpf_minimal_bpf *obj;
+    time_t last_print;
+    int err;
+
+    err = parse_args(argc, argv);
+    if (err)
+        return 1;
+
+    set_libbpf_print(env.verbose);
+
+    obj = bpf_minimal_bpf__open();
+    if (!obj) {
+        fprintf(stderr, "failed to open BPF object\n");
+        return 1;
+    }
+
+    /* fexit needs BTF and trampolines, keep it out unless asked for */
+    if (!env.sockets)
+        bpf_program__set_autoload(obj->progs.handle_vfs_write, false);
+
+    err = bpf_minimal_bpf__load(obj);
+    if (err) {
+        fprintf(stderr, "failed to load BPF object: %d\n", err);
+        goto cleanup;
+    }
+
+    /* Before attaching, so no selected syscall is missed at start */
+    err = fill_id_config(obj);
+    if (err) {
+        fprintf(stderr, "failed to fill id config: %d\n", err);
+        goto cleanup;
+    }
+    err = fill_output(obj);
+    if (err) {
+        fprintf(stderr, "failed to select ring buffer output: %d\n", err);
+        goto cleanup;
+    }
+    err = fill_sampler_ctl(obj);
+    if (err) {
+        fprintf(stderr, "failed to configure sampler: %d\n", err);
+        goto cleanup;
+    }
+    err = fill_io_syscalls(obj);
+    if (err) {
+        fprintf(stderr, "failed to fill syscall filter: %d\n", err);
+        goto cleanup;
+    }
+
+    err = bpf_minimal_bpf__attach(obj);
+    if (err) {
+        fprintf(stderr, "failed to attach BPF programs\n");
+        goto cleanup;
+    }
+
+    if (env.fds)
+        fd_cache = new FdCache(bpf_map__fd(obj->maps.fd_watch),
+                               bpf_map__fd(obj->maps.fd_lost));
+
+    rb = ring_buffer__new(bpf_map__fd(obj->maps.events), handle_event, nullptr, nullptr);
+    if (!rb) {
+        err = -errno;
+        fprintf(stderr, "failed to create ring buffer: %d\n", err);
+        goto cleanup;
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    printf("Tracing I/O syscalls... Hit Ctrl-C to end.\n");
+    if (!env.aggregate)
+        printf("%-16s %-8s %-16s %-6s %12s %8s %s%s%s\n", "TS", "PID", "SYSCALL", "FD", "COUNT",
+               "WEIGHT", env.per_cgroup ? "CGROUP" : "", env.per_cgroup && env.fds ? " " : "",
+               env.fds ? "TARGET" : "");
+    last_print = time(nullptr);
+
+    while (!exiting) {
+        if (env.aggregate && time(nullptr) - last_print >= env.aggregate) {
+            print_totals();
+            if (env.sockets)
+                print_writes(obj);
+            last_print = time(nullptr);
+        }
+        adapt_rate(obj, ring_buffer__ring(rb, 0));
+        err = ring_buffer__poll(rb, 100);
+        if (err == -EINTR) {
+            err = 0;
+            break;
+        }
+        if (err < 0) {
+            fprintf(stderr, "error polling ring buffer: %d\n", err);
+            goto cleanup;
+        }
+        err = 0;
+    }
+    if (env.aggregate)
+        print_totals();
+    if (env.sockets)
+        print_writes(obj);
+    print_sampler_stats(obj);
+    if (fd_cache)
+        fprintf(stderr, "fd cache: %llu hits, %llu misses, %llu flushes\n",
+                (unsigned long long)fd_cache->hits(), (unsigned long long)fd_cache->misses(),
+                (unsigned long long)fd_cache->flushes());
+
+cleanup:
+    ring_buffer__free(rb);
+    delete fd_cache;
+    bpf_minimal_bpf__destroy(obj);
+
+    return err != 0;
+}
@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file fd_cache.cpp
+ * @brief Cache of what the file descriptors of traced processes point at
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+#include "fd_cache.hpp"
+
+static const std::string unknown = "[unknown]";
+
+/* /proc/net address: IPv4 as one host-order word, IPv6 as four of them */
+static bool format_addr(const char *hex, bool v6, char *buf, size_t size)
+{
+    uint32_t words[4];
+    unsigned int port;
+    char ip[INET6_ADDRSTRLEN];
+    int n = v6 ? 4 : 1;
+
+    for (int i = 0; i < n; i++)
+        if (sscanf(hex + 8 * i, "%8" SCNx32, &words[i]) != 1)
+            return false;
+    if (sscanf(hex + 8 * n, ":%x", &port) != 1)
+        return false;
+    if (!inet_ntop(v6 ? AF_INET6 : AF_INET, words, ip, sizeof(ip)))
+        return false;
+    snprintf(buf, size, v6 ? "[%s]:%u" : "%s:%u", ip, port);
+    return true;
+}
+
+std::string FdCache::describe_socket(uint32_t pid, unsigned long inode)
+{
+    static const char *const tables[] = { "tcp", "tcp6", "udp", "udp6" };
+    char path[64], line[512], local[64], remote[64];
+
+    for (const char *table : tables) {
+        bool v6 = table[3] == '6';
+        bool found = false;
+        FILE *f;
+
+        snprintf(path, sizeof(path), "/proc/%u/net/%s", pid, table);
+        f = fopen(path, "r");
+        if (!f)
+            continue;
+        /* "sl local_address rem_address st tx:rx tr:when retrnsmt uid timeout inode" */
+        while (fgets(line, sizeof(line), f)) {
+            char laddr[64], raddr[64];
+            unsigned long ino;
+
+            if (sscanf(line, "%*s %63s %63s %*s %*s %*s %*s %*s %*s %lu", laddr, raddr,
+                       &ino) != 3 || ino != inode)
+                continue;
+            found = format_addr(laddr, v6, local, sizeof(local)) &&
+                    format_addr(raddr, v6, remote, sizeof(remote));
+            break;
+        }
+        fclose(f);
+        if (found)
+            return std::string(table) + " " + local + "->" + remote;
+    }
+    /* Unix and other families keep the inode */
+    return "socket:[" + std::to_string(inode) + "]";
+}
+
+std::string FdCache::describe(uint32_t pid, uint32_t fd)
+{
+    char path[64], target[4096];
+    unsigned long inode;
+    ssize_t len;
+
+    snprintf(path, sizeof(path), "/proc/%u/fd/%u", pid, fd);
+    len = readlink(path, target, sizeof(target) - 1);
+    if (len <= 0)
+        return unknown;
+    target[len] = '\0';
+
+    if (sscanf(target, "socket:[%lu]", &inode) == 1)
+        return describe_socket(pid, inode);
+    return target;
+}
+
+FdCache::FdCache(int watch_fd, int lost_fd) : watch_fd_(watch_fd)
+{
+    void *p;
+
+    if (lost_fd < 0)
+        return;
+    p = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, lost_fd, 0);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "fd cache: cannot map fd_lost, lost invalidations go unnoticed\n");
+        return;
+    }
+    lost_ = (const volatile uint64_t *)p;
+    lost_seen_ = *lost_;
+}
+
+FdCache::~FdCache()
+{
+    if (lost_)
+        munmap((void *)lost_, sysconf(_SC_PAGESIZE));
+}
+
+const std::string &FdCache::resolve(uint32_t pid, uint32_t fd)
+{
+    /*
+     * An invalidation lost before this event was reserved is counted by
+     * now; which entry it was for is unknown, so drop them all
+     */
+    if (lost_ && *lost_ != lost_seen_) {
+        lost_seen_ = *lost_;
+        procs_.clear();
+        flushes_++;
+    }
+
+    auto proc = procs_.find(pid);
+
+    if (proc != procs_.end()) {
+        auto it = proc->second.find(fd);
+
+        if (it != proc->second.end()) {
+            hits_++;
+            return it->second;
+        }
+    } else {
+        __u8 one = 1;
+
+        /* Watch before reading /proc so a close racing with it is reported */
+        if (watch_fd_ >= 0 && bpf_map_update_elem(watch_fd_, &pid, &one, BPF_ANY))
+            return unknown; /* fd_watch full: invalidations would be missed */
+        proc = procs_.emplace(pid, std::unordered_map<uint32_t, std::string>()).first;
+    }
+
+    /* An fd that is not open yet gives no close to invalidate on, keep it out */
+    misses_++;
+    std::string target = describe(pid, fd);
+    if (target == unknown)
+        return unknown;
+    return proc->second.emplace(fd, std::move(target)).first->second;
+}
+
+void FdCache::invalidate(uint32_t pid, uint32_t fd)
+{
+    auto proc = procs_.find(pid);
+
+    if (proc != procs_.end())
+        proc->second.erase(fd);
+}
+
+void FdCache::invalidate_range(uint32_t pid, uint32_t first, uint32_t last)
+{
+    auto proc = procs_.find(pid);
+
+    if (proc == procs_.end())
+        return;
+    /* close_range() is often called up to ~0U, walk what is cached instead */
+    for (auto it = proc->second.begin(); it != proc->second.end();) {
+        if (it->first >= first && it->first <= last)
+            it = proc->second.erase(it);
+        else
+            ++it;
+    }
+}
+
+void FdCache::invalidate_all(uint32_t pid)
+{
+    procs_.erase(pid);
+}
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __FD_CACHE_HPP
+#define __FD_CACHE_HPP
+
+/**
+ * @file fd_cache.hpp
+ * @brief Cache of what the file descriptors of traced processes point at
+ *
+ * A (pid, fd) pair is resolved once through /proc/<pid>/fd and served from
+ * the cache until bpf_minimal.c reports that the fd was closed or replaced
+ * (close, close_range, dup2, dup3) or that the process exec'd or exited.
+ * Those reports are only sent for processes listed in the fd_watch map,
+ * which the cache fills before its first lookup of a process. A report
+ * that did not fit in the ring buffer is counted in the fd_lost map, and
+ * the cache is dropped as a whole the next time it is used after that.
+ *
+ * Fds closed without a syscall of their own are not reported: io_uring
+ * IORING_OP_CLOSE requests and fds reused after such a close can resolve
+ * to their previous target until the process execs or exits.
+ *
+ * Regular files resolve to their path, sockets to "proto local->remote"
+ * found by inode in /proc/<pid>/net, anything else (pipes, anon inodes) to
+ * the /proc link text. Resolution reflects the fd table at the time the
+ * event is consumed, which lags the syscall by the ring buffer delay.
+ */
+
+#include <cstdint>
+#include <sys/types.h>
+#include <string>
+#include <unordered_map>
+
+class FdCache {
+public:
+    /**
+     * @watch_fd: fd_watch map of the loaded bpf_minimal object, -1 for none
+     * @lost_fd: fd_lost map of the same object, -1 to not check for losses
+     */
+    FdCache(int watch_fd, int lost_fd);
+    FdCache(const FdCache &) = delete;
+    FdCache &operator=(const FdCache &) = delete;
+    ~FdCache();
+
+    /**
+     * resolve - Target of a file descriptor
+     * @pid: Process ID (tgid)
+     * @fd: File descriptor
+     *
+     * @return the cached or freshly resolved description, "[unknown]" if
+     * the process or fd is gone
+     */
+    const std::string &resolve(uint32_t pid, uint32_t fd);
+
+    /**
+     * invalidate - Forget one fd of a process
+     */
+    void invalidate(uint32_t pid, uint32_t fd);
+
+    /**
+     * invalidate_range - Forget the fds @first to @last of a process
+     */
+    void invalidate_range(uint32_t pid, uint32_t first, uint32_t last);
+
+    /**
+     * invalidate_all - Forget every fd of a process
+     *
+     * bpf_minimal.c drops the process from fd_watch itself.
+     */
+    void invalidate_all(uint32_t pid);
+
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+    uint64_t flushes() const { return flushes_; } /* Drops after lost invalidations */
+
+private:
+    std::string describe(uint32_t pid, uint32_t fd);
+    std::string describe_socket(uint32_t pid, unsigned long inode);
+
+    int watch_fd_;
+    const volatile uint64_t *lost_ = nullptr; /* fd_lost, mapped */
+    uint64_t lost_seen_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t flushes_ = 0;
+    std::unordered_map<uint32_t, std::unordered_map<uint32_t, std::string>> procs_;
+};
+
+#endif /* __FD_CACHE_HPP */
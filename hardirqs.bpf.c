@@ -17,7 +17,22 @@
  * - Count interrupt occurrences per interrupt name
  * - Measure interrupt handling latency (in ns or μs)
  * - Generate latency distributions using log2 histogram
+ * - Or collect count, total, min, max and histogram together in one pass
+ * - Optionally keep rolling per-window histograms readable without resets
+ * - Optionally update per-CPU statistics that a bpf_timer periodically
+ *   folds into infos, so userspace reads a single small map
+ * - Optionally track moving averages of rate and latency per irq and CPU
+ *   and notify userspace when an interrupt storm starts or ends
+ * - Optionally histogram the gap between interrupts per irq and CPU
+ * - Optionally attribute block request completions to the hardirq they
+ *   complete in, per device, with their latency
+ * - Optionally time idle exits to the first handler that follows, per
+ *   cpuidle state and interrupt
  * - Optionally filter by cgroup
+ * - Optionally keep a per-CPU flight recorder of recent interrupts that is
+ *   frozen for dumping when a latency outlier occurs
+ * - Optionally stream latency outliers with their kernel stack to userspace
+ * - Optionally charge handler time to the interrupted task and cgroup
  */
 
 #include <vmlinux.h>
@@ -27,23 +42,48 @@
 #include "hardirqs.h"
 #include "bits.bpf.h"
 #include "maps.bpf.h"
+#include "sampling.bpf.h"
 
 /* Configuration constants */
 #define MAX_ENTRIES 256
-#define IRQ_NAME_LEN 32
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC 1
+#endif
+#ifndef PWR_EVENT_EXIT
+#define PWR_EVENT_EXIT -1
+#endif
+#ifndef EEXIST
+#define EEXIST 17
+#endif
 
-/* Runtime configuration flags */
-const volatile bool filter_cg = false /* Enable cgroup filtering */
-const volatile bool targ_dist = false /* Enable latency distribution */
-const volatile bool targ_ns = false /* use nanoseconds (true) or microseconds (false) */
-
-/**
- * @struct irq_key
- * @brief Key structure for identifying unique interrupts
+/*
+ * Set by the loader through the skeleton's rodata before load. The host
+ * build (host/hardirqs_host.c) defines it first, without const, to set the
+ * knobs itself.
  */
-struct irq_key {
-    char name[IRQ_NAME_LEN]; /* Interrupt handler name */
-}
+#ifndef __rodata
+#define __rodata const volatile
+#endif
+
+/* Runtime configuration flags */
+__rodata bool filter_cg = false; /* Enable cgroup filtering */
+__rodata bool targ_dist = false; /* Enable latency distribution */
+__rodata bool targ_ns = false; /* use nanoseconds (true) or microseconds (false) */
+__rodata bool do_count = false; /* Count interrupts instead of timing them */
+__rodata bool targ_stats = false; /* Combined count, total, min, max and histogram */
+__rodata bool targ_flight = false; /* Enable the flight recorder */
+__rodata __u64 flight_thresh = 0; /* Freeze the flight recorder above this latency, 0 = never */
+__rodata __u32 flight_slots = FLIGHT_SLOTS; /* Entries in flight_buf, power of two */
+__rodata __u64 outlier_thresh = 0; /* Emit an outlier_event at or above this latency, 0 = never */
+__rodata bool targ_tax = false; /* Charge interrupt time to the interrupted task */
+__rodata __u64 window_ns = 0; /* Rolling window length, 0 = disabled */
+__rodata __u64 rollup_ns = 0; /* Fold pcpu_infos into infos this often, 0 = disabled */
+__rodata __u32 nr_cpus = 1; /* Possible CPUs, for the rollup */
+__rodata __u64 storm_gap_ns = 0; /* Storm when the average gap drops to this, 0 = off */
+__rodata __u64 storm_lat = 0; /* Storm when the average latency reaches this, 0 = off */
+__rodata bool targ_gaps = false; /* Histogram inter-arrival times */
+__rodata bool targ_bio = false; /* Correlate block completions with hardirqs */
+__rodata bool targ_idle = false; /* Correlate idle exits with the next hardirq */
 
 /* Maps section */
 
@@ -52,14 +92,784 @@ struct irq_key {
  * Used when filter_cg is enabled to restrict monitoring to specific cgroups
  */
 struct {
-    __uint(type, BFF_MAP_TYPE_HASH);
+    __uint(type, BPF_MAP_TYPE_CGROUP_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, u32);
+} cgroup_map SEC(".maps");
+
+/**
+ * @brief Per-CPU interrupt entry timestamp
+ * Hardirq handlers do not nest, so one slot per CPU is enough
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, u64);
+} start SEC(".maps");
+
+/**
+ * @brief Per-interrupt statistics keyed by handler name
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
     __uint(max_entries, MAX_ENTRIES);
     __type(key, struct irq_key);
     __type(value, struct info);
 } infos SEC(".maps");
 
-/* Initialize zero value for new entries */
-static struct info zero;
+/**
+ * @brief Flight recorder ring, overwritten round-robin on each CPU
+ * Userspace may shrink or grow it together with flight_slots before load
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, FLIGHT_SLOTS);
+    __type(key, u32);
+    __type(value, struct flight_rec);
+} flight_buf SEC(".maps");
+
+/**
+ * @brief Per-CPU write position in flight_buf
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, u64);
+} flight_head SEC(".maps");
+
+/**
+ * @brief Flight recorder freeze state, shared with userspace
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct flight_ctl);
+} flight_ctl SEC(".maps");
+
+/**
+ * @brief Outlier events for userspace, sampled under pressure (see sampling.bpf.h)
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 256 * 1024);
+} outliers SEC(".maps");
+
+/**
+ * @brief Kernel stacks referenced by outlier_event.stack_id
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_STACK_TRACE);
+    __uint(max_entries, MAX_STACKS);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, MAX_STACK_DEPTH * sizeof(u64));
+} stacks SEC(".maps");
+
+/**
+ * @brief Interrupt time stolen from each task ("interrupt tax")
+ * Per-CPU values avoid atomics in the handler path; the LRU evicts exited
+ * tasks instead of failing inserts once the map is full
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(max_entries, MAX_TAX_ENTRIES);
+    __type(key, struct tax_key);
+    __type(value, struct tax_info);
+} irq_tax SEC(".maps");
+
+/**
+ * @brief Rolling latency histograms, never reset by userspace
+ * Any number of readers can sum the windows they need concurrently
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_ENTRIES);
+    __type(key, struct irq_key);
+    __type(value, struct irq_windows);
+} windows SEC(".maps");
+
+/**
+ * @brief Per-CPU statistics written by the handlers in rollup mode
+ * Drained into infos by rollup_cb without losing concurrent updates
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, MAX_ENTRIES);
+    __type(key, struct irq_key);
+    __type(value, struct info);
+} pcpu_infos SEC(".maps");
+
+struct rollup_timer {
+    struct bpf_timer timer;
+};
+
+/**
+ * @brief Moving averages per interrupt number, per CPU so no atomics are needed
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, MAX_STORM_IRQS);
+    __type(key, u32);
+    __type(value, struct storm_state);
+} storm_states SEC(".maps");
+
+/**
+ * @brief Storm start/end notifications for userspace
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 64 * 1024);
+} storms SEC(".maps");
+
+/**
+ * @brief Inter-arrival histograms per interrupt number
+ * Per-CPU since a gap is only meaningful between entries on the same CPU
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, MAX_GAP_IRQS);
+    __type(key, u32);
+    __type(value, struct gap_hist);
+} gaps SEC(".maps");
+
+/**
+ * @brief Hardirq running on this CPU, as seen by block_rq_complete
+ */
+struct irq_cur {
+    u64 nr; /* Requests completed by this invocation so far */
+    u32 active; /* Inside a handler */
+    u32 pad;
+    char name[IRQ_NAME_LEN];
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct irq_cur);
+} irq_cur SEC(".maps");
+
+/**
+ * @brief Issue timestamp of block requests in flight keyed by request address
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_BIO_INFLIGHT);
+    __type(key, u64);
+    __type(value, u64);
+} bio_start SEC(".maps");
+
+/**
+ * @brief Completions per enclosing interrupt and device
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_BIO_KEYS);
+    __type(key, struct bio_key);
+    __type(value, struct bio_info);
+} bio_infos SEC(".maps");
+
+/**
+ * @brief Completions per invocation of each interrupt
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_ENTRIES);
+    __type(key, struct irq_key);
+    __type(value, struct bio_batch);
+} bio_batches SEC(".maps");
+
+/**
+ * @brief Last idle exit of this CPU not yet followed by a handler
+ */
+struct idle_exit {
+    u64 ts; /* cpu_idle exit timestamp, 0 once consumed */
+    u32 state; /* State being left */
+    u32 cur; /* State entered last plus one, 0 while not idle or unknown */
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct idle_exit);
+} idle_exits SEC(".maps");
+
+/**
+ * @brief Idle exits per state, whether or not a handler followed
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, MAX_IDLE_STATES);
+    __type(key, u32);
+    __type(value, u64);
+} idle_counts SEC(".maps");
+
+/**
+ * @brief Exit-to-handler latency per state and interrupt
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_ENTRIES);
+    __type(key, struct idle_key);
+    __type(value, struct idle_info);
+} idle_infos SEC(".maps");
+
+/**
+ * @brief Timer driving the rollup, armed once by start_rollup
+ * Only referenced from start_rollup since tracing program types (raw_tp)
+ * may not use maps holding a bpf_timer
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct rollup_timer);
+} rollup_timer SEC(".maps");
+
+/**
+ * @brief Inserts lost because a map was full, indexed by FAIL_*
+ * Read by the map report to tell a right-sized map from one dropping keys
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, NR_FAIL_MAPS);
+    __type(key, u32);
+    __type(value, u64);
+} init_fails SEC(".maps");
+
+/* Initialize zero value for new entries, min starts high so any sample lowers it */
+static struct info zero = { .min = (u64)-1 };
+static struct irq_windows zero_windows;
+static struct storm_state zero_storm;
+static struct bio_info zero_bio;
+static struct bio_batch zero_batch;
+static struct idle_info zero_idle;
+
+/**
+ * count_fail - Count an insert lost to a full map
+ * @slot: FAIL_* slot of the map in init_fails
+ */
+static __always_inline void count_fail(u32 slot)
+{
+    u64 *fails = bpf_map_lookup_elem(&init_fails, &slot);
+
+    if (fails)
+        (*fails)++;
+}
+
+/**
+ * lookup_or_count - bpf_map_lookup_or_try_init() that counts failed inserts
+ * @map: Map to look up or insert into
+ * @key: Key
+ * @init: Value inserted when @key is missing
+ * @slot: FAIL_* slot of @map in init_fails
+ */
+static __always_inline void *lookup_or_count(void *map, const void *key, const void *init,
+                                             u32 slot)
+{
+    void *val = bpf_map_lookup_or_try_init(map, key, init);
+
+    if (!val)
+        count_fail(slot);
+    return val;
+}
+
+/* request::rq_disk moved to request_queue::disk in 5.17 */
+struct request_queue___x {
+    struct gendisk *disk;
+} __attribute__((preserve_access_index));
+
+struct request___x {
+    struct request_queue___x *q;
+    struct gendisk *rq_disk;
+} __attribute__((preserve_access_index));
+
+static __always_inline struct gendisk *get_disk(void *request)
+{
+    struct request___x *r = request;
+
+    if (bpf_core_field_exists(r->rq_disk))
+        return BPF_CORE_READ(r, rq_disk);
+    return BPF_CORE_READ(r, q, disk);
+}
+
+/**
+ * flight_record - Append an interrupt to this CPU's flight recorder
+ * @irq: Hardware interrupt number
+ * @ikey: Interrupt name
+ * @ts: Exit timestamp in ns
+ * @delta: Handler latency in the configured unit
+ *
+ * Nothing is recorded while the recorder is frozen. A latency at or above
+ * flight_thresh freezes it; two CPUs tripping the threshold at the same time
+ * may both fill in the trigger fields, which is harmless since either is a
+ * valid outlier and no further records are written after the freeze.
+ */
+static void flight_record(int irq, struct irq_key *ikey, u64 ts, u64 delta)
+{
+    struct flight_ctl *ctl;
+    struct flight_rec *rec;
+    u64 *head;
+    u32 key = 0;
+    u32 idx;
+
+    ctl = bpf_map_lookup_elem(&flight_ctl, &key);
+    head = bpf_map_lookup_elem(&flight_head, &key);
+    if (!ctl || !head || ctl->frozen)
+        return;
+
+    idx = *head & (flight_slots - 1);
+    *head += 1;
+    rec = bpf_map_lookup_elem(&flight_buf, &idx);
+    if (!rec)
+        return;
+
+    rec->ts = ts;
+    rec->delta = delta > (u32)-1 ? (u32)-1 : delta;
+    rec->irq = irq;
+    __builtin_memcpy(rec->name, ikey->name, sizeof(rec->name));
+    rec->name[sizeof(rec->name) - 1] = '\0';
+
+    if (flight_thresh && delta >= flight_thresh) {
+        ctl->frozen = FLIGHT_FROZEN_TRIGGER;
+        ctl->trigger_cpu = bpf_get_smp_processor_id();
+        ctl->trigger_ts = ts;
+        ctl->trigger_delta = delta;
+    }
+}
+
+/**
+ * emit_outlier - Report a slow handler together with its kernel stack
+ * @ctx: Program context, needed for the stack walk
+ * @irq: Hardware interrupt number
+ * @ikey: Interrupt name
+ * @ts: Exit timestamp in ns
+ * @delta: Handler latency in the configured unit
+ */
+static void emit_outlier(void *ctx, int irq, struct irq_key *ikey, u64 ts, u64 delta)
+{
+    struct outlier_event *e;
+    __u32 weight;
+
+    if (!sampler_sample(&weight))
+        return;
+
+    e = sampler_reserve(&outliers, sizeof(*e), weight);
+    if (!e)
+        return;
+
+    e->ts = ts;
+    e->delta = delta;
+    e->stack_id = bpf_get_stackid(ctx, &stacks, 0);
+    e->cpu = bpf_get_smp_processor_id();
+    e->irq = irq;
+    e->weight = weight;
+    __builtin_memcpy(e->name, ikey->name, sizeof(e->name));
+    bpf_ringbuf_submit(e, 0);
+}
+
+/**
+ * window_record - Add a latency to the current rolling window of an interrupt
+ * @ikey: Interrupt name
+ * @ts: Exit timestamp in ns
+ * @delta: Handler latency in the configured unit
+ *
+ * The window slot is recycled lazily: the first update in a new window
+ * clears what was left from NR_WINDOWS windows ago. Two CPUs rolling the
+ * same slot at once can lose a few counts, which is the same precision
+ * the shared infos map already has.
+ */
+static void window_record(struct irq_key *ikey, u64 ts, u64 delta)
+{
+    struct irq_windows *iw;
+    struct hist_window *w;
+    u64 epoch = ts / window_ns;
+    u64 slot;
+
+    iw = lookup_or_count(&windows, ikey, &zero_windows, FAIL_WINDOWS);
+    if (!iw)
+        return;
+
+    w = &iw->w[epoch % NR_WINDOWS];
+    if (w->epoch != epoch) {
+        __builtin_memset(w->slots, 0, sizeof(w->slots));
+        w->epoch = epoch;
+    }
+
+    slot = log2(delta);
+    if (slot >= MAX_SLOTS)
+        slot = MAX_SLOTS - 1;
+    w->slots[slot]++;
+}
+
+/**
+ * lookup_info - Statistics slot of an interrupt for the configured mode
+ * @ikey: Interrupt name
+ *
+ * In rollup mode this CPU's slot in pcpu_infos, otherwise the shared infos.
+ */
+static __always_inline struct info *lookup_info(struct irq_key *ikey)
+{
+    if (rollup_ns)
+        return lookup_or_count(&pcpu_infos, ikey, &zero, FAIL_PCPU_INFOS);
+    return lookup_or_count(&infos, ikey, &zero, FAIL_INFOS);
+}
+
+struct fold_ctx {
+    struct irq_key *key;
+    struct info *sum;
+};
+
+/**
+ * fold_cpu - Move one CPU's pcpu_infos slot into the rolled-up sum
+ * @cpu: CPU to drain
+ * @fctx: Key being folded and its infos entry
+ *
+ * Counters are drained by atomically subtracting what was read; together
+ * with the atomic increments in the handlers this keeps updates racing
+ * with the fold for the next round. min/max are reset non-atomically, a
+ * racing update may be lost from them only.
+ *
+ * @return 0 to continue with the next CPU
+ */
+static long fold_cpu(u32 cpu, struct fold_ctx *fctx)
+{
+    struct info *sum = fctx->sum;
+    struct info *pc;
+    u64 v;
+
+    pc = bpf_map_lookup_percpu_elem(&pcpu_infos, fctx->key, cpu);
+    if (!pc)
+        return 0;
+
+    if (targ_stats && pc->count) {
+        if (pc->min < sum->min)
+            sum->min = pc->min;
+        if (pc->max > sum->max)
+            sum->max = pc->max;
+        pc->min = (u64)-1;
+        pc->max = 0;
+    }
+
+    v = pc->count;
+    if (v) {
+        sum->count += v;
+        __sync_fetch_and_add(&pc->count, -v);
+    }
+    v = pc->total;
+    if (v) {
+        sum->total += v;
+        __sync_fetch_and_add(&pc->total, -v);
+    }
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        u32 s = pc->slots[i];
+
+        if (s) {
+            sum->slots[i] += s;
+            __sync_fetch_and_add(&pc->slots[i], -s);
+        }
+    }
+    return 0;
+}
+
+static long fold_key(struct bpf_map *map, struct irq_key *key, struct info *val, void *ctx)
+{
+    struct fold_ctx fctx = { .key = key };
+
+    fctx.sum = lookup_or_count(&infos, key, &zero, FAIL_INFOS);
+    if (!fctx.sum)
+        return 0;
+    bpf_loop(nr_cpus < ROLLUP_MAX_CPUS ? nr_cpus : ROLLUP_MAX_CPUS, fold_cpu, &fctx, 0);
+    return 0;
+}
+
+/**
+ * rollup_cb - Periodic fold of pcpu_infos into infos, re-arms itself
+ */
+static int rollup_cb(void *map, int *key, struct rollup_timer *rt)
+{
+    bpf_for_each_map_elem(&pcpu_infos, fold_key, NULL, 0);
+    bpf_timer_start(&rt->timer, rollup_ns, 0);
+    return 0;
+}
+
+/**
+ * ewma - Fixed-point exponential moving average step
+ * @avg: Current average, scaled by 2^EWMA_FP
+ * @sample: New sample, unscaled
+ * @seeded: Whether @avg holds a sample yet; a 0 average is a valid one
+ *          (sub-microsecond handlers), so it cannot mean "none"
+ *
+ * @return avg + (sample - avg) / 2^EWMA_SHIFT, scaled by 2^EWMA_FP, or the
+ * sample itself for the first one
+ */
+static __always_inline u64 ewma(u64 avg, u64 sample, bool seeded)
+{
+    s64 scaled = sample << EWMA_FP;
+
+    if (!seeded)
+        return scaled;
+    return avg + ((scaled - (s64)avg) >> EWMA_SHIFT);
+}
+
+/**
+ * storm_check - Re-evaluate storm flags and notify userspace on change
+ * @st: This CPU's state of the interrupt
+ * @irq: Hardware interrupt number
+ * @action: Interrupt action, the name is only read when notifying
+ * @ts: Current timestamp in ns
+ *
+ * A flag is raised when its average crosses the threshold and cleared only
+ * once the average is back past twice (rate) or half (latency) of it, so a
+ * line hovering at the threshold does not flood the ring buffer.
+ */
+static void storm_check(struct storm_state *st, int irq, struct irqaction *action, u64 ts)
+{
+    struct storm_event *e;
+    u64 gap = st->gap_fp >> EWMA_FP;
+    u64 lat = st->lat_fp >> EWMA_FP;
+    u32 flags = st->flags;
+
+    if (storm_gap_ns && (st->seeded & STORM_SEEDED_GAP) && gap) {
+        if (gap <= storm_gap_ns)
+            flags |= STORM_F_RATE;
+        else if (gap > 2 * storm_gap_ns)
+            flags &= ~STORM_F_RATE;
+    }
+    if (storm_lat && (st->seeded & STORM_SEEDED_LAT)) {
+        if (lat >= storm_lat)
+            flags |= STORM_F_LATENCY;
+        else if (lat < storm_lat / 2)
+            flags &= ~STORM_F_LATENCY;
+    }
+    if (flags == st->flags)
+        return;
+
+    e = bpf_ringbuf_reserve(&storms, sizeof(*e), 0);
+    if (e) {
+        e->ts = ts;
+        e->rate = gap ? 1000000000ULL / gap : 0;
+        e->latency = lat;
+        e->irq = irq;
+        e->cpu = bpf_get_smp_processor_id();
+        e->flags = flags;
+        e->prev_flags = st->flags;
+        bpf_probe_read_kernel_str(&e->name, sizeof(e->name), BPF_CORE_READ(action, name));
+        bpf_ringbuf_submit(e, 0);
+    }
+    st->flags = flags;
+}
+
+/**
+ * storm_entry - Update the inter-arrival average of an interrupt
+ * @irq: Hardware interrupt number
+ * @action: Interrupt action structure containing handler info
+ */
+static void storm_entry(int irq, struct irqaction *action)
+{
+    struct storm_state *st;
+    u32 key = irq;
+    u64 ts;
+
+    st = lookup_or_count(&storm_states, &key, &zero_storm, FAIL_STORM_STATES);
+    if (!st)
+        return;
+
+    ts = bpf_ktime_get_ns();
+    if (st->last_ts) {
+        st->gap_fp = ewma(st->gap_fp, ts - st->last_ts, st->seeded & STORM_SEEDED_GAP);
+        st->seeded |= STORM_SEEDED_GAP;
+    }
+    st->last_ts = ts;
+    storm_check(st, irq, action, ts);
+}
+
+/**
+ * storm_exit - Update the latency average of an interrupt
+ * @irq: Hardware interrupt number
+ * @action: Interrupt action structure containing handler info
+ * @ts: Exit timestamp in ns
+ * @delta: Handler latency in the configured unit
+ */
+static void storm_exit(int irq, struct irqaction *action, u64 ts, u64 delta)
+{
+    struct storm_state *st;
+    u32 key = irq;
+
+    st = bpf_map_lookup_elem(&storm_states, &key);
+    if (!st)
+        return;
+
+    st->lat_fp = ewma(st->lat_fp, delta, st->seeded & STORM_SEEDED_LAT);
+    st->seeded |= STORM_SEEDED_LAT;
+    storm_check(st, irq, action, ts);
+}
+
+/**
+ * gap_record - Histogram the time since the previous entry of an interrupt
+ * @irq: Hardware interrupt number
+ * @action: Interrupt action, the name is only read for a new entry
+ *
+ * The histogram is this CPU's, so plain increments are enough. The first
+ * entry after userspace deleted the element only restarts the clock, and
+ * so does the first one on a CPU whose copy another CPU's insert zeroed.
+ */
+static void gap_record(int irq, struct irqaction *action)
+{
+    struct gap_hist *gh;
+    u32 key = irq;
+    u64 ts = bpf_ktime_get_ns();
+    u64 gap, slot;
+    long err;
+
+    gh = bpf_map_lookup_elem(&gaps, &key);
+    if (!gh) {
+        struct gap_hist init = {};
+
+        init.last_ts = ts;
+        bpf_probe_read_kernel_str(&init.name, sizeof(init.name), BPF_CORE_READ(action, name));
+        err = bpf_map_update_elem(&gaps, &key, &init, BPF_NOEXIST);
+        /* -EEXIST is another CPU creating the same entry, not a loss */
+        if (err && err != -EEXIST)
+            count_fail(FAIL_GAPS);
+        return;
+    }
+    if (!gh->last_ts) {
+        gh->last_ts = ts;
+        bpf_probe_read_kernel_str(&gh->name, sizeof(gh->name), BPF_CORE_READ(action, name));
+        return;
+    }
+
+    gap = ts - gh->last_ts;
+    gh->last_ts = ts;
+    if (!targ_ns)
+        gap /= 1000U;
+
+    slot = log2l(gap);
+    if (slot >= MAX_SLOTS)
+        slot = MAX_SLOTS - 1;
+    gh->slots[slot]++;
+}
+
+/**
+ * bio_entry - Mark this CPU as running a handler for block_rq_complete
+ * @action: Interrupt action structure containing handler info
+ */
+static void bio_entry(struct irqaction *action)
+{
+    struct irq_cur *cur;
+    u32 key = 0;
+
+    cur = bpf_map_lookup_elem(&irq_cur, &key);
+    if (!cur)
+        return;
+    bpf_probe_read_kernel_str(&cur->name, sizeof(cur->name), BPF_CORE_READ(action, name));
+    cur->nr = 0;
+    cur->active = 1;
+}
+
+/**
+ * bio_exit - Account how many requests the finished handler completed
+ */
+static void bio_exit(void)
+{
+    struct bio_batch *batch;
+    struct irq_cur *cur;
+    struct irq_key ikey;
+    u32 key = 0;
+    u64 slot;
+
+    cur = bpf_map_lookup_elem(&irq_cur, &key);
+    if (!cur || !cur->active)
+        return;
+    cur->active = 0;
+    if (!cur->nr)
+        return;
+
+    __builtin_memcpy(ikey.name, cur->name, sizeof(ikey.name));
+    batch = lookup_or_count(&bio_batches, &ikey, &zero_batch, FAIL_BIO_BATCHES);
+    if (!batch)
+        return;
+    __sync_fetch_and_add(&batch->irqs, 1);
+    __sync_fetch_and_add(&batch->completions, cur->nr);
+    slot = log2l(cur->nr);
+    if (slot >= MAX_SLOTS)
+        slot = MAX_SLOTS - 1;
+    __sync_fetch_and_add(&batch->slots[slot], 1);
+}
+
+/**
+ * idle_entry - Charge the pending idle exit of this CPU to an interrupt
+ * @action: Interrupt action structure containing handler info
+ *
+ * Only the first handler after an exit is charged. Wakeups by vectors
+ * that bypass irq_handler_entry (local timer, IPIs) leave the exit
+ * pending until the CPU goes idle again, which discards it.
+ */
+static void idle_entry(struct irqaction *action)
+{
+    struct idle_key ikey = {};
+    struct idle_info *info;
+    struct idle_exit *ie;
+    u32 key = 0;
+    u64 delta, slot;
+
+    ie = bpf_map_lookup_elem(&idle_exits, &key);
+    if (!ie || !ie->ts)
+        return;
+
+    delta = bpf_ktime_get_ns() - ie->ts;
+    ie->ts = 0;
+    if (!targ_ns)
+        delta /= 1000U;
+
+    ikey.state = ie->state;
+    bpf_probe_read_kernel_str(&ikey.name, sizeof(ikey.name), BPF_CORE_READ(action, name));
+    info = lookup_or_count(&idle_infos, &ikey, &zero_idle, FAIL_IDLE_INFOS);
+    if (!info)
+        return;
+    __sync_fetch_and_add(&info->count, 1);
+    __sync_fetch_and_add(&info->lat_total, delta);
+    slot = log2l(delta);
+    if (slot >= MAX_SLOTS)
+        slot = MAX_SLOTS - 1;
+    __sync_fetch_and_add(&info->slots[slot], 1);
+}
+
+/**
+ * charge_task - Attribute handler time to the task it interrupted
+ * @delta_ns: Handler latency in ns
+ *
+ * In hardirq context the current task is the one that was interrupted,
+ * so the handler time is charged to it and to its cgroup.
+ */
+static void charge_task(u64 delta_ns)
+{
+    u64 pid_tgid = bpf_get_current_pid_tgid();
+    struct tax_key tkey = {};
+    struct tax_info *tax;
+
+    tkey.tgid = pid_tgid >> 32;
+    tkey.pid = (u32)pid_tgid;
+    tkey.cgroup_id = bpf_get_current_cgroup_id();
+
+    tax = bpf_map_lookup_elem(&irq_tax, &tkey);
+    if (!tax) {
+        struct tax_info init = {};
+
+        bpf_get_current_comm(&init.comm, sizeof(init.comm));
+        bpf_map_update_elem(&irq_tax, &tkey, &init, BPF_NOEXIST);
+        tax = bpf_map_lookup_elem(&irq_tax, &tkey);
+        if (!tax)
+            return;
+    }
+    tax->count += 1;
+    tax->total_ns += delta_ns;
+}
 
 /**
  * handle_entry - Common handler for interrupt entry points
@@ -69,39 +879,54 @@ static struct info zero;
  * Records timestamp on interrupt entry if timing is enabled
  * or increments counter if in counting mode
  * 
- * @return 0 on sucess, error code otherwise
+ * @return 0 on success, error code otherwise
  */
 static int handle_entry(int irq, struct irqaction *action)
 {
-    /* Check cgroup filter if enabled */
-    if (filter_cg && !bpf_current_task_under_cgroup(&cgroup_map, 0))
-        return 0;
-
-    if (do_count) {
-        /* Counting mode - increment interrupt counter */
-        struct irq_key key = {};
-        struct info *info;
-
-        bpf_probe_read_kernel_str(&key, name, sizeof(key, name),
-        BPF_CORE_READ(action, name));
+    struct irq_key ikey = {};
+    struct info *info;
 
-        info = bpf_map_lookup_or_try_init(&infos, &zero);
-        if (!info)
-            return 0;
+    /* Storms and gaps are properties of the line, not of the interrupted task */
+    if (storm_gap_ns || storm_lat)
+        storm_entry(irq, action);
+    if (targ_gaps)
+        gap_record(irq, action);
+    if (targ_bio)
+        bio_entry(action);
+    if (targ_idle)
+        idle_entry(action);
 
-        info->count += 1;
-    } else {
-        /* Timing mode - record entry timestamp */
+    /*
+     * Timing mode - record entry timestamp ahead of the cgroup filter, so
+     * storm_exit sees every handler of the line
+     */
+    if (!do_count) {
         u64 ts = bpf_ktime_get_ns();
         u32 key = 0;
 
         bpf_map_update_elem(&start, &key, &ts, BPF_ANY);
+        return 0;
     }
+
+    /* Check cgroup filter if enabled */
+    if (filter_cg && !bpf_current_task_under_cgroup(&cgroup_map, 0))
+        return 0;
+
+    /* Counting mode - increment interrupt counter */
+    bpf_probe_read_kernel_str(&ikey.name, sizeof(ikey.name),
+    BPF_CORE_READ(action, name));
+
+    info = lookup_info(&ikey);
+    if (!info)
+        return 0;
+
+    __sync_fetch_and_add(&info->count, 1);
     return 0;
 }
 
 /**
  * handle_exit - Common handler for interrupt exit points
+ * @ctx: Program context
  * @irq: Hardware interrupt number
  * @action: Interrupt action structure containing handler info
  * 
@@ -110,60 +935,100 @@ static int handle_entry(int irq, struct irqaction *action)
  * 
  * @return 0 on success, error code otherwise
  */
-static int handle_exit(int irq, struct irqaction *action )
+static int handle_exit(void *ctx, int irq, struct irqaction *action)
 {
     struct irq_key ikey = {};
     struct info *info;
     u32 key = 0;
+    u64 delta_ns;
     u64 delta;
     u64 *tsp;
+    u64 ts;
 
-    /* Check cgroup filter if enabled */
-    if (filter_cg && !bpf_current_task_under_cgroup(&cgroup_map, 0))
+    if (targ_bio)
+        bio_exit();
+
+    /* Only loaded in counting mode for bio_exit; keeps start dead so it is not created */
+    if (do_count)
         return 0;
 
     /* Get entry timestamp */
     tsp = bpf_map_lookup_elem(&start, &key);
-    if (!tsp)
+    if (!tsp || !*tsp)
         return 0;
 
     /* Calculate latency */
-    delta = bpf_ktime_get_ns() - *tsp;
-    if (!targ_ns)
-        delta /= 1000U; /* Convert to microseconds if required */
+    ts = bpf_ktime_get_ns();
+    delta_ns = ts - *tsp;
+    delta = targ_ns ? delta_ns : delta_ns / 1000U; /* Convert to microseconds if required */
+
+    /* Like storm_entry, ahead of the cgroup filter: a storm is a property of the line */
+    if (storm_lat)
+        storm_exit(irq, action, ts, delta);
+
+    /* Check cgroup filter if enabled */
+    if (filter_cg && !bpf_current_task_under_cgroup(&cgroup_map, 0))
+        return 0;
+
+    if (targ_tax)
+        charge_task(delta_ns);
 
     /* Prepare key and get/initialize info struct */
     bpf_probe_read_kernel_str(&ikey.name, sizeof(ikey.name),
     BPF_CORE_READ(action, name));
-    info = bpf_map_lookup_or_try_init(&infos, &key, &zero);
+
+    if (targ_flight)
+        flight_record(irq, &ikey, ts, delta);
+
+    if (outlier_thresh && delta >= outlier_thresh)
+        emit_outlier(ctx, irq, &ikey, ts, delta);
+
+    if (window_ns)
+        window_record(&ikey, ts, delta);
+
+    info = lookup_info(&ikey);
     if (!info)
         return 0;
-    
+
     /* Update statistics */
-    if (!targ_dist) {
-        /* store raw latecy */
-        info ->count += delta;
-    } else {
-        /* Update latency histogram */
-        u64 slot = log2(delta);
-        if (slot >= MAX_SLOTS)
-            slots = MAX_SLOTS - 1;
-        info->slots[slot]++;
+    if (targ_stats) {
+        /*
+         * Combined mode - rate and latency summary next to the histogram.
+         * A pcpu_infos element created from another CPU is zeroed on this
+         * one instead of starting from zero.min, so min is only trusted
+         * once this copy has a sample.
+         */
+        if (!info->count || delta < info->min)
+            info->min = delta;
+        if (delta > info->max)
+            info->max = delta;
+        __sync_fetch_and_add(&info->count, 1);
+        __sync_fetch_and_add(&info->total, delta);
+    } else if (!targ_dist) {
+        /* store raw latency */
+        __sync_fetch_and_add(&info->count, delta);
+        return 0;
     }
+
+    /* Update latency histogram */
+    u64 slot = log2(delta);
+    if (slot >= MAX_SLOTS)
+        slot = MAX_SLOTS - 1;
+    __sync_fetch_and_add(&info->slots[slot], 1);
     return 0;
 }
 
-/* Tracepoint attacchments */
+/* Tracepoint attachments */
 SEC("tp_btf/irq_handler_entry")
 int BPF_PROG(irq_handler_entry_btf, int irq, struct irqaction *action)
 {
     return handle_entry(irq, action);
 }
 
-SEC("tp_bpf/irq_handler_exit")
+SEC("tp_btf/irq_handler_exit")
 int BPF_PROG(irq_handler_exit_btf, int irq, struct irqaction *action)
 {
-    return handle_exit(irq, action);
+    return handle_exit(ctx, irq, action);
 }
 
 SEC("raw_tp/irq_handler_entry")
@@ -175,7 +1040,129 @@ int BPF_PROG(irq_handler_entry, int irq, struct irqaction *action)
 SEC("raw_tp/irq_handler_exit")
 int BPF_PROG(irq_handler_exit, int irq, struct irqaction *action)
 {
-    return handle_exit(irq, action);
+    return handle_exit(ctx, irq, action);
+}
+
+SEC("tp_btf/block_rq_issue")
+int BPF_PROG(block_rq_issue, struct request *rq)
+{
+    u64 key = (u64)rq;
+    u64 ts = bpf_ktime_get_ns();
+
+    bpf_map_update_elem(&bio_start, &key, &ts, BPF_ANY);
+    return 0;
+}
+
+/**
+ * block_rq_complete - Attribute a completed request to the running hardirq
+ * @rq: Completed request
+ * @error: Completion status
+ * @nr_bytes: Bytes completed
+ *
+ * Completions in softirq or task context (remote completion, polling,
+ * threaded handlers) are accounted under BIO_NO_IRQ.
+ */
+SEC("tp_btf/block_rq_complete")
+int BPF_PROG(block_rq_complete, struct request *rq, blk_status_t error, unsigned int nr_bytes)
+{
+    struct bio_key bkey = {};
+    struct gendisk *disk;
+    struct irq_cur *cur;
+    struct bio_info *info;
+    u64 key = (u64)rq;
+    u64 *tsp, delta, slot;
+    u32 zero_key = 0;
+
+    tsp = bpf_map_lookup_elem(&bio_start, &key);
+    if (!tsp)
+        return 0;
+    delta = bpf_ktime_get_ns() - *tsp;
+    bpf_map_delete_elem(&bio_start, &key);
+    if (!targ_ns)
+        delta /= 1000U;
+
+    disk = get_disk(rq);
+    if (disk)
+        bkey.dev = BPF_CORE_READ(disk, major) << MINORBITS | BPF_CORE_READ(disk, first_minor);
+    cur = bpf_map_lookup_elem(&irq_cur, &zero_key);
+    if (cur && cur->active) {
+        cur->nr++;
+        __builtin_memcpy(bkey.name, cur->name, sizeof(bkey.name));
+    } else {
+        __builtin_memcpy(bkey.name, BIO_NO_IRQ, sizeof(BIO_NO_IRQ));
+    }
+
+    info = lookup_or_count(&bio_infos, &bkey, &zero_bio, FAIL_BIO_INFOS);
+    if (!info)
+        return 0;
+    __sync_fetch_and_add(&info->count, 1);
+    __sync_fetch_and_add(&info->bytes, nr_bytes);
+    __sync_fetch_and_add(&info->lat_total, delta);
+    slot = log2l(delta);
+    if (slot >= MAX_SLOTS)
+        slot = MAX_SLOTS - 1;
+    __sync_fetch_and_add(&info->slots[slot], 1);
+    return 0;
+}
+
+/**
+ * cpu_idle - Track idle state transitions of this CPU
+ * @state: State index entered, or PWR_EVENT_EXIT when leaving idle
+ * @cpu_id: CPU, always the current one
+ */
+SEC("tp_btf/cpu_idle")
+int BPF_PROG(cpu_idle, unsigned int state, unsigned int cpu_id)
+{
+    struct idle_exit *ie;
+    u32 key = 0;
+    u64 *cnt;
+
+    ie = bpf_map_lookup_elem(&idle_exits, &key);
+    if (!ie)
+        return 0;
+
+    if (state != (u32)PWR_EVENT_EXIT) {
+        /* Going idle again: an exit no handler followed is dropped */
+        ie->ts = 0;
+        ie->cur = state + 1;
+        return 0;
+    }
+    /* Idle since before attach, the state is unknown */
+    if (!ie->cur || ie->cur > MAX_IDLE_STATES)
+        return 0;
+
+    ie->state = ie->cur - 1;
+    ie->cur = 0;
+    ie->ts = bpf_ktime_get_ns();
+    cnt = bpf_map_lookup_elem(&idle_counts, &ie->state);
+    if (cnt)
+        *cnt += 1;
+    return 0;
+}
+
+/**
+ * start_rollup - Arm the rollup timer, run once by userspace after load
+ *
+ * @return 0 on success, error code otherwise
+ */
+SEC("syscall")
+int start_rollup(void *ctx)
+{
+    struct rollup_timer *rt;
+    u32 key = 0;
+    long err;
+
+    rt = bpf_map_lookup_elem(&rollup_timer, &key);
+    if (!rt || !rollup_ns)
+        return -1;
+
+    err = bpf_timer_init(&rt->timer, &rollup_timer, CLOCK_MONOTONIC);
+    if (err)
+        return err;
+    err = bpf_timer_set_callback(&rt->timer, rollup_cb);
+    if (err)
+        return err;
+    return bpf_timer_start(&rt->timer, rollup_ns, 0);
 }
 
-char LICENSE[] SEC("license") = "GPL"
+char LICENSE[] SEC("license") = "GPL";
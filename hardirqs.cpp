@@ -0,0 +1,1373 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * @file hardirqs.cpp
+ * @brief Userspace front-end for hardirqs.bpf.c
+ *
+ * Loads the hardirqs program, prints the per-interrupt counts, summed
+ * latencies, log2 histograms or all of them together (combined mode) every
+ * interval and, in flight-recorder mode,
+ * dumps the per-CPU ring whenever it is frozen by a latency outlier or by
+ * SIGUSR1. Outlier events are printed as they arrive with their kernel
+ * stack symbolized through /proc/kallsyms. In interrupt-tax mode the
+ * handler time charged to each interrupted task and cgroup is printed too.
+ * Rolling-window histograms are read without resetting anything, so other
+ * readers of the same map are not disturbed. In rollup mode the handlers
+ * only touch per-CPU slots and a bpf_timer folds them into infos, which
+ * stays the only map read here. Interrupt storm transitions detected
+ * in-kernel are printed as soon as they are signalled. Inter-arrival
+ * histograms are printed per interrupt number and CPU. Block request
+ * completions are attributed to the interrupt they completed in. Idle
+ * exits are timed to the first handler that follows them. Maps only
+ * used by modes that are off are not created, and the memory of those
+ * that are is reported at startup; with --map-report their peak occupancy,
+ * lost inserts and recommended sizes are printed at exit.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <climits>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "hardirqs.h"
+#include "hardirqs.skel.h"
+#include "ksyms.hpp"
+#include "map_report.hpp"
+#include "sampling.h"
+#include "trace_helpers.hpp"
+
+#define POLL_MS 100
+
+static struct env {
+    bool count;
+    bool stats;
+    bool distributed;
+    bool nanoseconds;
+    bool timestamp;
+    bool verbose;
+    const char *cgroupspath;
+    bool cg;
+    bool flight;
+    unsigned long long flight_thresh;
+    unsigned int flight_slots = FLIGHT_SLOTS;
+    unsigned long long flight_window_ms = 5000;
+    bool outlier;
+    unsigned long long outlier_thresh;
+    bool tax;
+    int tax_top = 20;
+    std::vector<unsigned int> horizons; /* Rolling histogram spans, in windows */
+    unsigned long long window_ms = 1000;
+    unsigned long long rollup_ms;
+    unsigned long long storm_rate;
+    unsigned long long storm_lat;
+    bool gaps;
+    bool bio;
+    bool idle;
+    bool map_report;
+    int interval = 99999999;
+    int times = 99999999;
+} env;
+
+static volatile sig_atomic_t dump_requested;
+static Ksyms ksyms;
+static StackSymbolizer *stack_syms;
+static MapReport *map_report;
+
+static const char usage[] =
+    "Usage: hardirqs [OPTION...] [interval] [count]\n"
+    "Summarize hard irq event time as histograms.\n"
+    "\n"
+    "  -C, --count               Show event counts instead of timing\n"
+    "  -d, --distributed         Show distributions as histograms\n"
+    "  -S, --stats               Show count, rate, total, avg, min and max\n"
+    "                            latency in one pass (add -d for histograms)\n"
+    "  -c, --cgroup=PATH         Trace process in cgroup path\n"
+    "  -N, --nanoseconds         Output in nanoseconds\n"
+    "  -T, --timestamp           Include timestamp on output\n"
+    "  -F, --flight=THRESH       Keep a flight recorder, dump it when a handler\n"
+    "                            takes THRESH or longer (0: only on SIGUSR1)\n"
+    "      --flight-slots=N      Records kept per CPU (power of two)\n"
+    "      --flight-window=MS    Dump records from the last MS before the trigger\n"
+    "  -L, --outlier=THRESH      Print each handler taking THRESH or longer\n"
+    "                            with its kernel stack\n"
+    "  -t, --tax                 Show interrupt time stolen per task and cgroup\n"
+    "      --tax-top=N           Tasks shown in the interrupt tax table\n"
+    "  -W, --windows=S[,S...]    Show rolling histograms of the last S seconds,\n"
+    "                            kept in-kernel and never reset (e.g. 1,10,60)\n"
+    "      --window-ms=MS        Rolling window granularity (default 1000)\n"
+    "  -R, --rollup=MS           Update per-CPU statistics and fold them into\n"
+    "                            the summary in-kernel every MS\n"
+    "  -s, --storm-rate=N        Report interrupt storms above N irqs/s per CPU\n"
+    "      --storm-latency=T     Report handlers averaging T or longer as storms\n"
+    "  -g, --gaps                Show time between interrupts per irq and CPU\n"
+    "  -b, --bio                 Show block I/O completions per interrupt and\n"
+    "                            device, with their latency\n"
+    "  -I, --idle                Show latency from idle exit to the first\n"
+    "                            handler, per idle state and interrupt\n"
+    "  -M, --map-report          Print map memory, peak occupancy, lost inserts\n"
+    "                            and recommended sizes at exit\n"
+    "  -v, --verbose             Verbose debug output\n"
+    "  -h, --help                Show this help\n"
+    "\n"
+    "Examples:\n"
+    "    hardirqs            # sum hard irq event time\n"
+    "    hardirqs -d         # show hard irq event time as histograms\n"
+    "    hardirqs -Sd 1      # rate, latency summary and histograms each second\n"
+    "    hardirqs 1 10       # print 1 second summaries, 10 times\n"
+    "    hardirqs -c CG      # Trace process under cgroupsPath CG\n"
+    "    hardirqs -NT 1      # 1s summaries, nanoseconds, and timestamps\n"
+    "    hardirqs -F 500     # dump the preceding 5s when a handler takes 500us\n"
+    "    hardirqs -L 100     # print handlers taking 100us or longer\n"
+    "    hardirqs -t 10      # interrupt time per task and cgroup every 10s\n"
+    "    hardirqs -W 1,10,60 # last 1s, 10s and 60s histograms\n"
+    "    hardirqs -R 1000 60 # per-CPU updates folded each second, read each minute\n"
+    "    hardirqs -s 50000   # report lines above 50k irqs/s on a CPU\n"
+    "    hardirqs -Cg 10     # counts and inter-arrival histograms every 10s\n"
+    "    hardirqs -Cb 5      # which interrupts complete which disks' I/O\n"
+    "    hardirqs -CId 10    # idle exit to handler histograms every 10s\n"
+    "    hardirqs -SM 1 60   # size the maps for a minute of stats\n";
+
+enum {
+    OPT_FLIGHT_SLOTS = 256,
+    OPT_FLIGHT_WINDOW,
+    OPT_TAX_TOP,
+    OPT_WINDOW_MS,
+    OPT_STORM_LATENCY,
+};
+
+static const struct option long_opts[] = {
+    { "count", no_argument, nullptr, 'C' },
+    { "distributed", no_argument, nullptr, 'd' },
+    { "stats", no_argument, nullptr, 'S' },
+    { "cgroup", required_argument, nullptr, 'c' },
+    { "nanoseconds", no_argument, nullptr, 'N' },
+    { "timestamp", no_argument, nullptr, 'T' },
+    { "flight", required_argument, nullptr, 'F' },
+    { "flight-slots", required_argument, nullptr, OPT_FLIGHT_SLOTS },
+    { "flight-window", required_argument, nullptr, OPT_FLIGHT_WINDOW },
+    { "outlier", required_argument, nullptr, 'L' },
+    { "tax", no_argument, nullptr, 't' },
+    { "tax-top", required_argument, nullptr, OPT_TAX_TOP },
+    { "windows", required_argument, nullptr, 'W' },
+    { "window-ms", required_argument, nullptr, OPT_WINDOW_MS },
+    { "rollup", required_argument, nullptr, 'R' },
+    { "storm-rate", required_argument, nullptr, 's' },
+    { "storm-latency", required_argument, nullptr, OPT_STORM_LATENCY },
+    { "gaps", no_argument, nullptr, 'g' },
+    { "bio", no_argument, nullptr, 'b' },
+    { "idle", no_argument, nullptr, 'I' },
+    { "map-report", no_argument, nullptr, 'M' },
+    { "verbose", no_argument, nullptr, 'v' },
+    { "help", no_argument, nullptr, 'h' },
+    {},
+};
+
+static int parse_args(int argc, char **argv)
+{
+    std::vector<unsigned long long> spans;
+    unsigned long long val;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "CdSc:NTF:L:tW:R:s:gbIMvh", long_opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'C':
+            env.count = true;
+            break;
+        case 'd':
+            env.distributed = true;
+            break;
+        case 'S':
+            env.stats = true;
+            break;
+        case 'c':
+            env.cgroupspath = optarg;
+            env.cg = true;
+            break;
+        case 'N':
+            env.nanoseconds = true;
+            break;
+        case 'T':
+            env.timestamp = true;
+            break;
+        case 'F':
+            if (!parse_ull(optarg, &env.flight_thresh)) {
+                fprintf(stderr, "invalid flight threshold: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.flight = true;
+            break;
+        case OPT_FLIGHT_SLOTS:
+            if (!parse_ull(optarg, &val) || !val || (val & (val - 1)) || val > (1U << 24)) {
+                fprintf(stderr, "flight slots must be a power of two: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.flight_slots = val;
+            break;
+        case OPT_FLIGHT_WINDOW:
+            if (!parse_ull(optarg, &env.flight_window_ms)) {
+                fprintf(stderr, "invalid flight window: %s\n", optarg);
+                return -EINVAL;
+            }
+            break;
+        case 'L':
+            if (!parse_ull(optarg, &env.outlier_thresh) || !env.outlier_thresh) {
+                fprintf(stderr, "invalid outlier threshold: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.outlier = true;
+            break;
+        case 't':
+            env.tax = true;
+            break;
+        case OPT_TAX_TOP:
+            if (!parse_ull(optarg, &val) || !val || val > MAX_TAX_ENTRIES) {
+                fprintf(stderr, "invalid tax table size: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.tax_top = val;
+            break;
+        case 'W':
+            for (char *tok = strtok(optarg, ","); tok; tok = strtok(nullptr, ",")) {
+                if (!parse_ull(tok, &val) || !val) {
+                    fprintf(stderr, "invalid window span: %s\n", tok);
+                    return -EINVAL;
+                }
+                spans.push_back(val);
+            }
+            break;
+        case OPT_WINDOW_MS:
+            if (!parse_ull(optarg, &env.window_ms) || !env.window_ms) {
+                fprintf(stderr, "invalid window length: %s\n", optarg);
+                return -EINVAL;
+            }
+            break;
+        case 'R':
+            if (!parse_ull(optarg, &env.rollup_ms) || !env.rollup_ms) {
+                fprintf(stderr, "invalid rollup period: %s\n", optarg);
+                return -EINVAL;
+            }
+            break;
+        case 's':
+            if (!parse_ull(optarg, &env.storm_rate) || !env.storm_rate ||
+                env.storm_rate > 1000000000ULL) {
+                fprintf(stderr, "invalid storm rate: %s\n", optarg);
+                return -EINVAL;
+            }
+            break;
+        case OPT_STORM_LATENCY:
+            if (!parse_ull(optarg, &env.storm_lat) || !env.storm_lat) {
+                fprintf(stderr, "invalid storm latency: %s\n", optarg);
+                return -EINVAL;
+            }
+            break;
+        case 'g':
+            env.gaps = true;
+            break;
+        case 'b':
+            env.bio = true;
+            break;
+        case 'I':
+            env.idle = true;
+            break;
+        case 'M':
+            env.map_report = true;
+            break;
+        case 'v':
+            env.verbose = true;
+            break;
+        case 'h':
+            fputs(usage, stdout);
+            exit(0);
+        default:
+            fputs(usage, stderr);
+            return -EINVAL;
+        }
+    }
+
+    if (parse_interval_count(argc, argv, &env.interval, &env.times) < 0)
+        return -EINVAL;
+
+    for (unsigned long long span : spans) {
+        unsigned long long n = (span * 1000 + env.window_ms - 1) / env.window_ms;
+
+        /* One ring slot always holds the window in progress */
+        if (n >= NR_WINDOWS) {
+            fprintf(stderr, "window span %llus exceeds %d windows of %llums\n", span,
+                    NR_WINDOWS - 1, env.window_ms);
+            return -EINVAL;
+        }
+        env.horizons.push_back(n);
+    }
+
+    if (env.count && (env.stats || env.distributed || env.flight || env.outlier || env.tax ||
+                      !env.horizons.empty() || env.storm_lat)) {
+        fprintf(stderr, "count mode cannot be combined with timing options\n");
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/* SIGUSR1: dump the flight recorder at the next poll */
+static void sig_dump(int sig)
+{
+    dump_requested = 1;
+}
+
+static double monotonic_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_stats(const struct irq_key *key, const struct info *info, double secs)
+{
+    unsigned long long avg = info->count ? info->total / info->count : 0;
+    unsigned long long min = info->count ? info->min : 0;
+
+    printf("%-26s %10llu %10.1f %12llu %8llu %8llu %8llu\n", key->name,
+           (unsigned long long)info->count, secs > 0 ? info->count / secs : 0.0,
+           (unsigned long long)info->total, avg, min,
+           (unsigned long long)info->max);
+}
+
+struct info_entry {
+    struct irq_key key;
+    struct info info;
+};
+
+/**
+ * drain_infos - Read and delete all entries of infos
+ * @map: infos
+ * @entries: Filled with the entries, in map order
+ *
+ * The handlers, or the rollup timer, keep adding to the same keys while
+ * this runs, so every entry is read and deleted in one step: anything
+ * added after that starts a new entry for the next interval instead of
+ * being dropped with the old one. One batch call covers the whole map;
+ * kernels without batch operations fall back to one lookup and delete per
+ * key, and to a plain lookup then delete where even that is missing.
+ *
+ * @return 0 on success, negative on error
+ */
+static int drain_infos(struct bpf_map *map, std::vector<struct info_entry> &entries)
+{
+    __u32 batch = bpf_map__max_entries(map);
+    std::vector<struct irq_key> keys(batch);
+    std::vector<struct info> values(batch);
+    struct irq_key key, next_key, *prev = nullptr;
+    __u32 out_batch, *in_batch = nullptr;
+    int fd = bpf_map__fd(map);
+    int err;
+
+    for (;;) {
+        __u32 count = batch;
+
+        err = bpf_map_lookup_and_delete_batch(fd, in_batch, &out_batch, keys.data(),
+                                              values.data(), &count, nullptr);
+        /* Entries returned by a failing call are deleted all the same */
+        for (__u32 i = 0; i < count; i++)
+            entries.push_back({ keys[i], values[i] });
+        if (err)
+            break;
+        in_batch = &out_batch;
+    }
+    if (err == -ENOENT)
+        return 0; /* The whole map was walked */
+
+    /* No batch support, or the walk broke off: drain what is left per key */
+    while (!bpf_map_get_next_key(fd, prev, &next_key)) {
+        struct info_entry e = { next_key, {} };
+
+        key = next_key;
+        prev = &key;
+        err = bpf_map_lookup_and_delete_elem(fd, &next_key, &e.info);
+        if (err == -ENOENT)
+            continue;
+        if (err < 0) {
+            err = bpf_map_lookup_elem(fd, &next_key, &e.info);
+            if (err == -ENOENT)
+                continue;
+            if (err < 0) {
+                fprintf(stderr, "failed to lookup infos: %d\n", err);
+                return -1;
+            }
+            err = bpf_map_delete_elem(fd, &next_key);
+            if (err < 0 && err != -ENOENT) {
+                fprintf(stderr, "failed to cleanup infos: %d\n", err);
+                return -1;
+            }
+        }
+        entries.push_back(e);
+    }
+    return 0;
+}
+
+static int print_map(struct bpf_map *map, double secs)
+{
+    const char *units = env.nanoseconds ? "nsecs" : "usecs";
+    std::vector<struct info_entry> entries;
+
+    if (drain_infos(map, entries))
+        return -1;
+
+    if (env.count)
+        printf("%-26s %11s\n", "HARDIRQ", "TOTAL_count");
+    else if (env.stats)
+        printf("%-26s %10s %10s %7s%5s %8s %8s %8s\n", "HARDIRQ", "COUNT", "RATE/s",
+               "TOTAL_", units, "AVG", "MIN", "MAX");
+    else if (!env.distributed)
+        printf("%-26s %6s%5s\n", "HARDIRQ", "TOTAL_", units);
+
+    for (const auto &e : entries) {
+        if (env.stats) {
+            print_stats(&e.key, &e.info, secs);
+            if (env.distributed)
+                print_log2_hist(e.info.slots, MAX_SLOTS, units);
+        } else if (!env.distributed) {
+            printf("%-26s %11llu\n", e.key.name, (unsigned long long)e.info.count);
+        } else {
+            printf("hardirq = %s\n", e.key.name);
+            print_log2_hist(e.info.slots, MAX_SLOTS, units);
+        }
+    }
+    return 0;
+}
+
+/**
+ * print_windows - Print rolling histograms over the configured spans
+ * @obj: Loaded skeleton
+ *
+ * Only completed windows are summed; a ring slot is used only if its epoch
+ * matches, so windows without interrupts count as empty. Nothing is reset.
+ */
+static int print_windows(struct hardirqs_bpf *obj)
+{
+    const char *units = env.nanoseconds ? "nsecs" : "usecs";
+    unsigned long long window_ns = env.window_ms * 1000000ULL;
+    int fd = bpf_map__fd(obj->maps.windows);
+    struct irq_key lookup_key = {}, next_key;
+    struct irq_windows iw;
+    unsigned long long cur;
+    struct timespec ts;
+    int err;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    cur = (ts.tv_sec * 1000000000ULL + ts.tv_nsec) / window_ns;
+
+    while (!bpf_map_get_next_key(fd, &lookup_key, &next_key)) {
+        lookup_key = next_key;
+        err = bpf_map_lookup_elem(fd, &next_key, &iw);
+        if (err < 0) {
+            fprintf(stderr, "failed to lookup windows: %d\n", err);
+            return -1;
+        }
+        for (unsigned int n : env.horizons) {
+            unsigned int slots[MAX_SLOTS] = {};
+
+            for (unsigned long long e = cur - n; e < cur; e++) {
+                const struct hist_window &w = iw.w[e % NR_WINDOWS];
+
+                if (w.epoch != e)
+                    continue;
+                for (int i = 0; i < MAX_SLOTS; i++)
+                    slots[i] += w.slots[i];
+            }
+            printf("hardirq = %s, last %.1fs\n", next_key.name, n * env.window_ms / 1000.0);
+            print_log2_hist(slots, MAX_SLOTS, units);
+        }
+    }
+    return 0;
+}
+
+/**
+ * print_gaps - Print and reset the inter-arrival histograms
+ * @obj: Loaded skeleton
+ *
+ * Each CPU that saw an interrupt gets its own histogram. Deleting the
+ * element drops the gap spanning the reset, the next entry only restarts
+ * the clock.
+ */
+static int print_gaps(struct hardirqs_bpf *obj)
+{
+    const char *units = env.nanoseconds ? "nsecs" : "usecs";
+    int fd = bpf_map__fd(obj->maps.gaps);
+    int ncpus = libbpf_num_possible_cpus();
+    std::vector<struct gap_hist> percpu(ncpus > 0 ? ncpus : 0);
+    std::vector<__u32> keys;
+    __u32 key, next_key, *prev = nullptr;
+    int err;
+
+    if (percpu.empty())
+        return ncpus;
+
+    /* A NULL previous key starts the walk, irq 0 is a valid key */
+    while (!bpf_map_get_next_key(fd, prev, &next_key)) {
+        keys.push_back(next_key);
+        key = next_key;
+        prev = &key;
+    }
+    std::sort(keys.begin(), keys.end());
+
+    for (__u32 irq : keys) {
+        err = bpf_map_lookup_elem(fd, &irq, percpu.data());
+        if (err == -ENOENT)
+            continue;
+        if (err < 0) {
+            fprintf(stderr, "failed to lookup gaps: %d\n", err);
+            return -1;
+        }
+        for (int cpu = 0; cpu < ncpus; cpu++) {
+            const struct gap_hist &gh = percpu[cpu];
+            bool empty = true;
+
+            for (int i = 0; i < MAX_SLOTS && empty; i++)
+                empty = !gh.slots[i];
+            if (empty)
+                continue;
+            printf("hardirq = %s, irq %u, cpu %d, time between interrupts\n", gh.name, irq, cpu);
+            print_log2_hist(gh.slots, MAX_SLOTS, units);
+        }
+        bpf_map_delete_elem(fd, &irq);
+    }
+    return 0;
+}
+
+static std::string disk_name(__u32 dev)
+{
+    char path[64], target[PATH_MAX];
+    unsigned int major = dev >> MINORBITS, minor = dev & ((1U << MINORBITS) - 1);
+    ssize_t len;
+
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u", major, minor);
+    len = readlink(path, target, sizeof(target) - 1);
+    if (len <= 0)
+        return std::to_string(major) + ":" + std::to_string(minor);
+    target[len] = '\0';
+    return basename(target);
+}
+
+struct bio_entry {
+    struct bio_key key;
+    struct bio_info info;
+};
+
+/**
+ * print_bio - Print and reset block completions per interrupt and device
+ * @obj: Loaded skeleton
+ */
+static int print_bio(struct hardirqs_bpf *obj)
+{
+    const char *units = env.nanoseconds ? "nsecs" : "usecs";
+    int fd = bpf_map__fd(obj->maps.bio_infos);
+    int batch_fd = bpf_map__fd(obj->maps.bio_batches);
+    std::vector<struct bio_entry> entries;
+    struct bio_key bkey, next_bkey, *bprev = nullptr;
+    struct irq_key ikey, next_ikey, *iprev = nullptr;
+    std::vector<struct irq_key> irqs;
+    struct bio_batch batch;
+    int err;
+
+    while (!bpf_map_get_next_key(fd, bprev, &next_bkey)) {
+        struct bio_entry e = { next_bkey, {} };
+
+        bkey = next_bkey;
+        bprev = &bkey;
+        err = bpf_map_lookup_elem(fd, &next_bkey, &e.info);
+        if (err < 0) {
+            fprintf(stderr, "failed to lookup bio_infos: %d\n", err);
+            return -1;
+        }
+        entries.push_back(e);
+    }
+    for (const auto &e : entries)
+        bpf_map_delete_elem(fd, &e.key);
+    std::sort(entries.begin(), entries.end(), [](const bio_entry &a, const bio_entry &b) {
+        return a.info.count > b.info.count;
+    });
+
+    printf("%-26s %-12s %10s %12s %8s%5s\n", "HARDIRQ", "DISK", "IOS", "KBYTES", "AVG_",
+           units);
+    for (const auto &e : entries)
+        printf("%-26s %-12s %10llu %12llu %13llu\n", e.key.name, disk_name(e.key.dev).c_str(),
+               (unsigned long long)e.info.count, (unsigned long long)e.info.bytes / 1024,
+               e.info.count ? (unsigned long long)(e.info.lat_total / e.info.count) : 0ULL);
+
+    while (!bpf_map_get_next_key(batch_fd, iprev, &next_ikey)) {
+        ikey = next_ikey;
+        iprev = &ikey;
+        irqs.push_back(next_ikey);
+    }
+
+    printf("\n%-26s %10s %12s %10s\n", "HARDIRQ", "IRQS_W_IO", "COMPLETIONS", "PER_IRQ");
+    for (const auto &k : irqs) {
+        if (bpf_map_lookup_elem(batch_fd, &k, &batch))
+            continue;
+        bpf_map_delete_elem(batch_fd, &k);
+        printf("%-26s %10llu %12llu %10.2f\n", k.name, (unsigned long long)batch.irqs,
+               (unsigned long long)batch.completions,
+               batch.irqs ? (double)batch.completions / batch.irqs : 0.0);
+        if (env.distributed) {
+            printf("hardirq = %s, requests completed per invocation\n", k.name);
+            print_log2_hist(batch.slots, MAX_SLOTS, "requests");
+        }
+    }
+
+    if (!env.distributed)
+        return 0;
+    for (const auto &e : entries) {
+        printf("\nhardirq = %s, disk = %s, completion latency\n", e.key.name,
+               disk_name(e.key.dev).c_str());
+        print_log2_hist(e.info.slots, MAX_SLOTS, units);
+    }
+    return 0;
+}
+
+static std::string idle_state_name(__u32 state)
+{
+    char path[96], name[32];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cpuidle/state%u/name", state);
+    f = fopen(path, "r");
+    if (!f || !fgets(name, sizeof(name), f)) {
+        if (f)
+            fclose(f);
+        return "state" + std::to_string(state);
+    }
+    fclose(f);
+    name[strcspn(name, "\n")] = '\0';
+    return name;
+}
+
+struct idle_entry {
+    struct idle_key key;
+    struct idle_info info;
+};
+
+/**
+ * print_idle - Print and reset idle exit to handler latencies
+ * @obj: Loaded skeleton
+ *
+ * Exits not followed by a handler were woken by a vector that bypasses
+ * irq_handler_entry (local timer, IPI) and only show up in EXITS.
+ */
+static int print_idle(struct hardirqs_bpf *obj)
+{
+    const char *units = env.nanoseconds ? "nsecs" : "usecs";
+    int fd = bpf_map__fd(obj->maps.idle_infos);
+    int counts_fd = bpf_map__fd(obj->maps.idle_counts);
+    int ncpus = libbpf_num_possible_cpus();
+    std::vector<__u64> percpu(ncpus > 0 ? ncpus : 0), zeros(percpu.size());
+    std::vector<struct idle_entry> entries;
+    unsigned long long followed[MAX_IDLE_STATES] = {};
+    struct idle_key key, next_key, *prev = nullptr;
+    int err;
+
+    if (percpu.empty())
+        return ncpus;
+
+    while (!bpf_map_get_next_key(fd, prev, &next_key)) {
+        struct idle_entry e = { next_key, {} };
+
+        key = next_key;
+        prev = &key;
+        err = bpf_map_lookup_elem(fd, &next_key, &e.info);
+        if (err < 0) {
+            fprintf(stderr, "failed to lookup idle_infos: %d\n", err);
+            return -1;
+        }
+        if (e.key.state < MAX_IDLE_STATES)
+            followed[e.key.state] += e.info.count;
+        entries.push_back(e);
+    }
+    for (const auto &e : entries)
+        bpf_map_delete_elem(fd, &e.key);
+    std::sort(entries.begin(), entries.end(), [](const idle_entry &a, const idle_entry &b) {
+        return a.key.state != b.key.state ? a.key.state > b.key.state :
+                                            a.info.count > b.info.count;
+    });
+
+    printf("%-12s %12s %12s\n", "IDLE_STATE", "EXITS", "BY_HARDIRQ");
+    for (__u32 state = 0; state < MAX_IDLE_STATES; state++) {
+        unsigned long long exits = 0;
+
+        if (bpf_map_lookup_elem(counts_fd, &state, percpu.data()))
+            continue;
+        for (__u64 v : percpu)
+            exits += v;
+        if (!exits)
+            continue;
+        bpf_map_update_elem(counts_fd, &state, zeros.data(), BPF_ANY);
+        printf("%-12s %12llu %11.1f%%\n", idle_state_name(state).c_str(), exits,
+               100.0 * followed[state] / exits);
+    }
+
+    printf("\n%-12s %-26s %10s %8s%5s\n", "IDLE_STATE", "HARDIRQ", "COUNT", "AVG_", units);
+    for (const auto &e : entries)
+        printf("%-12s %-26s %10llu %13llu\n", idle_state_name(e.key.state).c_str(),
+               e.key.name, (unsigned long long)e.info.count,
+               e.info.count ? (unsigned long long)(e.info.lat_total / e.info.count) : 0ULL);
+
+    if (!env.distributed)
+        return 0;
+    for (const auto &e : entries) {
+        printf("\nidle state = %s, hardirq = %s, idle exit to handler\n",
+               idle_state_name(e.key.state).c_str(), e.key.name);
+        print_log2_hist(e.info.slots, MAX_SLOTS, units);
+    }
+    return 0;
+}
+
+struct flight_entry {
+    int cpu;
+    struct flight_rec rec;
+};
+
+/**
+ * dump_flight - Print and release a frozen flight recorder
+ * @obj: Loaded skeleton
+ *
+ * Records of all CPUs are merged in timestamp order and limited to the
+ * flight window preceding the trigger (or the dump request).
+ */
+static int dump_flight(struct hardirqs_bpf *obj)
+{
+    const char *units = env.nanoseconds ? "ns" : "us";
+    int ctl_fd = bpf_map__fd(obj->maps.flight_ctl);
+    int buf_fd = bpf_map__fd(obj->maps.flight_buf);
+    int ncpus = libbpf_num_possible_cpus();
+    std::vector<struct flight_entry> entries;
+    std::vector<struct flight_rec> percpu;
+    struct flight_ctl ctl, zero_ctl = {};
+    unsigned long long end, window;
+    struct timespec ts;
+    __u32 key = 0;
+    int err;
+
+    if (ncpus <= 0)
+        return ncpus;
+    err = bpf_map_lookup_elem(ctl_fd, &key, &ctl);
+    if (err)
+        return err;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    end = ctl.frozen == FLIGHT_FROZEN_TRIGGER ? ctl.trigger_ts :
+          ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    window = env.flight_window_ms * 1000000ULL;
+
+    percpu.resize(ncpus);
+    for (__u32 i = 0; i < env.flight_slots; i++) {
+        err = bpf_map_lookup_elem(buf_fd, &i, percpu.data());
+        if (err)
+            return err;
+        for (int cpu = 0; cpu < ncpus; cpu++) {
+            const struct flight_rec &rec = percpu[cpu];
+
+            if (!rec.ts || rec.ts > end || end - rec.ts > window)
+                continue;
+            entries.push_back({ cpu, rec });
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const flight_entry &a, const flight_entry &b) { return a.rec.ts < b.rec.ts; });
+
+    if (ctl.frozen == FLIGHT_FROZEN_TRIGGER)
+        printf("flight recorder triggered on CPU %u: %llu %s\n", ctl.trigger_cpu,
+               (unsigned long long)ctl.trigger_delta, units);
+    else
+        printf("flight recorder dump requested\n");
+    printf("%-14s %-4s %-6s %-16s %10s\n", "TIME(ms)", "CPU", "IRQ", "HANDLER", units);
+    for (const auto &e : entries) {
+        long long rel_ns = (long long)e.rec.ts - (long long)end;
+
+        printf("%-14.3f %-4d %-6u %-16.*s %10u\n", rel_ns / 1e6, e.cpu, e.rec.irq,
+               FLIGHT_NAME_LEN, e.rec.name, e.rec.delta);
+    }
+
+    /* Resume recording */
+    return bpf_map_update_elem(ctl_fd, &key, &zero_ctl, BPF_ANY);
+}
+
+static int poll_flight(struct hardirqs_bpf *obj)
+{
+    int ctl_fd = bpf_map__fd(obj->maps.flight_ctl);
+    struct flight_ctl ctl;
+    __u32 key = 0;
+    int err;
+
+    err = bpf_map_lookup_elem(ctl_fd, &key, &ctl);
+    if (err)
+        return err;
+
+    if (!ctl.frozen && dump_requested) {
+        /*
+         * Freeze on behalf of the user. A trigger racing with this update
+         * is overwritten, which only loses its trigger details.
+         */
+        ctl = {};
+        ctl.frozen = FLIGHT_FROZEN_USER;
+        err = bpf_map_update_elem(ctl_fd, &key, &ctl, BPF_ANY);
+        if (err)
+            return err;
+    }
+    dump_requested = 0;
+
+    if (!ctl.frozen)
+        return 0;
+    return dump_flight(obj);
+}
+
+static void print_stack(__s32 stack_id)
+{
+    const std::vector<std::string> *frames = stack_syms->resolve(stack_id);
+
+    if (!frames) {
+        printf("    [stack unavailable: %d]\n", stack_id);
+        return;
+    }
+    for (const auto &frame : *frames)
+        printf("    %s\n", frame.c_str());
+}
+
+static int handle_outlier(void *ctx, void *data, size_t data_sz)
+{
+    const struct outlier_event *e = (const struct outlier_event *)data;
+
+    if (data_sz < sizeof(*e))
+        return 0;
+
+    if (env.timestamp)
+        print_timestamp();
+    printf("outlier: %s irq %u cpu %u %llu %s", e->name, e->irq, e->cpu,
+           (unsigned long long)e->delta, env.nanoseconds ? "ns" : "us");
+    if (e->weight > 1)
+        printf(" (sampled 1/%u)", e->weight);
+    printf("\n");
+    print_stack(e->stack_id);
+    return 0;
+}
+
+static void print_storm_flags(__u32 flags)
+{
+    if (!flags)
+        printf("none");
+    if (flags & STORM_F_RATE)
+        printf("rate%s", flags & STORM_F_LATENCY ? "+" : "");
+    if (flags & STORM_F_LATENCY)
+        printf("latency");
+}
+
+static int handle_storm(void *ctx, void *data, size_t data_sz)
+{
+    const struct storm_event *e = (const struct storm_event *)data;
+
+    if (data_sz < sizeof(*e))
+        return 0;
+
+    if (env.timestamp)
+        print_timestamp();
+    printf("storm %s: %s irq %u cpu %u, %llu irqs/s, avg %llu %s (",
+           e->flags & ~e->prev_flags ? "start" : "end", e->name, e->irq, e->cpu,
+           (unsigned long long)e->rate, (unsigned long long)e->latency,
+           env.nanoseconds ? "ns" : "us");
+    print_storm_flags(e->prev_flags);
+    printf(" -> ");
+    print_storm_flags(e->flags);
+    printf(")\n");
+    return 0;
+}
+
+/**
+ * add_ringbuf - Poll one more ring buffer map from the main loop
+ * @rb: Ring buffer manager, created on first use
+ * @map: BPF_MAP_TYPE_RINGBUF map
+ * @cb: Record callback
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+static int add_ringbuf(struct ring_buffer **rb, struct bpf_map *map, ring_buffer_sample_fn cb)
+{
+    if (*rb)
+        return ring_buffer__add(*rb, bpf_map__fd(map), cb, nullptr);
+    *rb = ring_buffer__new(bpf_map__fd(map), cb, nullptr, nullptr);
+    return *rb ? 0 : -errno;
+}
+
+/**
+ * print_outlier_drops - Report outlier events lost since the last call
+ * @obj: Loaded skeleton
+ */
+static void print_outlier_drops(struct hardirqs_bpf *obj)
+{
+    static unsigned long long reported;
+    int ncpus = libbpf_num_possible_cpus();
+    std::vector<struct sampler_stats> stats(ncpus > 0 ? ncpus : 0);
+    unsigned long long dropped = 0;
+    __u32 key = 0;
+
+    if (stats.empty() ||
+        bpf_map_lookup_elem(bpf_map__fd(obj->maps.sampler_stats), &key, stats.data()))
+        return;
+    for (const auto &s : stats)
+        dropped += s.dropped_weight;
+    if (dropped > reported)
+        printf("%llu outlier events dropped\n", dropped - reported);
+    reported = dropped;
+}
+
+struct tax_entry {
+    struct tax_key key;
+    unsigned long long count;
+    unsigned long long total_ns;
+    char comm[TASK_COMM_LEN];
+};
+
+/**
+ * print_tax - Print and reset the interrupt time charged to tasks and cgroups
+ * @obj: Loaded skeleton
+ */
+static int print_tax(struct hardirqs_bpf *obj)
+{
+    const char *units = env.nanoseconds ? "nsecs" : "usecs";
+    unsigned long long div = env.nanoseconds ? 1 : 1000;
+    int fd = bpf_map__fd(obj->maps.irq_tax);
+    int ncpus = libbpf_num_possible_cpus();
+    std::map<unsigned long long, std::pair<unsigned long long, unsigned long long>> cgroups;
+    std::vector<struct tax_info> percpu(ncpus > 0 ? ncpus : 0);
+    std::vector<struct tax_entry> tasks;
+    struct tax_key lookup_key = {}, next_key;
+    int err;
+
+    if (percpu.empty())
+        return ncpus;
+
+    while (!bpf_map_get_next_key(fd, &lookup_key, &next_key)) {
+        struct tax_entry entry = {};
+
+        lookup_key = next_key;
+        err = bpf_map_lookup_elem(fd, &next_key, percpu.data());
+        if (err == -ENOENT)
+            continue; /* evicted by the LRU meanwhile */
+        if (err < 0) {
+            fprintf(stderr, "failed to lookup irq_tax: %d\n", err);
+            return -1;
+        }
+        entry.key = next_key;
+        for (const auto &v : percpu) {
+            entry.count += v.count;
+            entry.total_ns += v.total_ns;
+            if (!entry.comm[0] && v.comm[0])
+                memcpy(entry.comm, v.comm, sizeof(entry.comm));
+        }
+        tasks.push_back(entry);
+    }
+
+    for (const auto &t : tasks) {
+        bpf_map_delete_elem(fd, &t.key);
+        cgroups[t.key.cgroup_id].first += t.count;
+        cgroups[t.key.cgroup_id].second += t.total_ns;
+    }
+
+    std::sort(tasks.begin(), tasks.end(),
+              [](const tax_entry &a, const tax_entry &b) { return a.total_ns > b.total_ns; });
+    if (tasks.size() > (size_t)env.tax_top)
+        tasks.resize(env.tax_top);
+
+    printf("%-8s %-8s %-16s %10s %11s%5s\n", "PID", "TID", "COMM", "IRQS", "IRQ_TIME_", units);
+    for (const auto &t : tasks)
+        printf("%-8u %-8u %-16.*s %10llu %16llu\n", t.key.tgid, t.key.pid, TASK_COMM_LEN,
+               t.key.tgid ? t.comm : "[idle]", t.count, t.total_ns / div);
+
+    std::vector<std::pair<unsigned long long, std::pair<unsigned long long, unsigned long long>>>
+        by_time(cgroups.begin(), cgroups.end());
+    std::sort(by_time.begin(), by_time.end(),
+              [](const auto &a, const auto &b) { return a.second.second > b.second.second; });
+
+    printf("\n%-40s %10s %11s%5s\n", "CGROUP", "IRQS", "IRQ_TIME_", units);
+    for (const auto &c : by_time)
+        printf("%-40s %10llu %16llu\n", cgroup_name(c.first).c_str(), c.second.first,
+               c.second.second / div);
+    return 0;
+}
+
+/**
+ * start_rollup - Arm the in-kernel rollup timer
+ * @obj: Loaded skeleton
+ *
+ * bpf_timer can only be armed from BPF, so run the start_rollup syscall
+ * program once.
+ */
+static int start_rollup(struct hardirqs_bpf *obj)
+{
+    LIBBPF_OPTS(bpf_test_run_opts, opts);
+    int err;
+
+    err = bpf_prog_test_run_opts(bpf_program__fd(obj->progs.start_rollup), &opts);
+    if (err)
+        return err;
+    return (int)opts.retval;
+}
+
+/**
+ * skip_unused_maps - Keep the maps of modes that are off from being created
+ * @obj: Opened skeleton
+ *
+ * Their references are in code the rodata knobs make dead, which the
+ * verifier skips and libbpf poisons, so the object still loads.
+ */
+static void skip_unused_maps(struct hardirqs_bpf *obj)
+{
+    const struct {
+        struct bpf_map *map;
+        bool used;
+    } maps[] = {
+        { obj->maps.cgroup_map, env.cg },
+        { obj->maps.start, !env.count },
+        { obj->maps.flight_buf, env.flight },
+        { obj->maps.flight_head, env.flight },
+        { obj->maps.flight_ctl, env.flight },
+        { obj->maps.outliers, env.outlier },
+        { obj->maps.stacks, env.outlier },
+        { obj->maps.sampler_ctl, env.outlier },
+        { obj->maps.sampler_stats, env.outlier },
+        { obj->maps.sampler_bucket, env.outlier },
+        { obj->maps.irq_tax, env.tax },
+        { obj->maps.windows, !env.horizons.empty() },
+        { obj->maps.pcpu_infos, env.rollup_ms != 0 },
+        { obj->maps.rollup_timer, env.rollup_ms != 0 },
+        { obj->maps.storm_states, env.storm_rate || env.storm_lat },
+        { obj->maps.storms, env.storm_rate || env.storm_lat },
+        { obj->maps.gaps, env.gaps },
+        { obj->maps.irq_cur, env.bio },
+        { obj->maps.bio_start, env.bio },
+        { obj->maps.bio_infos, env.bio },
+        { obj->maps.bio_batches, env.bio },
+        { obj->maps.idle_exits, env.idle },
+        { obj->maps.idle_counts, env.idle },
+        { obj->maps.idle_infos, env.idle },
+    };
+
+    for (const auto &m : maps)
+        if (!m.used)
+            bpf_map__set_autocreate(m.map, false);
+}
+
+static void print_map_memory(struct hardirqs_bpf *obj)
+{
+    unsigned long long total = 0;
+    int created = 0, skipped = 0;
+    struct bpf_map *map;
+
+    bpf_object__for_each_map(map, obj->obj) {
+        if (!bpf_map__autocreate(map)) {
+            skipped++;
+            continue;
+        }
+        created++;
+        total += map_memlock(bpf_map__fd(map));
+        if (env.verbose)
+            fprintf(stderr, "map %-16s %10llu bytes\n", bpf_map__name(map),
+                    map_memlock(bpf_map__fd(map)));
+    }
+    fprintf(stderr, "%d BPF maps using %llu KiB, %d unused ones not created\n", created,
+            total / 1024, skipped);
+}
+
+/**
+ * start_map_report - Track every created map for the exit report
+ * @obj: Loaded skeleton
+ */
+static int start_map_report(struct hardirqs_bpf *obj)
+{
+    struct bpf_map *map;
+    int err;
+
+    map_report = new MapReport();
+    bpf_object__for_each_map(map, obj->obj) {
+        if (!bpf_map__autocreate(map))
+            continue;
+        err = map_report->add(bpf_map__fd(map));
+        if (err)
+            return err;
+    }
+    return 0;
+}
+
+/**
+ * print_map_report - Hand the counted failed inserts over and print the report
+ * @obj: Loaded skeleton
+ */
+static void print_map_report(struct hardirqs_bpf *obj)
+{
+    /* In FAIL_* order */
+    static const char *const names[NR_FAIL_MAPS] = {
+        "infos", "pcpu_infos", "windows", "storm_states", "bio_infos", "bio_batches", "idle_infos",
+        "gaps",
+    };
+    int ncpus = libbpf_num_possible_cpus();
+    std::vector<__u64> fails(ncpus > 0 ? ncpus : 0);
+    int fd = bpf_map__fd(obj->maps.init_fails);
+
+    map_report->sample();
+    for (__u32 slot = 0; slot < NR_FAIL_MAPS && !fails.empty(); slot++) {
+        unsigned long long sum = 0;
+
+        if (bpf_map_lookup_elem(fd, &slot, fails.data()))
+            continue;
+        for (__u64 f : fails)
+            sum += f;
+        map_report->set_fails(names[slot], sum);
+    }
+    printf("\n");
+    map_report->print();
+}
+
+int main(int argc, char **argv)
+{
+    struct ring_buffer *rb = nullptr;
+    struct hardirqs_bpf *obj;
+    double last_print;
+    int cgfd = -1;
+    int err;
+
+    err = parse_args(argc, argv);
+    if (err)
+        return 1;
+
+    set_libbpf_print(env.verbose);
+
+    obj = hardirqs_bpf__open();
+    if (!obj) {
+        fprintf(stderr, "failed to open BPF object\n");
+        return 1;
+    }
+
+    if (probe_tp_btf("irq_handler_entry")) {
+        bpf_program__set_autoload(obj->progs.irq_handler_entry, false);
+        bpf_program__set_autoload(obj->progs.irq_handler_exit, false);
+        if (env.count && !env.bio)
+            bpf_program__set_autoload(obj->progs.irq_handler_exit_btf, false);
+    } else {
+        bpf_program__set_autoload(obj->progs.irq_handler_entry_btf, false);
+        bpf_program__set_autoload(obj->progs.irq_handler_exit_btf, false);
+        if (env.count && !env.bio)
+            bpf_program__set_autoload(obj->progs.irq_handler_exit, false);
+    }
+    if (env.bio && !probe_tp_btf("block_rq_complete")) {
+        fprintf(stderr, "block I/O correlation needs BTF-enabled block tracepoints\n");
+        err = -ENOENT;
+        goto cleanup;
+    }
+    if (!env.bio) {
+        bpf_program__set_autoload(obj->progs.block_rq_issue, false);
+        bpf_program__set_autoload(obj->progs.block_rq_complete, false);
+    }
+    if (env.idle && !probe_tp_btf("cpu_idle")) {
+        fprintf(stderr, "idle correlation needs BTF-enabled power tracepoints\n");
+        err = -ENOENT;
+        goto cleanup;
+    }
+    if (!env.idle)
+        bpf_program__set_autoload(obj->progs.cpu_idle, false);
+    if (!env.rollup_ms)
+        bpf_program__set_autoload(obj->progs.start_rollup, false);
+
+    /* initialize global data (filtering options) */
+    obj->rodata->filter_cg = env.cg;
+    obj->rodata->do_count = env.count;
+    obj->rodata->targ_dist = env.distributed;
+    obj->rodata->targ_stats = env.stats;
+    obj->rodata->targ_ns = env.nanoseconds;
+    obj->rodata->targ_flight = env.flight;
+    obj->rodata->flight_thresh = env.flight_thresh;
+    obj->rodata->flight_slots = env.flight_slots;
+    obj->rodata->outlier_thresh = env.outlier_thresh;
+    obj->rodata->targ_tax = env.tax;
+    if (!env.horizons.empty())
+        obj->rodata->window_ns = env.window_ms * 1000000ULL;
+    obj->rodata->rollup_ns = env.rollup_ms * 1000000ULL;
+    obj->rodata->nr_cpus = libbpf_num_possible_cpus();
+    if (env.storm_rate)
+        obj->rodata->storm_gap_ns = 1000000000ULL / env.storm_rate;
+    obj->rodata->storm_lat = env.storm_lat;
+    obj->rodata->targ_gaps = env.gaps;
+    obj->rodata->targ_bio = env.bio;
+    obj->rodata->targ_idle = env.idle;
+
+    bpf_map__set_max_entries(obj->maps.flight_buf, env.flight_slots);
+    skip_unused_maps(obj);
+
+    err = hardirqs_bpf__load(obj);
+    if (err) {
+        fprintf(stderr, "failed to load BPF object: %d\n", err);
+        goto cleanup;
+    }
+    print_map_memory(obj);
+
+    if (env.map_report) {
+        err = start_map_report(obj);
+        if (err) {
+            fprintf(stderr, "failed to read map info: %d\n", err);
+            goto cleanup;
+        }
+    }
+
+    /* update cgroup path fd to map */
+    if (env.cg) {
+        int idx = 0;
+        int cg_map_fd = bpf_map__fd(obj->maps.cgroup_map);
+
+        cgfd = open(env.cgroupspath, O_RDONLY);
+        if (cgfd < 0) {
+            err = -errno;
+            fprintf(stderr, "Failed opening Cgroup path: %s\n", env.cgroupspath);
+            goto cleanup;
+        }
+        err = bpf_map_update_elem(cg_map_fd, &idx, &cgfd, BPF_ANY);
+        if (err) {
+            fprintf(stderr, "Failed adding target cgroup to map\n");
+            goto cleanup;
+        }
+    }
+
+    err = hardirqs_bpf__attach(obj);
+    if (err) {
+        fprintf(stderr, "failed to attach BPF programs\n");
+        goto cleanup;
+    }
+
+    if (env.rollup_ms) {
+        err = start_rollup(obj);
+        if (err) {
+            fprintf(stderr, "failed to start rollup timer: %d\n", err);
+            goto cleanup;
+        }
+    }
+
+    if (env.outlier) {
+        err = ksyms.load();
+        if (err)
+            fprintf(stderr, "failed to load kallsyms, stacks are not symbolized: %d\n", err);
+        stack_syms = new StackSymbolizer(ksyms, bpf_map__fd(obj->maps.stacks), MAX_STACK_DEPTH);
+
+        err = add_ringbuf(&rb, obj->maps.outliers, handle_outlier);
+        if (err) {
+            fprintf(stderr, "failed to create ring buffer: %d\n", err);
+            goto cleanup;
+        }
+    }
+
+    if (env.storm_rate || env.storm_lat) {
+        err = add_ringbuf(&rb, obj->maps.storms, handle_storm);
+        if (err) {
+            fprintf(stderr, "failed to create ring buffer: %d\n", err);
+            goto cleanup;
+        }
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+    if (env.flight)
+        signal(SIGUSR1, sig_dump);
+
+    printf("Tracing hard irq event time... Hit Ctrl-C to end.\n");
+    last_print = monotonic_secs();
+
+    /* main: poll */
+    while (!exiting) {
+        for (long waited = 0; !exiting && waited < env.interval * 1000L; waited += POLL_MS) {
+            if (rb) {
+                err = ring_buffer__poll(rb, POLL_MS);
+                if (err < 0 && err != -EINTR) {
+                    fprintf(stderr, "error polling ring buffer: %d\n", err);
+                    goto cleanup;
+                }
+            } else {
+                usleep(POLL_MS * 1000);
+            }
+            if (env.flight && poll_flight(obj))
+                fprintf(stderr, "failed to dump flight recorder\n");
+        }
+        printf("\n");
+
+        if (env.timestamp)
+            print_timestamp();
+
+        double now = monotonic_secs();
+
+        /* Before print_map and friends drain the maps */
+        if (map_report)
+            map_report->sample();
+        err = print_map(obj->maps.infos, now - last_print);
+        last_print = now;
+        if (err)
+            break;
+
+        if (env.outlier)
+            print_outlier_drops(obj);
+
+        if (env.tax) {
+            printf("\n");
+            err = print_tax(obj);
+            if (err)
+                break;
+        }
+
+        if (!env.horizons.empty()) {
+            printf("\n");
+            err = print_windows(obj);
+            if (err)
+                break;
+        }
+
+        if (env.gaps) {
+            printf("\n");
+            err = print_gaps(obj);
+            if (err)
+                break;
+        }
+
+        if (env.bio) {
+            printf("\n");
+            err = print_bio(obj);
+            if (err)
+                break;
+        }
+
+        if (env.idle) {
+            printf("\n");
+            err = print_idle(obj);
+            if (err)
+                break;
+        }
+
+        if (--env.times == 0)
+            break;
+    }
+
+    if (map_report)
+        print_map_report(obj);
+
+cleanup:
+    ring_buffer__free(rb);
+    delete stack_syms;
+    delete map_report;
+    hardirqs_bpf__destroy(obj);
+    if (cgfd > 0)
+        close(cgfd);
+
+    return err != 0;
+}
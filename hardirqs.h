@@ -0,0 +1,257 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __HARDIRQS_H
+#define __HARDIRQS_H
+
+/**
+ * @file hardirqs.h
+ * @brief Definitions shared between hardirqs.bpf.c and its userspace front-end
+ */
+
+#define MAX_SLOTS 20
+#define IRQ_NAME_LEN 32
+
+/* Flight recorder: records per CPU, must be a power of two */
+#define FLIGHT_SLOTS 4096
+#define FLIGHT_NAME_LEN 16
+
+/* Who froze the flight recorder (flight_ctl.frozen) */
+#define FLIGHT_FROZEN_TRIGGER 1 /* handle_exit saw a latency above flight_thresh */
+#define FLIGHT_FROZEN_USER 2 /* userspace asked for a dump */
+
+/* Outlier events: kernel stack depth and number of distinct stacks kept */
+#define MAX_STACK_DEPTH 127
+#define MAX_STACKS 1024
+
+/* Interrupt tax: interrupted tasks tracked at once */
+#define MAX_TAX_ENTRIES 10240
+#define TASK_COMM_LEN 16
+
+/* Rolling windows kept per interrupt, one of them is always in progress */
+#define NR_WINDOWS 64
+
+/* Rollup: bpf_timer folding per-CPU statistics into infos */
+#define ROLLUP_MAX_CPUS 4096
+
+/* Storm detection: EWMA weight 1/2^EWMA_SHIFT, EWMA_FP fractional bits */
+#define EWMA_SHIFT 3
+#define EWMA_FP 8
+#define MAX_STORM_IRQS 1024
+
+#define STORM_F_RATE (1U << 0) /* Interrupt rate at or above storm_rate */
+#define STORM_F_LATENCY (1U << 1) /* Handler latency at or above storm_lat */
+#define STORM_SEEDED_GAP (1U << 0) /* gap_fp holds at least one sample */
+#define STORM_SEEDED_LAT (1U << 1) /* lat_fp holds at least one sample */
+
+/* Inter-arrival histograms: interrupt numbers tracked at once */
+#define MAX_GAP_IRQS 1024
+
+/* Block I/O correlation: requests in flight and (irq, device) pairs tracked */
+#define MAX_BIO_INFLIGHT 10240
+#define MAX_BIO_KEYS 1024
+#define BIO_NO_IRQ "[no hardirq]" /* Name used for completions outside hardirqs */
+#define MINORBITS 20 /* Kernel dev_t layout */
+
+/* Idle wakeups: cpuidle states tracked, CPUIDLE_STATE_MAX is 10 */
+#define MAX_IDLE_STATES 16
+
+/* init_fails slots: maps whose lookup_or_try_init inserts are counted */
+enum {
+    FAIL_INFOS,
+    FAIL_PCPU_INFOS,
+    FAIL_WINDOWS,
+    FAIL_STORM_STATES,
+    FAIL_BIO_INFOS,
+    FAIL_BIO_BATCHES,
+    FAIL_IDLE_INFOS,
+    FAIL_GAPS,
+    NR_FAIL_MAPS,
+};
+
+/**
+ * @struct irq_key
+ * @brief Key structure for identifying unique interrupts
+ */
+struct irq_key {
+    char name[IRQ_NAME_LEN]; /* Interrupt handler name */
+};
+
+/**
+ * @struct info
+ * @brief Per-interrupt statistics stored in the infos map
+ */
+struct info {
+    __u64 count; /* Occurrences, or summed latency in timing mode */
+    __u32 slots[MAX_SLOTS]; /* log2 latency histogram */
+    __u64 total; /* Summed latency, combined mode only */
+    __u64 min; /* Smallest latency, combined mode only, ~0 until the first sample */
+    __u64 max; /* Largest latency, combined mode only */
+};
+
+/**
+ * @struct flight_rec
+ * @brief Compact record kept in the per-CPU flight recorder ring
+ */
+struct flight_rec {
+    __u64 ts; /* bpf_ktime_get_ns() at handler exit, 0 if never written */
+    __u32 delta; /* Handler latency in the tool's time unit, saturated */
+    __u32 irq; /* Hardware interrupt number */
+    char name[FLIGHT_NAME_LEN]; /* Truncated handler name */
+};
+
+/**
+ * @struct flight_ctl
+ * @brief Flight recorder state, single entry of the flight_ctl array map
+ *
+ * While frozen is non-zero no CPU writes to the ring, so userspace can
+ * dump it consistently; writing frozen back to 0 resumes recording.
+ */
+struct flight_ctl {
+    __u32 frozen; /* 0 or FLIGHT_FROZEN_* */
+    __u32 trigger_cpu; /* CPU that hit the threshold */
+    __u64 trigger_ts; /* Timestamp of the triggering record */
+    __u64 trigger_delta; /* Latency of the triggering record */
+};
+
+/**
+ * @struct outlier_event
+ * @brief Ring buffer record for a handler at or above outlier_thresh
+ */
+struct outlier_event {
+    __u64 ts; /* bpf_ktime_get_ns() at handler exit */
+    __u64 delta; /* Handler latency in the tool's time unit */
+    __s32 stack_id; /* Kernel stack in the stacks map, negative if not captured */
+    __u32 cpu; /* CPU the handler ran on */
+    __u32 irq; /* Hardware interrupt number */
+    __u32 weight; /* Outliers this event stands for when sampled */
+    char name[IRQ_NAME_LEN]; /* Interrupt handler name */
+};
+
+/**
+ * @struct tax_key
+ * @brief Task that was running when an interrupt arrived
+ */
+struct tax_key {
+    __u32 tgid; /* Process ID */
+    __u32 pid; /* Thread ID */
+    __u64 cgroup_id; /* cgroup v2 id, equal to the cgroup directory inode */
+};
+
+/**
+ * @struct tax_info
+ * @brief Interrupt time charged to a task, per CPU in the irq_tax map
+ */
+struct tax_info {
+    __u64 count; /* Interrupts that hit the task */
+    __u64 total_ns; /* Handler time stolen from the task, always in ns */
+    char comm[TASK_COMM_LEN]; /* Task name when first charged */
+};
+
+/**
+ * @struct hist_window
+ * @brief log2 latency histogram of one time window
+ */
+struct hist_window {
+    __u64 epoch; /* ktime / window_ns this window was last reset for */
+    __u32 slots[MAX_SLOTS];
+};
+
+/**
+ * @struct irq_windows
+ * @brief Ring of windows of one interrupt, window e lives at w[e % NR_WINDOWS]
+ *
+ * A slot whose epoch does not match the window a reader is looking for
+ * holds stale data from NR_WINDOWS windows ago (or none) and is skipped.
+ */
+struct irq_windows {
+    struct hist_window w[NR_WINDOWS];
+};
+
+/**
+ * @struct storm_state
+ * @brief Per-CPU moving averages of one interrupt line
+ */
+struct storm_state {
+    __u64 last_ts; /* Previous entry timestamp in ns */
+    __u64 gap_fp; /* EWMA of the inter-arrival gap in ns, fixed point */
+    __u64 lat_fp; /* EWMA of the handler latency in the tool's unit, fixed point */
+    __u32 flags; /* STORM_F_* currently raised */
+    __u32 seeded; /* STORM_SEEDED_*, averages with no sample are not used */
+};
+
+/**
+ * @struct storm_event
+ * @brief Ring buffer record sent when the storm flags of an irq/CPU change
+ */
+struct storm_event {
+    __u64 ts; /* bpf_ktime_get_ns() of the transition */
+    __u64 rate; /* Averaged interrupts per second on this CPU */
+    __u64 latency; /* Averaged handler latency in the tool's unit */
+    __u32 irq; /* Hardware interrupt number */
+    __u32 cpu; /* CPU the averages belong to */
+    __u32 flags; /* STORM_F_* raised after the transition */
+    __u32 prev_flags; /* STORM_F_* raised before the transition */
+    char name[IRQ_NAME_LEN]; /* Interrupt handler name */
+};
+
+/**
+ * @struct gap_hist
+ * @brief Per-CPU inter-arrival histogram of one interrupt number
+ */
+struct gap_hist {
+    __u64 last_ts; /* Previous entry timestamp in ns, 0 before the first one */
+    __u32 slots[MAX_SLOTS]; /* log2 histogram of gaps in the tool's unit */
+    char name[IRQ_NAME_LEN]; /* Handler name seen on the first entry */
+};
+
+/**
+ * @struct bio_key
+ * @brief Block device whose requests completed inside an interrupt
+ */
+struct bio_key {
+    __u32 dev; /* Kernel dev_t of the disk, major << MINORBITS | minor */
+    __u32 pad;
+    char name[IRQ_NAME_LEN]; /* Enclosing handler, BIO_NO_IRQ outside hardirqs */
+};
+
+/**
+ * @struct bio_info
+ * @brief Requests of one device completed by one interrupt
+ */
+struct bio_info {
+    __u64 count; /* Requests completed */
+    __u64 bytes; /* Bytes completed */
+    __u64 lat_total; /* Summed issue-to-completion latency in the tool's unit */
+    __u32 slots[MAX_SLOTS]; /* log2 histogram of issue-to-completion latency */
+};
+
+/**
+ * @struct bio_batch
+ * @brief How many requests each invocation of an interrupt completed
+ */
+struct bio_batch {
+    __u64 irqs; /* Invocations that completed at least one request */
+    __u64 completions; /* Requests completed by those invocations */
+    __u32 slots[MAX_SLOTS]; /* log2 histogram of requests per invocation */
+};
+
+/**
+ * @struct idle_key
+ * @brief Interrupt handled first after leaving an idle state
+ */
+struct idle_key {
+    __u32 state; /* cpuidle state index the CPU left */
+    __u32 pad;
+    char name[IRQ_NAME_LEN]; /* Interrupt handler name */
+};
+
+/**
+ * @struct idle_info
+ * @brief Latency from idle exit to the first handler of one interrupt
+ */
+struct idle_info {
+    __u64 count; /* Idle exits followed by this interrupt */
+    __u64 lat_total; /* Summed exit-to-handler latency in the tool's unit */
+    __u32 slots[MAX_SLOTS]; /* log2 histogram of exit-to-handler latency */
+};
+
+#endif /* __HARDIRQS_H */
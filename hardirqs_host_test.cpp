@@ -0,0 +1,461 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file hardirqs_host_test.cpp
+ * @brief Checks of hardirqs' handler logic, run on the host
+ *
+ * Usage: hardirqs_host_test
+ *
+ * Drives handle_entry/handle_exit of hardirqs.bpf.c, compiled against the
+ * host shims in host/, with handlers of known names and durations, and
+ * checks what lands in the maps: log2 slotting, the combined-mode
+ * summary, the cgroup filter, irq_key naming, the per-CPU rollup, the
+ * inter-arrival histograms, rolling windows, storm detection, block
+ * completion and idle exit attribution.
+ * Needs no root; exits non-zero on the first failed case.
+ *
+ * Build:
+ *
+ *     cmake -S host -B build-host && cmake --build build-host
+ *     ctest --test-dir build-host
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <linux/types.h>
+#include "hardirqs.h"
+#include "host/bpf_host.h"
+#include "host/hardirqs_host.h"
+
+#define T0 1000000000ULL
+
+static int failures;
+
+#define CHECK(cond)                                                                         \
+    do {                                                                                    \
+        if (!(cond)) {                                                                      \
+            fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, __func__, \
+                    #cond);                                                                 \
+            failures++;                                                                     \
+        }                                                                                   \
+    } while (0)
+
+static void setup(const struct hardirqs_host_opts &opts)
+{
+    bpf_host_reset();
+    hardirqs_host_init(&opts);
+    bpf_host_set_current(1000, 1000);
+    bpf_host_set_cgroup(7);
+    bpf_host_set_cpu(0);
+    bpf_host_set_ktime(T0);
+}
+
+/* One handler invocation of @dur_ns, starting now; the clock ends past it */
+static void irq(int nr, const char *name, __u64 dur_ns)
+{
+    hardirqs_host_entry(nr, name);
+    bpf_host_set_ktime(bpf_host_ktime() + dur_ns);
+    hardirqs_host_exit(nr, name);
+    bpf_host_set_ktime(bpf_host_ktime() + 1000000);
+}
+
+static const struct info *info_of(const char *name)
+{
+    struct irq_key key = {};
+
+    strncpy(key.name, name, sizeof(key.name) - 1);
+    return (const struct info *)bpf_host_lookup("infos", &key);
+}
+
+static unsigned int nr_keys(const char *map, size_t key_size)
+{
+    char key[64], next[64];
+    unsigned int n = 0;
+
+    for (const void *prev = nullptr; !bpf_host_get_next_key(map, prev, next); prev = key) {
+        memcpy(key, next, key_size);
+        n++;
+    }
+    return n;
+}
+
+static void test_log2_slots(void)
+{
+    struct hardirqs_host_opts opts = {};
+    const struct info *i;
+
+    opts.targ_dist = true;
+    setup(opts);
+    /* In us: 0 and 1 share slot 0, then one slot per power of two */
+    irq(1, "eth0", 500);
+    irq(1, "eth0", 1000);
+    irq(1, "eth0", 2000);
+    irq(1, "eth0", 3999);
+    irq(1, "eth0", 4000);
+    irq(1, "eth0", 1023000);
+    irq(1, "eth0", 1024000);
+    /* Anything past the last slot is clamped into it */
+    irq(1, "eth0", 3600000000000ULL);
+
+    i = info_of("eth0");
+    CHECK(i);
+    if (!i)
+        return;
+    CHECK(i->slots[0] == 2);
+    CHECK(i->slots[1] == 2);
+    CHECK(i->slots[2] == 1);
+    CHECK(i->slots[9] == 1);
+    CHECK(i->slots[10] == 1);
+    CHECK(i->slots[MAX_SLOTS - 1] == 1);
+    CHECK(i->count == 0);
+
+    /* With -N the slots are in ns */
+    opts.targ_ns = true;
+    setup(opts);
+    irq(1, "eth0", 1000);
+    i = info_of("eth0");
+    CHECK(i && i->slots[9] == 1);
+}
+
+static void test_stats(void)
+{
+    struct hardirqs_host_opts opts = {};
+    const struct info *i;
+
+    opts.targ_stats = true;
+    setup(opts);
+    irq(3, "nvme0q1", 5000);
+    irq(3, "nvme0q1", 100000);
+    irq(3, "nvme0q1", 20000);
+    irq(4, "i8042", 7000);
+
+    i = info_of("nvme0q1");
+    CHECK(i);
+    if (!i)
+        return;
+    CHECK(i->count == 3);
+    CHECK(i->total == 125);
+    CHECK(i->min == 5);
+    CHECK(i->max == 100);
+    /* The histogram is kept next to the summary */
+    CHECK(i->slots[2] == 1);
+    CHECK(i->slots[4] == 1);
+    CHECK(i->slots[6] == 1);
+
+    i = info_of("i8042");
+    CHECK(i && i->count == 1 && i->min == 7 && i->max == 7 && i->total == 7);
+
+    /* Without -s or -d the count field sums the latencies */
+    setup({});
+    irq(3, "nvme0q1", 5000);
+    irq(3, "nvme0q1", 20000);
+    i = info_of("nvme0q1");
+    CHECK(i && i->count == 25 && i->slots[2] == 0);
+}
+
+static void test_cgroup_filter(void)
+{
+    struct hardirqs_host_opts opts = {};
+    __u32 key = 0, cg = 42;
+
+    opts.filter_cg = true;
+    opts.targ_stats = true;
+    setup(opts);
+    bpf_host_update("cgroup_map", &key, &cg, BPF_ANY);
+
+    bpf_host_set_cgroup(7);
+    irq(1, "eth0", 5000);
+    CHECK(!info_of("eth0"));
+
+    bpf_host_set_cgroup(42);
+    irq(1, "eth0", 6000);
+    CHECK(info_of("eth0") && info_of("eth0")->count == 1 && info_of("eth0")->total == 6);
+
+    /* An entry in another cgroup still times the handler that exits in ours */
+    bpf_host_set_cgroup(7);
+    hardirqs_host_entry(1, "eth0");
+    bpf_host_set_cgroup(42);
+    bpf_host_set_ktime(bpf_host_ktime() + 2000);
+    hardirqs_host_exit(1, "eth0");
+    CHECK(info_of("eth0")->count == 2 && info_of("eth0")->min == 2);
+
+    /* Counting mode filters on entry */
+    opts.do_count = true;
+    setup(opts);
+    bpf_host_update("cgroup_map", &key, &cg, BPF_ANY);
+    hardirqs_host_entry(1, "eth0");
+    bpf_host_set_cgroup(42);
+    hardirqs_host_entry(1, "eth0");
+    hardirqs_host_entry(1, "eth0");
+    CHECK(info_of("eth0") && info_of("eth0")->count == 2);
+}
+
+static void test_irq_key(void)
+{
+    static const char long_name[] = "a-handler-name-that-is-longer-than-irq-key";
+    struct hardirqs_host_opts opts = {};
+    struct irq_key key = {};
+    const struct info *i;
+
+    opts.do_count = true;
+    setup(opts);
+    hardirqs_host_entry(1, "eth0");
+    hardirqs_host_entry(2, "eth0");
+    hardirqs_host_entry(3, "eth0-tx");
+    hardirqs_host_entry(4, long_name);
+
+    /* Keyed by name only: lines sharing a handler name share an entry */
+    CHECK(nr_keys("infos", sizeof(key)) == 3);
+    CHECK(info_of("eth0") && info_of("eth0")->count == 2);
+    CHECK(info_of("eth0-tx") && info_of("eth0-tx")->count == 1);
+
+    /* Long names are cut to IRQ_NAME_LEN - 1 and NUL-terminated */
+    memcpy(key.name, long_name, sizeof(key.name) - 1);
+    i = (const struct info *)bpf_host_lookup("infos", &key);
+    CHECK(i && i->count == 1);
+}
+
+static void test_rollup(void)
+{
+    struct hardirqs_host_opts opts = {};
+    const struct info *i;
+
+    opts.targ_stats = true;
+    opts.rollup_ns = 100000000;
+    opts.nr_cpus = 2;
+    setup(opts);
+    CHECK(hardirqs_host_start_rollup() == 0);
+
+    irq(1, "eth0", 5000);
+    bpf_host_set_cpu(1);
+    irq(1, "eth0", 9000);
+    irq(1, "eth0", 3000);
+    CHECK(!info_of("eth0"));
+
+    bpf_host_set_ktime(T0 + opts.rollup_ns);
+    CHECK(bpf_host_run_timers() == 1);
+    i = info_of("eth0");
+    CHECK(i && i->count == 3 && i->total == 17 && i->min == 3 && i->max == 9);
+
+    /* Drained per-CPU slots fold nothing twice, and the timer re-armed */
+    bpf_host_set_ktime(T0 + 2 * opts.rollup_ns);
+    CHECK(bpf_host_run_timers() == 1);
+    i = info_of("eth0");
+    CHECK(i && i->count == 3 && i->total == 17);
+}
+
+static void test_gaps(void)
+{
+    struct hardirqs_host_opts opts = {};
+    const struct gap_hist *gh;
+    __u32 irq = 5;
+
+    opts.targ_gaps = true;
+    setup(opts);
+    /* Entries every 3ms on CPU 0, the element is created there */
+    for (int n = 0; n < 3; n++) {
+        hardirqs_host_entry(irq, "eth0");
+        bpf_host_set_ktime(bpf_host_ktime() + 3000000);
+    }
+    /* CPU 1's copy was zeroed by that insert: its first entry only starts the clock */
+    bpf_host_set_cpu(1);
+    hardirqs_host_entry(irq, "eth0");
+    bpf_host_set_ktime(bpf_host_ktime() + 100000);
+    hardirqs_host_entry(irq, "eth0");
+
+    gh = (const struct gap_hist *)bpf_host_lookup_cpu("gaps", &irq, 0);
+    CHECK(gh && !strcmp(gh->name, "eth0"));
+    CHECK(gh && gh->slots[11] == 2);
+
+    gh = (const struct gap_hist *)bpf_host_lookup_cpu("gaps", &irq, 1);
+    CHECK(gh && !strcmp(gh->name, "eth0"));
+    CHECK(gh && gh->slots[6] == 1 && gh->slots[MAX_SLOTS - 1] == 0);
+    for (int i = 0; gh && i < MAX_SLOTS; i++)
+        CHECK(i == 6 || !gh->slots[i]);
+}
+
+static void test_windows(void)
+{
+    struct hardirqs_host_opts opts = {};
+    const struct irq_windows *iw;
+    struct irq_key key = {};
+
+    opts.window_ns = 1000000000;
+    setup(opts);
+    /* T0 is window 1 */
+    irq(1, "eth0", 5000);
+    irq(1, "eth0", 6000);
+    bpf_host_set_ktime(2 * opts.window_ns);
+    irq(1, "eth0", 100000);
+
+    strcpy(key.name, "eth0");
+    iw = (const struct irq_windows *)bpf_host_lookup("windows", &key);
+    CHECK(iw);
+    if (!iw)
+        return;
+    CHECK(iw->w[1].epoch == 1 && iw->w[1].slots[2] == 2);
+    CHECK(iw->w[2].epoch == 2 && iw->w[2].slots[6] == 1);
+
+    /* NR_WINDOWS later the slot is recycled, not added to */
+    bpf_host_set_ktime((1 + NR_WINDOWS) * opts.window_ns);
+    irq(1, "eth0", 5000);
+    CHECK(iw->w[1].epoch == 1 + NR_WINDOWS && iw->w[1].slots[2] == 1);
+    CHECK(iw->w[2].epoch == 2 && iw->w[2].slots[6] == 1);
+}
+
+static int save_storm(void *ctx, void *data, size_t size)
+{
+    auto *events = (std::vector<struct storm_event> *)ctx;
+
+    if (size == sizeof(struct storm_event))
+        events->push_back(*(const struct storm_event *)data);
+    return 0;
+}
+
+static void test_storms(void)
+{
+    struct hardirqs_host_opts opts = {};
+    std::vector<struct storm_event> events;
+
+    /* A storm is 1000 irq/s or more, or handlers averaging 50us or more */
+    opts.storm_gap_ns = 1000000;
+    opts.storm_lat = 50;
+    setup(opts);
+    bpf_host_set_cpu(2);
+
+    /* 10000 irq/s: the first gap seeds the average and raises the flag */
+    hardirqs_host_entry(9, "eth0");
+    bpf_host_set_ktime(bpf_host_ktime() + 100000);
+    hardirqs_host_entry(9, "eth0");
+    bpf_host_ringbuf_consume("storms", save_storm, &events);
+    CHECK(events.size() == 1);
+    if (events.size() == 1) {
+        const struct storm_event &e = events[0];
+
+        CHECK(e.flags == STORM_F_RATE && e.prev_flags == 0);
+        CHECK(e.irq == 9 && e.cpu == 2 && !strcmp(e.name, "eth0"));
+        CHECK(e.rate == 10000);
+    }
+
+    /* 10 irq/s: cleared once the average is past twice the threshold, not before */
+    events.clear();
+    for (int n = 0; n < 3; n++) {
+        bpf_host_set_ktime(bpf_host_ktime() + 100000000);
+        hardirqs_host_entry(9, "eth0");
+    }
+    bpf_host_ringbuf_consume("storms", save_storm, &events);
+    CHECK(events.size() == 1 && events[0].flags == 0 && events[0].prev_flags == STORM_F_RATE);
+
+    /* A 200us handler raises the latency flag, without a new rate storm */
+    events.clear();
+    bpf_host_set_ktime(bpf_host_ktime() + 100000000);
+    irq(9, "eth0", 200000);
+    bpf_host_ringbuf_consume("storms", save_storm, &events);
+    CHECK(events.size() == 1 && events[0].flags == STORM_F_LATENCY && events[0].latency == 200);
+}
+
+static void test_bio(void)
+{
+    struct hardirqs_host_opts opts = {};
+    struct hardirqs_host_rq *rq[3];
+    const struct bio_batch *batch;
+    const struct bio_info *info;
+    struct irq_key ikey = {};
+    struct bio_key bkey = {};
+
+    opts.targ_bio = true;
+    setup(opts);
+    for (auto &r : rq)
+        r = hardirqs_host_rq_new(259, 1);
+
+    for (auto &r : rq)
+        hardirqs_host_rq_issue(r);
+    bpf_host_set_ktime(bpf_host_ktime() + 40000);
+
+    /* Two completions inside one handler, one outside any */
+    hardirqs_host_entry(30, "nvme0q1");
+    hardirqs_host_rq_complete(rq[0], 4096);
+    hardirqs_host_rq_complete(rq[1], 8192);
+    hardirqs_host_exit(30, "nvme0q1");
+    hardirqs_host_rq_complete(rq[2], 512);
+    /* Not issued while traced: no latency to account */
+    hardirqs_host_rq_complete(rq[0], 4096);
+
+    bkey.dev = 259 << MINORBITS | 1;
+    strcpy(bkey.name, "nvme0q1");
+    info = (const struct bio_info *)bpf_host_lookup("bio_infos", &bkey);
+    CHECK(info && info->count == 2 && info->bytes == 12288 && info->lat_total == 80);
+    CHECK(info && info->slots[5] == 2);
+
+    memset(bkey.name, 0, sizeof(bkey.name));
+    strcpy(bkey.name, BIO_NO_IRQ);
+    info = (const struct bio_info *)bpf_host_lookup("bio_infos", &bkey);
+    CHECK(info && info->count == 1 && info->bytes == 512);
+
+    strcpy(ikey.name, "nvme0q1");
+    batch = (const struct bio_batch *)bpf_host_lookup("bio_batches", &ikey);
+    CHECK(batch && batch->irqs == 1 && batch->completions == 2 && batch->slots[1] == 1);
+    CHECK(nr_keys("bio_start", sizeof(__u64)) == 0);
+
+    for (auto &r : rq)
+        hardirqs_host_rq_free(r);
+}
+
+static void test_idle(void)
+{
+    struct hardirqs_host_opts opts = {};
+    const struct idle_info *info;
+    struct idle_key key = {};
+    __u32 state = 2;
+    const __u64 *cnt;
+
+    opts.targ_idle = true;
+    setup(opts);
+    /* Idle since before attach: the state is unknown, nothing is charged */
+    hardirqs_host_cpu_idle((unsigned int)-1);
+    irq(1, "eth0", 1000);
+
+    hardirqs_host_cpu_idle(state);
+    bpf_host_set_ktime(bpf_host_ktime() + 1000000);
+    hardirqs_host_cpu_idle((unsigned int)-1);
+    bpf_host_set_ktime(bpf_host_ktime() + 30000);
+    /* Only the first handler after the exit is charged */
+    irq(1, "eth0", 1000);
+    irq(1, "eth0", 1000);
+
+    key.state = state;
+    strcpy(key.name, "eth0");
+    info = (const struct idle_info *)bpf_host_lookup("idle_infos", &key);
+    CHECK(info && info->count == 1 && info->lat_total == 30 && info->slots[4] == 1);
+    CHECK(nr_keys("idle_infos", sizeof(key)) == 1);
+    cnt = (const __u64 *)bpf_host_lookup("idle_counts", &state);
+    CHECK(cnt && *cnt == 1);
+
+    /* Going idle again drops an exit no handler followed */
+    hardirqs_host_cpu_idle(state);
+    hardirqs_host_cpu_idle((unsigned int)-1);
+    hardirqs_host_cpu_idle(state);
+    irq(1, "eth0", 1000);
+    CHECK(info && info->count == 1);
+}
+
+int main(void)
+{
+    test_log2_slots();
+    test_stats();
+    test_cgroup_filter();
+    test_irq_key();
+    test_rollup();
+    test_gaps();
+    test_windows();
+    test_storms();
+    test_bio();
+    test_idle();
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __BPF_HOST_BITS_BPF_H
+#define __BPF_HOST_BITS_BPF_H
+
+/**
+ * @file bits.bpf.h
+ * @brief Host stand-in for libbpf-tools' bits.bpf.h
+ *
+ * Same branch-free log2 as the BPF side, so histogram slots match. Both
+ * names are libm builtins for a host compiler, hence the renames.
+ */
+
+#define log2 bpf_host_log2
+#define log2l bpf_host_log2l
+
+static __always_inline u64 log2(u32 v)
+{
+    u32 shift, r;
+
+    r = (v > 0xFFFF) << 4;
+    v >>= r;
+    shift = (v > 0xFF) << 3;
+    v >>= shift;
+    r |= shift;
+    shift = (v > 0xF) << 2;
+    v >>= shift;
+    r |= shift;
+    shift = (v > 0x3) << 1;
+    v >>= shift;
+    r |= shift;
+    r |= (v >> 1);
+    return r;
+}
+
+static __always_inline u64 log2l(u64 v)
+{
+    u32 hi = v >> 32;
+
+    if (hi)
+        return log2(hi) + 32;
+    return log2(v);
+}
+
+#endif /* __BPF_HOST_BITS_BPF_H */
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __BPF_HOST_CORE_READ_H
+#define __BPF_HOST_CORE_READ_H
+
+/**
+ * @file bpf_core_read.h
+ * @brief Host stand-in for libbpf's <bpf/bpf_core_read.h>
+ *
+ * There is no relocation on the host: the local preserve_access_index
+ * declarations are the layout, and reads are plain dereferences of objects
+ * the caller built with them. Chains of up to four members are supported.
+ */
+
+#include <string.h>
+
+#define ___host_core_nth(_1, _2, _3, _4, _5, N, ...) N
+#define ___host_core_read1(s, a) ((s)->a)
+#define ___host_core_read2(s, a, b) ((s)->a->b)
+#define ___host_core_read3(s, a, b, c) ((s)->a->b->c)
+#define ___host_core_read4(s, a, b, c, d) ((s)->a->b->c->d)
+
+#define BPF_CORE_READ(...)                                                                  \
+    ___host_core_nth(__VA_ARGS__, ___host_core_read4, ___host_core_read3,                   \
+                     ___host_core_read2, ___host_core_read1, _)(__VA_ARGS__)
+
+#define BPF_CORE_READ_BITFIELD(s, field) ((s)->field)
+#define BPF_CORE_READ_BITFIELD_PROBED(s, field) ((s)->field)
+
+#define bpf_core_read(dst, sz, src) bpf_probe_read_kernel(dst, sz, src)
+#define bpf_core_field_exists(field) 1
+
+#endif /* __BPF_HOST_CORE_READ_H */
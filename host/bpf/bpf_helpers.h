@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __BPF_HOST_HELPERS_H
+#define __BPF_HOST_HELPERS_H
+
+/**
+ * @file bpf_helpers.h
+ * @brief Host stand-in for libbpf's <bpf/bpf_helpers.h>
+ *
+ * Map definitions keep libbpf's layout, so that BPF_HOST_MAP() can read the
+ * sizes back out of the member types; sections and licenses are dropped.
+ */
+
+#include "../bpf_host.h"
+
+#define __uint(name, val) int (*name)[val]
+#define __type(name, val) typeof(val) *name
+#define __array(name, val) typeof(val) *name[]
+
+#define SEC(name)
+
+#ifndef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#endif
+
+#define bpf_printk(fmt, ...)                                                                \
+    ({                                                                                      \
+        static const char ____fmt[] = fmt;                                                  \
+        bpf_trace_printk(____fmt, sizeof(____fmt), ##__VA_ARGS__);                          \
+    })
+
+#endif /* __BPF_HOST_HELPERS_H */
@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __BPF_HOST_TRACING_H
+#define __BPF_HOST_TRACING_H
+
+/**
+ * @file bpf_tracing.h
+ * @brief Host stand-in for libbpf's <bpf/bpf_tracing.h>
+ *
+ * BPF_PROG() programs become plain functions taking their typed arguments,
+ * which the host caller passes directly instead of through a u64 context.
+ * The context pointer is kept first, for bodies that hand ctx on to helpers
+ * such as bpf_get_stackid(); the host caller may pass NULL.
+ */
+
+#define BPF_PROG(name, ...) name(void *ctx, ##__VA_ARGS__)
+
+#endif /* __BPF_HOST_TRACING_H */
@@ -0,0 +1,662 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file bpf_host.cpp
+ * @brief Userspace emulation of the BPF maps and helpers used by the tools
+ *
+ * Single-threaded by design: the "current CPU" is a variable, not a thread,
+ * and timers fire when bpf_host_run_timers() is called, not on their own.
+ */
+
+#define BPF_HOST_IMPL
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "bpf_host.h"
+
+namespace {
+
+struct ring_record {
+    std::unique_ptr<char[]> data;
+    size_t size;
+    size_t footprint; /* Size with the 8-byte header, rounded up to 8 */
+    bool committed;
+    bool discarded;
+};
+
+struct hash_elem {
+    std::unique_ptr<char[]> data;
+    __u64 used; /* Last access, for LRU eviction */
+};
+
+struct host_map {
+    std::string name;
+    __u32 type;
+    __u32 key_size;
+    __u32 value_size;
+    __u32 max_entries;
+    /* Arrays, entry-major: (index * ncpus + cpu) * value_size */
+    std::vector<char> array;
+    /* Hashes, ordered by key bytes so iteration is reproducible */
+    std::map<std::string, hash_elem> hash;
+    /* RINGBUF */
+    std::deque<ring_record> ring;
+    size_t ring_used;
+
+    bool percpu() const
+    {
+        return type == BPF_MAP_TYPE_PERCPU_ARRAY || type == BPF_MAP_TYPE_PERCPU_HASH ||
+               type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+    }
+    bool is_array() const
+    {
+        return type == BPF_MAP_TYPE_ARRAY || type == BPF_MAP_TYPE_PERCPU_ARRAY ||
+               type == BPF_MAP_TYPE_CGROUP_ARRAY;
+    }
+    /* STACK_TRACE is kept as an always empty hash */
+    bool is_hash() const
+    {
+        return type == BPF_MAP_TYPE_HASH || type == BPF_MAP_TYPE_PERCPU_HASH || lru() ||
+               type == BPF_MAP_TYPE_STACK_TRACE;
+    }
+    bool lru() const
+    {
+        return type == BPF_MAP_TYPE_LRU_HASH || type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+    }
+    size_t ncpus() const { return percpu() ? BPF_HOST_MAX_CPUS : 1; }
+};
+
+struct host_timer {
+    host_map *map;
+    void *map_def; /* SEC(".maps") variable, passed to the callback */
+    __u32 key;
+    void *value;
+    void *callback;
+    __u64 expires;
+    bool armed;
+};
+
+struct host_state {
+    std::unordered_map<void *, std::unique_ptr<host_map>> by_addr;
+    std::unordered_map<std::string, host_map *> by_name;
+    /* Reserved ring buffer record -> its map */
+    std::unordered_map<void *, host_map *> reserved;
+    /* Initialized bpf_timers by address, ordered so they fire reproducibly */
+    std::map<void *, host_timer> timers;
+    __u32 pid, tgid;
+    void *task;
+    __u64 cgroup;
+    char comm[16];
+    __u64 pidns_dev, pidns_ino;
+    __u32 ns_pid, ns_tgid;
+    bool pidns;
+    __u32 cpu;
+    __u64 ktime;
+    __u64 printk_count;
+    __u64 tick; /* Map accesses, the LRU clock */
+};
+
+host_state state;
+
+host_map *find(void *map)
+{
+    auto it = state.by_addr.find(map);
+
+    return it == state.by_addr.end() ? nullptr : it->second.get();
+}
+
+host_map *find(const char *name)
+{
+    auto it = state.by_name.find(name);
+
+    return it == state.by_name.end() ? nullptr : it->second;
+}
+
+/* @cpu selects the copy of per-CPU maps and is ignored for shared ones */
+void *lookup(host_map *m, const void *key, __u32 cpu)
+{
+    if (!m || !key)
+        return nullptr;
+    if (!m->percpu())
+        cpu = 0;
+    else if (cpu >= m->ncpus())
+        return nullptr;
+    if (m->is_array()) {
+        __u32 idx = *(const __u32 *)key;
+
+        if (idx >= m->max_entries)
+            return nullptr;
+        return &m->array[((size_t)idx * m->ncpus() + cpu) * m->value_size];
+    }
+    if (m->is_hash()) {
+        auto it = m->hash.find(std::string((const char *)key, m->key_size));
+
+        if (it == m->hash.end())
+            return nullptr;
+        it->second.used = ++state.tick;
+        return it->second.data.get() + (size_t)cpu * m->value_size;
+    }
+    return nullptr;
+}
+
+/* Make room in a full LRU map by dropping its least recently used element */
+void lru_evict(host_map *m)
+{
+    auto victim = m->hash.begin();
+
+    for (auto it = m->hash.begin(); it != m->hash.end(); ++it)
+        if (it->second.used < victim->second.used)
+            victim = it;
+    if (victim != m->hash.end())
+        m->hash.erase(victim);
+}
+
+int update(host_map *m, const void *key, const void *value, __u64 flags)
+{
+    void *cur;
+
+    if (!m)
+        return -ENOENT;
+    if (flags > BPF_EXIST)
+        return -EINVAL;
+    cur = lookup(m, key, state.cpu);
+
+    if (m->is_array()) {
+        if (!cur)
+            return -E2BIG;
+        if (flags == BPF_NOEXIST)
+            return -EEXIST;
+        memcpy(cur, value, m->value_size);
+        return 0;
+    }
+    if (!m->is_hash() || m->type == BPF_MAP_TYPE_STACK_TRACE)
+        return -EINVAL;
+    if (cur && flags == BPF_NOEXIST)
+        return -EEXIST;
+    if (!cur && flags == BPF_EXIST)
+        return -ENOENT;
+    if (!cur) {
+        size_t size = m->ncpus() * m->value_size;
+
+        if (m->hash.size() >= m->max_entries) {
+            if (!m->lru())
+                return -E2BIG;
+            lru_evict(m);
+        }
+        /* New per-CPU elements start zeroed on the other CPUs */
+        auto &elem = m->hash[std::string((const char *)key, m->key_size)];
+        elem.data.reset(new char[size]());
+        elem.used = ++state.tick;
+        cur = elem.data.get() + (m->percpu() ? (size_t)state.cpu * m->value_size : 0);
+    }
+    memcpy(cur, value, m->value_size);
+    return 0;
+}
+
+int remove(host_map *m, const void *key)
+{
+    if (!m)
+        return -ENOENT;
+    if (!m->is_hash())
+        return -EINVAL;
+    return m->hash.erase(std::string((const char *)key, m->key_size)) ? 0 : -ENOENT;
+}
+
+} // namespace
+
+extern "C" {
+
+void bpf_host_map_register(const char *name, void *map, __u32 type, __u32 key_size,
+                           __u32 value_size, __u32 max_entries)
+{
+    std::unique_ptr<host_map> m(new host_map());
+
+    m->name = name;
+    m->type = type;
+    m->key_size = key_size;
+    m->value_size = value_size;
+    m->max_entries = max_entries;
+    m->ring_used = 0;
+    if (m->is_array())
+        m->array.assign((size_t)max_entries * m->ncpus() * value_size, 0);
+
+    for (auto it = state.reserved.begin(); it != state.reserved.end();) {
+        if (it->second == find(map))
+            it = state.reserved.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = state.timers.begin(); it != state.timers.end();) {
+        if (it->second.map == find(map))
+            it = state.timers.erase(it);
+        else
+            ++it;
+    }
+    state.by_name[name] = m.get();
+    state.by_addr[map] = std::move(m);
+}
+
+void bpf_host_reset(void)
+{
+    state = host_state();
+}
+
+void bpf_host_set_current(__u32 pid, __u32 tgid)
+{
+    state.pid = pid;
+    state.tgid = tgid;
+}
+
+void bpf_host_set_task(void *task)
+{
+    state.task = task;
+}
+
+void bpf_host_set_cgroup(__u64 cgroup_id)
+{
+    state.cgroup = cgroup_id;
+}
+
+void bpf_host_set_comm(const char *comm)
+{
+    strncpy(state.comm, comm, sizeof(state.comm) - 1);
+    state.comm[sizeof(state.comm) - 1] = '\0';
+}
+
+void bpf_host_set_pidns(__u64 dev, __u64 ino, __u32 pid, __u32 tgid)
+{
+    state.pidns = true;
+    state.pidns_dev = dev;
+    state.pidns_ino = ino;
+    state.ns_pid = pid;
+    state.ns_tgid = tgid;
+}
+
+void bpf_host_set_cpu(__u32 cpu)
+{
+    state.cpu = cpu < BPF_HOST_MAX_CPUS ? cpu : BPF_HOST_MAX_CPUS - 1;
+}
+
+void bpf_host_set_ktime(__u64 ns)
+{
+    state.ktime = ns;
+}
+
+__u64 bpf_host_ktime(void)
+{
+    return state.ktime;
+}
+
+void *bpf_host_lookup(const char *name, const void *key)
+{
+    return lookup(find(name), key, state.cpu);
+}
+
+void *bpf_host_lookup_cpu(const char *name, const void *key, __u32 cpu)
+{
+    return lookup(find(name), key, cpu);
+}
+
+int bpf_host_update(const char *name, const void *key, const void *value, __u64 flags)
+{
+    return update(find(name), key, value, flags);
+}
+
+int bpf_host_delete(const char *name, const void *key)
+{
+    return remove(find(name), key);
+}
+
+int bpf_host_get_next_key(const char *name, const void *key, void *next_key)
+{
+    host_map *m = find(name);
+
+    if (!m)
+        return -ENOENT;
+    if (m->is_array()) {
+        __u32 next = key ? *(const __u32 *)key + 1 : 0;
+
+        if (next >= m->max_entries)
+            return -ENOENT;
+        *(__u32 *)next_key = next;
+        return 0;
+    }
+
+    /* Like the kernel, a missing key restarts from the first one */
+    auto it = m->hash.begin();
+    if (key) {
+        auto cur = m->hash.find(std::string((const char *)key, m->key_size));
+
+        if (cur != m->hash.end())
+            it = std::next(cur);
+    }
+    if (it == m->hash.end())
+        return -ENOENT;
+    memcpy(next_key, it->first.data(), m->key_size);
+    return 0;
+}
+
+int bpf_host_ringbuf_consume(const char *name, int (*cb)(void *ctx, void *data, size_t size),
+                             void *ctx)
+{
+    host_map *m = find(name);
+    int n = 0;
+
+    if (!m || m->type != BPF_MAP_TYPE_RINGBUF)
+        return -ENOENT;
+    /* Stop at the first record still reserved, as the real consumer does */
+    while (!m->ring.empty() && m->ring.front().committed) {
+        ring_record rec = std::move(m->ring.front());
+
+        m->ring.pop_front();
+        m->ring_used -= rec.footprint;
+        if (rec.discarded)
+            continue;
+        n++;
+        if (cb && cb(ctx, rec.data.get(), rec.size))
+            break;
+    }
+    return n;
+}
+
+int bpf_host_run_timers(void)
+{
+    std::vector<host_timer *> due;
+
+    for (auto &t : state.timers)
+        if (t.second.armed && t.second.expires <= state.ktime)
+            due.push_back(&t.second);
+    for (host_timer *t : due) {
+        __u32 key = t->key;
+
+        t->armed = false;
+        reinterpret_cast<long (*)(void *, void *, void *)>(t->callback)(t->map_def, &key,
+                                                                        t->value);
+    }
+    return due.size();
+}
+
+__u64 bpf_host_printk_count(void)
+{
+    return state.printk_count;
+}
+
+void *bpf_map_lookup_elem(void *map, const void *key)
+{
+    return lookup(find(map), key, state.cpu);
+}
+
+long bpf_map_update_elem(void *map, const void *key, const void *value, __u64 flags)
+{
+    return update(find(map), key, value, flags);
+}
+
+long bpf_map_delete_elem(void *map, const void *key)
+{
+    return remove(find(map), key);
+}
+
+void *bpf_map_lookup_percpu_elem(void *map, const void *key, __u32 cpu)
+{
+    host_map *m = find(map);
+
+    if (!m || !m->percpu())
+        return nullptr;
+    return lookup(m, key, cpu);
+}
+
+long bpf_for_each_map_elem(void *map, void *callback_fn, void *callback_ctx, __u64 flags)
+{
+    auto cb = reinterpret_cast<long (*)(void *, void *, void *, void *)>(callback_fn);
+    host_map *m = find(map);
+    long n = 0;
+
+    if (!m || flags)
+        return -EINVAL;
+    if (m->is_array()) {
+        for (__u32 i = 0; i < m->max_entries; i++) {
+            n++;
+            if (cb(map, &i, lookup(m, &i, state.cpu), callback_ctx))
+                break;
+        }
+        return n;
+    }
+
+    /* The callback may delete elements, walk a snapshot of the keys */
+    std::vector<std::string> keys;
+    for (const auto &e : m->hash)
+        keys.push_back(e.first);
+    for (auto &k : keys) {
+        void *value = lookup(m, k.data(), state.cpu);
+
+        if (!value)
+            continue;
+        n++;
+        if (cb(map, &k[0], value, callback_ctx))
+            break;
+    }
+    return n;
+}
+
+long bpf_loop(__u32 nr_loops, void *callback_fn, void *callback_ctx, __u64 flags)
+{
+    auto cb = reinterpret_cast<long (*)(__u32, void *)>(callback_fn);
+
+    if (flags)
+        return -EINVAL;
+    if (nr_loops > 1 << 23)
+        return -E2BIG;
+    for (__u32 i = 0; i < nr_loops; i++)
+        if (cb(i, callback_ctx))
+            return i + 1;
+    return nr_loops;
+}
+
+__u64 bpf_get_current_pid_tgid(void)
+{
+    return (__u64)state.tgid << 32 | state.pid;
+}
+
+__u64 bpf_get_current_cgroup_id(void)
+{
+    return state.cgroup;
+}
+
+__u64 bpf_get_current_task(void)
+{
+    return (__u64)state.task;
+}
+
+long bpf_get_current_comm(void *buf, __u32 size_of_buf)
+{
+    if (!size_of_buf)
+        return -EINVAL;
+    strncpy((char *)buf, state.comm, size_of_buf - 1);
+    ((char *)buf)[size_of_buf - 1] = '\0';
+    return 0;
+}
+
+long bpf_current_task_under_cgroup(void *map, __u32 index)
+{
+    host_map *m = find(map);
+    __u32 *id;
+
+    if (!m || m->type != BPF_MAP_TYPE_CGROUP_ARRAY)
+        return -EINVAL;
+    id = (__u32 *)lookup(m, &index, 0);
+    if (!id)
+        return -E2BIG;
+    if (!*id)
+        return -EAGAIN;
+    return *id == (__u32)state.cgroup;
+}
+
+/* There is no stack to walk on the host */
+long bpf_get_stackid(void *ctx, void *map, __u64 flags)
+{
+    return -EFAULT;
+}
+
+long bpf_get_ns_current_pid_tgid(__u64 dev, __u64 ino, struct bpf_pidns_info *nsdata,
+                                 __u32 size)
+{
+    if (size != sizeof(*nsdata) || !state.pidns || dev != state.pidns_dev ||
+        ino != state.pidns_ino) {
+        memset(nsdata, 0, size);
+        return -EINVAL;
+    }
+    nsdata->pid = state.ns_pid;
+    nsdata->tgid = state.ns_tgid;
+    return 0;
+}
+
+__u32 bpf_get_smp_processor_id(void)
+{
+    return state.cpu;
+}
+
+__u64 bpf_ktime_get_ns(void)
+{
+    return state.ktime;
+}
+
+void *bpf_ringbuf_reserve(void *ringbuf, __u64 size, __u64 flags)
+{
+    host_map *m = find(ringbuf);
+    ring_record rec;
+    void *data;
+
+    if (!m || m->type != BPF_MAP_TYPE_RINGBUF || flags)
+        return nullptr;
+    rec.footprint = (size + 8 + 7) & ~(size_t)7;
+    if (m->ring_used + rec.footprint > m->max_entries)
+        return nullptr;
+    rec.data.reset(new char[size]());
+    rec.size = size;
+    rec.committed = false;
+    rec.discarded = false;
+    data = rec.data.get();
+    m->ring_used += rec.footprint;
+    m->ring.push_back(std::move(rec));
+    state.reserved[data] = m;
+    return data;
+}
+
+static void ringbuf_commit(void *data, bool discard)
+{
+    auto it = state.reserved.find(data);
+
+    if (it == state.reserved.end())
+        return;
+    /* Records are mostly committed in reservation order, search from the back */
+    for (auto rec = it->second->ring.rbegin(); rec != it->second->ring.rend(); ++rec) {
+        if (rec->data.get() == data) {
+            rec->committed = true;
+            rec->discarded = discard;
+            break;
+        }
+    }
+    state.reserved.erase(it);
+}
+
+void bpf_ringbuf_submit(void *data, __u64 flags)
+{
+    ringbuf_commit(data, false);
+}
+
+void bpf_ringbuf_discard(void *data, __u64 flags)
+{
+    ringbuf_commit(data, true);
+}
+
+long bpf_probe_read_kernel(void *dst, __u32 size, const void *unsafe_ptr)
+{
+    if (!unsafe_ptr) {
+        memset(dst, 0, size);
+        return -EFAULT;
+    }
+    memcpy(dst, unsafe_ptr, size);
+    return 0;
+}
+
+long bpf_probe_read_kernel_str(void *dst, __u32 size, const void *unsafe_ptr)
+{
+    size_t len;
+
+    if (!size)
+        return -EINVAL;
+    if (!unsafe_ptr) {
+        memset(dst, 0, size);
+        return -EFAULT;
+    }
+    len = strnlen((const char *)unsafe_ptr, size - 1);
+    memcpy(dst, unsafe_ptr, len);
+    ((char *)dst)[len] = '\0';
+    return len + 1;
+}
+
+long bpf_timer_init(struct bpf_timer *timer, void *map, __u64 flags)
+{
+    host_map *m = find(map);
+    char *p = (char *)timer;
+    size_t off;
+
+    /* @flags is the clock, all of them read the emulated one */
+    if (!m || !m->is_array() || m->percpu() ||
+        (flags != CLOCK_MONOTONIC && flags != CLOCK_REALTIME && flags != CLOCK_BOOTTIME))
+        return -EINVAL;
+    /* The timer must live in a value of @map, which is what the callback gets */
+    if (m->array.empty() || p < m->array.data() || p >= m->array.data() + m->array.size())
+        return -EINVAL;
+    if (state.timers.count(timer))
+        return -EBUSY;
+    off = p - m->array.data();
+    state.timers[timer] = { m, map, (__u32)(off / m->value_size),
+                            m->array.data() + off / m->value_size * m->value_size,
+                            nullptr, 0, false };
+    return 0;
+}
+
+long bpf_timer_set_callback(struct bpf_timer *timer, void *callback_fn)
+{
+    auto it = state.timers.find(timer);
+
+    if (it == state.timers.end())
+        return -EINVAL;
+    it->second.callback = callback_fn;
+    return 0;
+}
+
+/* Only relative expiry times, as with flags 0 in the kernel */
+long bpf_timer_start(struct bpf_timer *timer, __u64 nsecs, __u64 flags)
+{
+    auto it = state.timers.find(timer);
+
+    if (it == state.timers.end() || !it->second.callback || flags)
+        return -EINVAL;
+    it->second.expires = state.ktime + nsecs;
+    it->second.armed = true;
+    return 0;
+}
+
+long bpf_trace_printk(const char *fmt, __u32 fmt_size, ...)
+{
+    char buf[512];
+    va_list args;
+    int len;
+
+    va_start(args, fmt_size);
+    len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    state.printk_count++;
+    return len;
+}
+
+} // extern "C"
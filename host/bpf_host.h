@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __BPF_HOST_H
+#define __BPF_HOST_H
+
+/**
+ * @file bpf_host.h
+ * @brief Userspace emulation of the BPF maps and helpers used by the tools
+ *
+ * BPF C sources are compiled for the host with -Ihost ahead of the libbpf
+ * headers, so <bpf/bpf_helpers.h> and friends resolve to the shims next to
+ * this file and every helper lands here. Maps are emulated by type
+ * (ARRAY, HASH, their PERCPU and LRU variants, CGROUP_ARRAY and RINGBUF;
+ * STACK_TRACE is accepted but stays empty) and must be registered with
+ * BPF_HOST_MAP() before the first program runs; the "current task", CPU
+ * and clock are whatever the caller set last, which makes runs
+ * deterministic. bpf_timer callbacks only run from bpf_host_run_timers().
+ * Nothing here needs root or a BPF-capable kernel.
+ *
+ * The C++ side (benchmarks, harnesses) reaches the same maps by name.
+ */
+
+#include <stddef.h>
+#include <linux/bpf.h>
+#include <linux/types.h>
+
+/*
+ * No relocation on the host: local preserve_access_index types are the
+ * layout, so the attribute, which only clang knows, is dropped
+ */
+#define preserve_access_index
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Upper bound of bpf_host_set_cpu(), sizes the per-CPU map storage */
+#define BPF_HOST_MAX_CPUS 64
+
+/**
+ * bpf_host_map_register - Attach emulated storage to a map definition
+ * @name: Map name, for lookups from the C++ side
+ * @map: Address of the SEC(".maps") variable
+ * @type: BPF_MAP_TYPE_*
+ * @key_size: Key size, 0 for RINGBUF
+ * @value_size: Value size, 0 for RINGBUF
+ * @max_entries: Entries, or ring size in bytes for RINGBUF
+ *
+ * Registering a map again empties it.
+ */
+void bpf_host_map_register(const char *name, void *map, __u32 type, __u32 key_size,
+                           __u32 value_size, __u32 max_entries);
+
+/* Sizes are recovered from the __uint()/__type() members of the definition */
+#define BPF_HOST_MAP(m)                                                                     \
+    bpf_host_map_register(#m, &(m), sizeof(*(m).type) / sizeof(int), sizeof(*(m).key),     \
+                          sizeof(*(m).value), sizeof(*(m).max_entries) / sizeof(int))
+/* Maps declared with __uint(key_size)/__uint(value_size), such as STACK_TRACE */
+#define BPF_HOST_MAP_SIZED(m)                                                               \
+    bpf_host_map_register(#m, &(m), sizeof(*(m).type) / sizeof(int),                        \
+                          sizeof(*(m).key_size) / sizeof(int),                              \
+                          sizeof(*(m).value_size) / sizeof(int),                            \
+                          sizeof(*(m).max_entries) / sizeof(int))
+#define BPF_HOST_RINGBUF(m)                                                                 \
+    bpf_host_map_register(#m, &(m), sizeof(*(m).type) / sizeof(int), 0, 0,                 \
+                          sizeof(*(m).max_entries) / sizeof(int))
+
+/* Drop every registered map */
+void bpf_host_reset(void);
+
+/* What the helpers report for the current task */
+void bpf_host_set_current(__u32 pid, __u32 tgid);
+void bpf_host_set_task(void *task); /* What bpf_get_current_task() returns */
+/*
+ * A CGROUP_ARRAY slot holds the low 32 bits of a cgroup id instead of a
+ * cgroup fd; bpf_current_task_under_cgroup() matches it against this id
+ * exactly, cgroup nesting is not emulated
+ */
+void bpf_host_set_cgroup(__u64 cgroup_id);
+void bpf_host_set_comm(const char *comm);
+void bpf_host_set_pidns(__u64 dev, __u64 ino, __u32 pid, __u32 tgid);
+void bpf_host_set_cpu(__u32 cpu);
+void bpf_host_set_ktime(__u64 ns);
+__u64 bpf_host_ktime(void);
+
+/* Map access by name, the per-CPU variants see the current CPU's copy */
+void *bpf_host_lookup(const char *name, const void *key);
+void *bpf_host_lookup_cpu(const char *name, const void *key, __u32 cpu);
+int bpf_host_update(const char *name, const void *key, const void *value, __u64 flags);
+int bpf_host_delete(const char *name, const void *key);
+int bpf_host_get_next_key(const char *name, const void *key, void *next_key);
+
+/**
+ * bpf_host_ringbuf_consume - Pop the submitted records of a RINGBUF map
+ * @name: Map name
+ * @cb: Called for each record, in submission order
+ * @ctx: Passed to @cb
+ *
+ * @return the number of records consumed, -ENOENT for an unknown map
+ */
+int bpf_host_ringbuf_consume(const char *name, int (*cb)(void *ctx, void *data, size_t size),
+                             void *ctx);
+
+/**
+ * bpf_host_run_timers - Fire the bpf_timers that are due at the current ktime
+ *
+ * A callback re-arming its own timer for the current time is not run again
+ * in the same call.
+ *
+ * @return the number of callbacks run
+ */
+int bpf_host_run_timers(void);
+
+/* bpf_printk() calls so far; the text is formatted but not printed */
+__u64 bpf_host_printk_count(void);
+
+/*
+ * Helpers, called by the BPF sources through the shim headers. Hidden from
+ * C++ callers, whose <bpf/bpf.h> has syscall wrappers with the same names.
+ */
+#if !defined(__cplusplus) || defined(BPF_HOST_IMPL)
+void *bpf_map_lookup_elem(void *map, const void *key);
+long bpf_map_update_elem(void *map, const void *key, const void *value, __u64 flags);
+long bpf_map_delete_elem(void *map, const void *key);
+void *bpf_map_lookup_percpu_elem(void *map, const void *key, __u32 cpu);
+long bpf_for_each_map_elem(void *map, void *callback_fn, void *callback_ctx, __u64 flags);
+long bpf_loop(__u32 nr_loops, void *callback_fn, void *callback_ctx, __u64 flags);
+__u64 bpf_get_current_pid_tgid(void);
+__u64 bpf_get_current_cgroup_id(void);
+__u64 bpf_get_current_task(void);
+long bpf_get_current_comm(void *buf, __u32 size_of_buf);
+long bpf_current_task_under_cgroup(void *map, __u32 index);
+long bpf_get_stackid(void *ctx, void *map, __u64 flags);
+long bpf_get_ns_current_pid_tgid(__u64 dev, __u64 ino, struct bpf_pidns_info *nsdata,
+                                 __u32 size);
+__u32 bpf_get_smp_processor_id(void);
+__u64 bpf_ktime_get_ns(void);
+void *bpf_ringbuf_reserve(void *ringbuf, __u64 size, __u64 flags);
+void bpf_ringbuf_submit(void *data, __u64 flags);
+void bpf_ringbuf_discard(void *data, __u64 flags);
+long bpf_probe_read_kernel(void *dst, __u32 size, const void *unsafe_ptr);
+long bpf_probe_read_kernel_str(void *dst, __u32 size, const void *unsafe_ptr);
+long bpf_timer_init(struct bpf_timer *timer, void *map, __u64 flags);
+long bpf_timer_set_callback(struct bpf_timer *timer, void *callback_fn);
+long bpf_timer_start(struct bpf_timer *timer, __u64 nsecs, __u64 flags);
+long bpf_trace_printk(const char *fmt, __u32 fmt_size, ...);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BPF_HOST_H */
@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file bpf_minimal_host.c
+ * @brief bpf_minimal.c compiled for the host, see bpf_minimal_host.h
+ *
+ * Built as C with -Ihost ahead of the libbpf include path, so the included
+ * source picks up the shims in host/bpf.
+ */
+
+#include "../bpf_minimal.c"
+#include "bpf_minimal_host.h"
+
+void bpf_minimal_host_init(void)
+{
+    BPF_HOST_MAP(io_syscalls);
+    BPF_HOST_MAP(output);
+    BPF_HOST_MAP(id_config);
+    BPF_HOST_MAP(fd_watch);
+    BPF_HOST_MAP(fd_lost);
+    BPF_HOST_RINGBUF(events);
+    BPF_HOST_MAP(class_bytes);
+    BPF_HOST_MAP(sock_bytes);
+    BPF_HOST_MAP(sampler_ctl);
+    BPF_HOST_MAP(sampler_stats);
+    BPF_HOST_MAP(sampler_bucket);
+}
+
+int bpf_minimal_host_sys_enter(long id, const unsigned long args[6])
+{
+    struct sys_enter_args ctx = { .id = id };
+
+    __builtin_memcpy(ctx.args, args, sizeof(ctx.args));
+    return handle_tp(&ctx);
+}
+
+int bpf_minimal_host_exit(int live)
+{
+    struct signal_struct signal = { .live = { live } };
+    struct task_struct task = { .signal = &signal };
+    int ret;
+
+    bpf_host_set_task(&task);
+    ret = handle_exit(0);
+    bpf_host_set_task(0);
+    return ret;
+}
+
+int bpf_minimal_host_exec(void)
+{
+    return handle_exec(0);
+}
+
+int bpf_minimal_host_vfs_write(unsigned short mode, unsigned short family,
+                               unsigned short protocol, const void *saddr, const void *daddr,
+                               unsigned short sport, unsigned short dport, long ret)
+{
+    struct sock sk = {};
+    struct socket sock = { .sk = family ? &sk : 0 };
+    struct inode inode = { .i_mode = mode };
+    struct file file = { .f_inode = &inode, .private_data = &sock };
+
+    sk.__sk_common.skc_family = family;
+    sk.sk_protocol = protocol;
+    sk.__sk_common.skc_num = sport;
+    sk.__sk_common.skc_dport = __builtin_bswap16(dport);
+    if (family == AF_INET) {
+        __builtin_memcpy(&sk.__sk_common.skc_rcv_saddr, saddr, 4);
+        __builtin_memcpy(&sk.__sk_common.skc_daddr, daddr, 4);
+    } else if (family == AF_INET6) {
+        __builtin_memcpy(&sk.__sk_common.skc_v6_rcv_saddr, saddr, 16);
+        __builtin_memcpy(&sk.__sk_common.skc_v6_daddr, daddr, 16);
+    }
+    return handle_vfs_write(0, &file, 0, ret, 0, ret);
+}
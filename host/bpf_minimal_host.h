@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __BPF_MINIMAL_HOST_H
+#define __BPF_MINIMAL_HOST_H
+
+/**
+ * @file bpf_minimal_host.h
+ * @brief bpf_minimal.c compiled for the host, see bpf_host.h
+ *
+ * The programs keep their logic; only their kernel inputs become
+ * parameters. Task, CPU and clock come from the bpf_host_set_*() calls and
+ * the maps are reached with bpf_host_lookup() and friends by the names used
+ * in bpf_minimal.c.
+ */
+
+#include <linux/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Register (and so empty) every map of bpf_minimal.c */
+void bpf_minimal_host_init(void);
+
+/* Run handle_tp as raw_syscalls:sys_enter would for syscall @id */
+int bpf_minimal_host_sys_enter(long id, const unsigned long args[6]);
+
+/*
+ * Run handle_exit and handle_exec for the current task; @live is the
+ * number of threads of its group left once it is gone
+ */
+int bpf_minimal_host_exit(int live);
+int bpf_minimal_host_exec(void);
+
+/**
+ * bpf_minimal_host_vfs_write - Run handle_vfs_write on a synthetic file
+ * @mode: Inode i_mode, only the S_IFMT bits matter
+ * @family: Socket family for S_IFSOCK, 0 for a socket without struct sock
+ * @protocol: IPPROTO_* of the socket
+ * @saddr: Local address, 4 or 16 bytes in network order by family
+ * @daddr: Remote address, same
+ * @sport: Local port, host order
+ * @dport: Remote port, host order
+ * @ret: vfs_write() return value
+ */
+int bpf_minimal_host_vfs_write(unsigned short mode, unsigned short family,
+                               unsigned short protocol, const void *saddr, const void *daddr,
+                               unsigned short sport, unsigned short dport, long ret);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BPF_MINIMAL_HOST_H */
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file hardirqs_host.c
+ * @brief hardirqs.bpf.c compiled for the host, see hardirqs_host.h
+ *
+ * Built as C with -Ihost ahead of the libbpf include path, so <vmlinux.h>,
+ * bits.bpf.h, maps.bpf.h and the libbpf headers resolve to the shims.
+ */
+
+/* hardirqs_host_init() plays the loader, so the knobs must stay writable */
+#define __rodata volatile
+#include "../hardirqs.bpf.c"
+
+#include <stdlib.h>
+#include "hardirqs_host.h"
+
+/* Pre-5.17 layout, which bpf_core_field_exists() reports on the host */
+struct hardirqs_host_rq {
+    struct request___x rq;
+    struct gendisk disk;
+};
+
+void hardirqs_host_init(const struct hardirqs_host_opts *opts)
+{
+    filter_cg = opts->filter_cg;
+    targ_dist = opts->targ_dist;
+    targ_ns = opts->targ_ns;
+    do_count = opts->do_count;
+    targ_stats = opts->targ_stats;
+    targ_flight = opts->targ_flight;
+    flight_thresh = opts->flight_thresh;
+    flight_slots = opts->flight_slots ? opts->flight_slots : FLIGHT_SLOTS;
+    outlier_thresh = opts->outlier_thresh;
+    targ_tax = opts->targ_tax;
+    window_ns = opts->window_ns;
+    rollup_ns = opts->rollup_ns;
+    nr_cpus = opts->nr_cpus ? opts->nr_cpus : 1;
+    storm_gap_ns = opts->storm_gap_ns;
+    storm_lat = opts->storm_lat;
+    targ_gaps = opts->targ_gaps;
+    targ_bio = opts->targ_bio;
+    targ_idle = opts->targ_idle;
+
+    BPF_HOST_MAP(cgroup_map);
+    BPF_HOST_MAP(start);
+    BPF_HOST_MAP(infos);
+    BPF_HOST_MAP(flight_buf);
+    BPF_HOST_MAP(flight_head);
+    BPF_HOST_MAP(flight_ctl);
+    BPF_HOST_RINGBUF(outliers);
+    BPF_HOST_MAP_SIZED(stacks);
+    BPF_HOST_MAP(irq_tax);
+    BPF_HOST_MAP(windows);
+    BPF_HOST_MAP(pcpu_infos);
+    BPF_HOST_MAP(storm_states);
+    BPF_HOST_RINGBUF(storms);
+    BPF_HOST_MAP(gaps);
+    BPF_HOST_MAP(irq_cur);
+    BPF_HOST_MAP(bio_start);
+    BPF_HOST_MAP(bio_infos);
+    BPF_HOST_MAP(bio_batches);
+    BPF_HOST_MAP(idle_exits);
+    BPF_HOST_MAP(idle_counts);
+    BPF_HOST_MAP(idle_infos);
+    BPF_HOST_MAP(rollup_timer);
+    BPF_HOST_MAP(init_fails);
+    BPF_HOST_MAP(sampler_ctl);
+    BPF_HOST_MAP(sampler_stats);
+    BPF_HOST_MAP(sampler_bucket);
+}
+
+int hardirqs_host_entry(int irq, const char *name)
+{
+    struct irqaction action = { .name = name };
+
+    return irq_handler_entry_btf(0, irq, &action);
+}
+
+int hardirqs_host_exit(int irq, const char *name)
+{
+    struct irqaction action = { .name = name };
+
+    return irq_handler_exit_btf(0, irq, &action);
+}
+
+struct hardirqs_host_rq *hardirqs_host_rq_new(int major, int first_minor)
+{
+    struct hardirqs_host_rq *rq = calloc(1, sizeof(*rq));
+
+    if (!rq)
+        return 0;
+    rq->disk.major = major;
+    rq->disk.first_minor = first_minor;
+    rq->rq.rq_disk = &rq->disk;
+    return rq;
+}
+
+void hardirqs_host_rq_free(struct hardirqs_host_rq *rq)
+{
+    free(rq);
+}
+
+int hardirqs_host_rq_issue(struct hardirqs_host_rq *rq)
+{
+    return block_rq_issue(0, (struct request *)&rq->rq);
+}
+
+int hardirqs_host_rq_complete(struct hardirqs_host_rq *rq, unsigned int nr_bytes)
+{
+    return block_rq_complete(0, (struct request *)&rq->rq, 0, nr_bytes);
+}
+
+int hardirqs_host_cpu_idle(unsigned int state)
+{
+    return cpu_idle(0, state, bpf_get_smp_processor_id());
+}
+
+int hardirqs_host_start_rollup(void)
+{
+    return start_rollup(0);
+}
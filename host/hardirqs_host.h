@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __HARDIRQS_HOST_H
+#define __HARDIRQS_HOST_H
+
+/**
+ * @file hardirqs_host.h
+ * @brief hardirqs.bpf.c compiled for the host, see bpf_host.h
+ *
+ * The programs keep their logic; the irqaction they are handed is built
+ * from a name and block requests from a disk number. Task, cgroup, CPU and clock come from the bpf_host_set_*()
+ * calls and the maps are reached with bpf_host_lookup() and friends by the
+ * names used in hardirqs.bpf.c.
+ */
+
+#include <stdbool.h>
+#include <linux/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The rodata knobs of hardirqs.bpf.c, as the loader would set them */
+struct hardirqs_host_opts {
+    bool filter_cg;
+    bool targ_dist;
+    bool targ_ns;
+    bool do_count;
+    bool targ_stats;
+    bool targ_flight;
+    __u64 flight_thresh;
+    __u32 flight_slots; /* 0 for FLIGHT_SLOTS */
+    __u64 outlier_thresh;
+    bool targ_tax;
+    __u64 window_ns;
+    __u64 rollup_ns;
+    __u32 nr_cpus; /* 0 for 1 */
+    __u64 storm_gap_ns;
+    __u64 storm_lat;
+    bool targ_gaps;
+    bool targ_bio;
+    bool targ_idle;
+};
+
+/* Set the knobs and register (and so empty) every map of hardirqs.bpf.c */
+void hardirqs_host_init(const struct hardirqs_host_opts *opts);
+
+/* Run irq_handler_entry/exit for interrupt @irq of handler @name */
+int hardirqs_host_entry(int irq, const char *name);
+int hardirqs_host_exit(int irq, const char *name);
+
+/* A block request, its address is what block_rq_issue/complete key it by */
+struct hardirqs_host_rq;
+
+/* Request on disk @major:@first_minor, freed with hardirqs_host_rq_free() */
+struct hardirqs_host_rq *hardirqs_host_rq_new(int major, int first_minor);
+void hardirqs_host_rq_free(struct hardirqs_host_rq *rq);
+
+/* Run block_rq_issue and block_rq_complete for @rq */
+int hardirqs_host_rq_issue(struct hardirqs_host_rq *rq);
+int hardirqs_host_rq_complete(struct hardirqs_host_rq *rq, unsigned int nr_bytes);
+
+/* Run cpu_idle, @state is (unsigned int)-1 for an idle exit */
+int hardirqs_host_cpu_idle(unsigned int state);
+
+/* Run start_rollup; the rollup itself runs from bpf_host_run_timers() */
+int hardirqs_host_start_rollup(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HARDIRQS_HOST_H */
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __BPF_HOST_MAPS_BPF_H
+#define __BPF_HOST_MAPS_BPF_H
+
+/**
+ * @file maps.bpf.h
+ * @brief Host stand-in for libbpf-tools' maps.bpf.h
+ */
+
+#include <errno.h>
+
+/**
+ * bpf_map_lookup_or_try_init - Look up @key, inserting @init when missing
+ *
+ * An -EEXIST insert lost a race with another CPU and still finds the value.
+ *
+ * @return the value, NULL if the map is full
+ */
+static __always_inline void *bpf_map_lookup_or_try_init(void *map, const void *key,
+                                                        const void *init)
+{
+    void *val;
+    long err;
+
+    val = bpf_map_lookup_elem(map, key);
+    if (val)
+        return val;
+
+    err = bpf_map_update_elem(map, key, init, BPF_NOEXIST);
+    if (err && err != -EEXIST)
+        return 0;
+
+    return bpf_map_lookup_elem(map, key);
+}
+
+#endif /* __BPF_HOST_MAPS_BPF_H */
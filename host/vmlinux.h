@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __BPF_HOST_VMLINUX_H
+#define __BPF_HOST_VMLINUX_H
+
+/**
+ * @file vmlinux.h
+ * @brief Host stand-in for the generated <vmlinux.h>
+ *
+ * Only the kernel types the tools' BPF sources touch, declared locally
+ * with the members they read, the way bpf_minimal.c declares its own.
+ * The UAPI part (map types, flags, struct bpf_timer) comes from the host's
+ * <linux/bpf.h>. Harnesses build these objects themselves and hand them
+ * to the programs.
+ */
+
+#include <stdbool.h>
+#include <linux/bpf.h>
+#include <linux/types.h>
+#include "bpf_host.h"
+
+typedef __u8 u8;
+typedef __u16 u16;
+typedef __u32 u32;
+typedef __u64 u64;
+typedef __s8 s8;
+typedef __s16 s16;
+typedef __s32 s32;
+typedef __s64 s64;
+
+typedef u8 blk_status_t;
+
+struct bpf_map;
+
+/* Argument of the irq_handler_entry/exit tracepoints */
+struct irqaction {
+    const char *name;
+} __attribute__((preserve_access_index));
+
+struct gendisk {
+    int major;
+    int first_minor;
+} __attribute__((preserve_access_index));
+
+/* Opaque: programs go through their own request___x flavours */
+struct request;
+
+#endif /* __BPF_HOST_VMLINUX_H */
@@ -0,0 +1,169 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/**
+ * @file hrtimers.bpf.c
+ * @brief eBPF program profiling hrtimer expiry lateness and callback duration
+ *
+ * Most local timer interrupts end up running hrtimer callbacks (the tick,
+ * scheduler and networking timers). Per callback function this program:
+ * - Counts hrtimer_start calls, i.e. how often the timer is (re)armed
+ * - Histograms expiry lateness, the time between the soft expiry the timer
+ *   was armed for and the clock value its callback is run at
+ * - Histograms callback duration between hrtimer_expire_entry and _exit,
+ *   timed from a per-CPU entry timestamp like hardirqs.bpf.c
+ */
+
+#include <vmlinux.h>
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include "hrtimers.h"
+#include "bits.bpf.h"
+#include "maps.bpf.h"
+
+/* Runtime configuration flags */
+const volatile bool targ_ns = false; /* use nanoseconds (true) or microseconds (false) */
+
+/**
+ * @brief Callback running on this CPU
+ */
+struct timer_start {
+    u64 ts; /* hrtimer_expire_entry timestamp */
+    u64 func; /* Callback address */
+    u64 timer; /* Timer address, only compared: the callback may free the timer */
+};
+
+/**
+ * @brief Per-CPU callback entry, slot 1 for softirq-expired timers
+ * A hardirq-expired callback may interrupt a softirq one, never another
+ * of its own kind, so one slot per kind is enough
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 2);
+    __type(key, u32);
+    __type(value, struct timer_start);
+} start SEC(".maps");
+
+/**
+ * @brief Per-function statistics keyed by callback address
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_FUNCS);
+    __type(key, u64);
+    __type(value, struct timer_info);
+} infos SEC(".maps");
+
+static struct timer_info zero;
+
+static __always_inline u32 timer_kind(struct hrtimer *timer)
+{
+    if (bpf_core_field_exists(timer->is_soft))
+        return BPF_CORE_READ(timer, is_soft) ? 1 : 0;
+    return 0;
+}
+
+static __always_inline void hist_add(u32 *slots, u64 val)
+{
+    u64 slot = log2l(val);
+
+    if (slot >= MAX_SLOTS)
+        slot = MAX_SLOTS - 1;
+    __sync_fetch_and_add(&slots[slot], 1);
+}
+
+SEC("tp_btf/hrtimer_start")
+int BPF_PROG(hrtimer_start, struct hrtimer *timer)
+{
+    u64 func = (u64)BPF_CORE_READ(timer, function);
+    struct timer_info *info;
+
+    info = bpf_map_lookup_or_try_init(&infos, &func, &zero);
+    if (info)
+        __sync_fetch_and_add(&info->starts, 1);
+    return 0;
+}
+
+/**
+ * hrtimer_expire_entry - Account lateness and start timing the callback
+ * @timer: Expiring timer
+ * @now: Clock value of the timer's base the expiry is processed at
+ *
+ * Lateness is taken against the timer's own clock base so timers on
+ * CLOCK_REALTIME or CLOCK_BOOTTIME need no conversion.
+ */
+SEC("tp_btf/hrtimer_expire_entry")
+int BPF_PROG(hrtimer_expire_entry, struct hrtimer *timer, ktime_t *now)
+{
+    struct timer_start *ts;
+    struct timer_info *info;
+    u32 key = timer_kind(timer);
+    s64 soft, base;
+    u64 late;
+
+    ts = bpf_map_lookup_elem(&start, &key);
+    if (!ts)
+        return 0;
+    ts->func = (u64)BPF_CORE_READ(timer, function);
+    ts->timer = (u64)timer;
+    ts->ts = bpf_ktime_get_ns();
+
+    if (bpf_probe_read_kernel(&base, sizeof(base), now))
+        return 0;
+    soft = BPF_CORE_READ(timer, _softexpires);
+    late = base > soft ? base - soft : 0;
+    if (!targ_ns)
+        late /= 1000U;
+
+    info = bpf_map_lookup_or_try_init(&infos, &ts->func, &zero);
+    if (!info)
+        return 0;
+    __sync_fetch_and_add(&info->late_total, late);
+    hist_add(info->late_slots, late);
+    return 0;
+}
+
+/**
+ * hrtimer_expire_exit - Account the callback duration
+ * @timer: Timer whose callback returned
+ *
+ * The callback may have freed @timer, so it is never read here: the slot
+ * is the one whose entry recorded the same address.
+ */
+SEC("tp_btf/hrtimer_expire_exit")
+int BPF_PROG(hrtimer_expire_exit, struct hrtimer *timer)
+{
+    struct timer_start *ts;
+    struct timer_info *info;
+    u32 key = 0;
+    u64 delta;
+
+    ts = bpf_map_lookup_elem(&start, &key);
+    if (!ts)
+        return 0;
+    if (ts->timer != (u64)timer) {
+        key = 1;
+        ts = bpf_map_lookup_elem(&start, &key);
+        if (!ts || ts->timer != (u64)timer)
+            return 0;
+    }
+    if (!ts->ts)
+        return 0;
+
+    delta = bpf_ktime_get_ns() - ts->ts;
+    ts->ts = 0;
+    if (!targ_ns)
+        delta /= 1000U;
+
+    /* The callback may have re-armed the timer with another function */
+    info = bpf_map_lookup_or_try_init(&infos, &ts->func, &zero);
+    if (!info)
+        return 0;
+    __sync_fetch_and_add(&info->expiries, 1);
+    __sync_fetch_and_add(&info->run_total, delta);
+    hist_add(info->run_slots, delta);
+    return 0;
+}
+
+char LICENSE[] SEC("license") = "GPL";
@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * @file hrtimers.cpp
+ * @brief Userspace front-end for hrtimers.bpf.c
+ *
+ * Prints, per hrtimer callback function symbolized through /proc/kallsyms,
+ * how often it was armed and run, its average expiry lateness and average
+ * duration every interval. With -d the lateness and duration histograms
+ * follow.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "hrtimers.h"
+#include "hrtimers.skel.h"
+#include "ksyms.hpp"
+#include "trace_helpers.hpp"
+
+static struct env {
+    bool distributed;
+    bool nanoseconds;
+    bool timestamp;
+    bool verbose;
+    int top = 20;
+    int interval = 99999999;
+    int times = 99999999;
+} env;
+
+static Ksyms ksyms;
+
+static const char usage[] =
+    "Usage: hrtimers [OPTION...] [interval] [count]\n"
+    "Summarize hrtimer expiry lateness and callback duration per function.\n"
+    "\n"
+    "  -d, --distributed         Show lateness and duration histograms\n"
+    "  -n, --top=N               Functions shown, by total callback time\n"
+    "  -N, --nanoseconds         Output in nanoseconds\n"
+    "  -T, --timestamp           Include timestamp on output\n"
+    "  -v, --verbose             Verbose debug output\n"
+    "  -h, --help                Show this help\n"
+    "\n"
+    "Examples:\n"
+    "    hrtimers 1          # per-function summary every second\n"
+    "    hrtimers -dN 10     # nanosecond histograms every 10s\n";
+
+static const struct option long_opts[] = {
+    { "distributed", no_argument, nullptr, 'd' },
+    { "top", required_argument, nullptr, 'n' },
+    { "nanoseconds", no_argument, nullptr, 'N' },
+    { "timestamp", no_argument, nullptr, 'T' },
+    { "verbose", no_argument, nullptr, 'v' },
+    { "help", no_argument, nullptr, 'h' },
+    {},
+};
+
+static int parse_args(int argc, char **argv)
+{
+    unsigned long long val;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "dn:NTvh", long_opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'd':
+            env.distributed = true;
+            break;
+        case 'n':
+            if (!parse_ull(optarg, &val) || !val || val > MAX_FUNCS) {
+                fprintf(stderr, "invalid function count: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.top = val;
+            break;
+        case 'N':
+            env.nanoseconds = true;
+            break;
+        case 'T':
+            env.timestamp = true;
+            break;
+        case 'v':
+            env.verbose = true;
+            break;
+        case 'h':
+            fputs(usage, stdout);
+            exit(0);
+        default:
+            fputs(usage, stderr);
+            return -EINVAL;
+        }
+    }
+
+    if (parse_interval_count(argc, argv, &env.interval, &env.times) < 0)
+        return -EINVAL;
+    return 0;
+}
+
+static const char *func_name(unsigned long long addr, char *buf, size_t size)
+{
+    const struct ksym *sym = ksyms.lookup(addr);
+
+    if (!sym)
+        snprintf(buf, size, "0x%llx", addr);
+    else if (sym->module)
+        snprintf(buf, size, "%s [%s]", sym->name, sym->module);
+    else
+        snprintf(buf, size, "%s", sym->name);
+    return buf;
+}
+
+struct func_entry {
+    unsigned long long func;
+    struct timer_info info;
+};
+
+/**
+ * print_infos - Print and reset the per-function statistics
+ * @obj: Loaded skeleton
+ */
+static int print_infos(struct hrtimers_bpf *obj)
+{
+    const char *units = env.nanoseconds ? "nsecs" : "usecs";
+    int fd = bpf_map__fd(obj->maps.infos);
+    std::vector<struct func_entry> funcs;
+    __u64 key, next_key, *prev = nullptr;
+    char name[128];
+    int err;
+
+    while (!bpf_map_get_next_key(fd, prev, &next_key)) {
+        struct func_entry e = { next_key, {} };
+
+        key = next_key;
+        prev = &key;
+        err = bpf_map_lookup_elem(fd, &next_key, &e.info);
+        if (err < 0) {
+            fprintf(stderr, "failed to lookup infos: %d\n", err);
+            return -1;
+        }
+        funcs.push_back(e);
+    }
+    for (const auto &e : funcs)
+        bpf_map_delete_elem(fd, &e.func);
+
+    std::sort(funcs.begin(), funcs.end(), [](const func_entry &a, const func_entry &b) {
+        return a.info.run_total > b.info.run_total;
+    });
+    if (funcs.size() > (size_t)env.top)
+        funcs.resize(env.top);
+
+    printf("%-40s %10s %10s %9s%5s %8s%5s\n", "FUNCTION", "STARTS", "EXPIRIES", "AVG_LATE_",
+           units, "AVG_RUN_", units);
+    for (const auto &e : funcs) {
+        const struct timer_info &t = e.info;
+        unsigned long long n = t.expiries ? t.expiries : 1;
+
+        printf("%-40s %10llu %10llu %14llu %13llu\n", func_name(e.func, name, sizeof(name)),
+               (unsigned long long)t.starts, (unsigned long long)t.expiries,
+               (unsigned long long)t.late_total / n, (unsigned long long)t.run_total / n);
+    }
+
+    if (!env.distributed)
+        return 0;
+    for (const auto &e : funcs) {
+        if (!e.info.expiries)
+            continue;
+        func_name(e.func, name, sizeof(name));
+        printf("\nfunction = %s, expiry lateness\n", name);
+        print_log2_hist(e.info.late_slots, MAX_SLOTS, units);
+        printf("\nfunction = %s, callback duration\n", name);
+        print_log2_hist(e.info.run_slots, MAX_SLOTS, units);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct hrtimers_bpf *obj;
+    int err;
+
+    err = parse_args(argc, argv);
+    if (err)
+        return 1;
+
+    set_libbpf_print(env.verbose);
+
+    if (!probe_tp_btf("hrtimer_expire_entry")) {
+        fprintf(stderr, "kernel lacks BTF-enabled tracepoints\n");
+        return 1;
+    }
+
+    err = ksyms.load();
+    if (err)
+        fprintf(stderr, "failed to load kallsyms, functions are not symbolized: %d\n", err);
+
+    obj = hrtimers_bpf__open();
+    if (!obj) {
+        fprintf(stderr, "failed to open BPF object\n");
+        return 1;
+    }
+
+    obj->rodata->targ_ns = env.nanoseconds;
+
+    err = hrtimers_bpf__load(obj);
+    if (err) {
+        fprintf(stderr, "failed to load BPF object: %d\n", err);
+        goto cleanup;
+    }
+
+    err = hrtimers_bpf__attach(obj);
+    if (err) {
+        fprintf(stderr, "failed to attach BPF programs\n");
+        goto cleanup;
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    printf("Tracing hrtimer expiries... Hit Ctrl-C to end.\n");
+
+    /* main: poll */
+    while (!exiting) {
+        sleep(env.interval);
+        printf("\n");
+
+        if (env.timestamp)
+            print_timestamp();
+
+        err = print_infos(obj);
+        if (err)
+            break;
+
+        if (--env.times == 0)
+            break;
+    }
+
+cleanup:
+    hrtimers_bpf__destroy(obj);
+
+    return err != 0;
+}
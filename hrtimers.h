@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __HRTIMERS_H
+#define __HRTIMERS_H
+
+/**
+ * @file hrtimers.h
+ * @brief Definitions shared between hrtimers.bpf.c and its userspace front-end
+ */
+
+#define MAX_SLOTS 20
+#define MAX_FUNCS 1024
+
+/**
+ * @struct timer_info
+ * @brief Statistics of one hrtimer callback function
+ */
+struct timer_info {
+    __u64 starts; /* hrtimer_start calls, re-arms included */
+    __u64 expiries; /* Callbacks run */
+    __u64 late_total; /* Summed expiry lateness in the tool's unit */
+    __u64 run_total; /* Summed callback duration in the tool's unit */
+    __u32 late_slots[MAX_SLOTS]; /* log2 histogram of expiry lateness */
+    __u32 run_slots[MAX_SLOTS]; /* log2 histogram of callback duration */
+};
+
+#endif /* __HRTIMERS_H */
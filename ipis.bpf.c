@@ -0,0 +1,302 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/**
+ * @file ipis.bpf.c
+ * @brief eBPF program profiling inter-processor interrupts
+ *
+ * IPIs (reschedule, function call, TLB shootdown) are delivered through
+ * architecture vectors rather than irq_handler_entry, so hardirqs does not
+ * see them. This program:
+ * - Counts IPIs per callback, sending and receiving CPU from
+ *   ipi:ipi_send_cpu and ipi:ipi_send_cpumask (Linux 6.6+)
+ * - Times the handler on the receiving CPU, from ipi:ipi_entry/exit on
+ *   arm/arm64 or the irq_vectors reschedule/call_function tracepoints on
+ *   x86, with a per-CPU entry timestamp like hardirqs.bpf.c
+ * - Measures delivery latency from the earliest pending send to a CPU to
+ *   the start of its next IPI handler
+ */
+
+#include <vmlinux.h>
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include "ipis.h"
+#include "bits.bpf.h"
+#include "maps.bpf.h"
+
+#define MASK_WORDS (MAX_IPI_CPUS / 64)
+
+/* Runtime configuration flags */
+const volatile bool targ_ns = false; /* use nanoseconds (true) or microseconds (false) */
+const volatile __u32 nr_cpus = 1; /* Possible CPUs, bounds the cpumask scan */
+
+/**
+ * @brief Send counts per callback and CPU pair
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_IPI_PAIRS);
+    __type(key, struct ipi_send_key);
+    __type(value, u64);
+} sends SEC(".maps");
+
+/**
+ * @brief Earliest unserved send to each CPU, 0 if none
+ * Userspace shrinks it to the number of possible CPUs before load
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, MAX_IPI_CPUS);
+    __type(key, u32);
+    __type(value, u64);
+} pending SEC(".maps");
+
+/**
+ * @brief Handler statistics per receiving CPU and reason
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_IPI_RECV);
+    __type(key, struct ipi_recv_key);
+    __type(value, struct ipi_recv_info);
+} recvs SEC(".maps");
+
+/**
+ * @brief IPI handler running on this CPU
+ */
+struct ipi_start {
+    u64 ts; /* Handler entry timestamp, 0 if none */
+    u64 lat; /* Delivery latency in ns, 0 if no send was seen */
+    char reason[IPI_REASON_LEN];
+};
+
+/**
+ * @brief Per-CPU handler entry, IPI handlers do not nest
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct ipi_start);
+} start SEC(".maps");
+
+struct cpu_mask {
+    unsigned long bits[MASK_WORDS];
+};
+
+/**
+ * @brief Scratch copy of the target mask, too large for the BPF stack
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct cpu_mask);
+} mask_buf SEC(".maps");
+
+static struct ipi_recv_info zero;
+static u64 zero_count;
+
+static __always_inline void hist_add(u32 *slots, u64 val)
+{
+    u64 slot = log2l(val);
+
+    if (slot >= MAX_SLOTS)
+        slot = MAX_SLOTS - 1;
+    __sync_fetch_and_add(&slots[slot], 1);
+}
+
+/**
+ * record_send - Account one IPI from the current CPU
+ * @dst: Receiving CPU
+ * @callback: Function the receiver will run
+ * @ts: Send timestamp in ns
+ *
+ * Only the first send to a CPU before it handles an IPI starts the
+ * latency clock, later ones are delivered by the same interrupt.
+ */
+static void record_send(u32 dst, u64 callback, u64 ts)
+{
+    struct ipi_send_key key = {};
+    u64 *cnt, *pend;
+
+    key.callback = callback;
+    key.src = bpf_get_smp_processor_id();
+    key.dst = dst;
+    cnt = bpf_map_lookup_or_try_init(&sends, &key, &zero_count);
+    if (cnt)
+        __sync_fetch_and_add(cnt, 1);
+
+    pend = bpf_map_lookup_elem(&pending, &dst);
+    if (pend && !*pend)
+        *pend = ts;
+}
+
+struct mask_ctx {
+    struct cpu_mask *mask;
+    u64 callback;
+    u64 ts;
+};
+
+static long scan_word(u32 i, struct mask_ctx *mctx)
+{
+    unsigned long word;
+
+    if (i >= MASK_WORDS)
+        return 1;
+    word = mctx->mask->bits[i];
+    for (u32 b = 0; b < 64 && word; b++) {
+        if (!(word & (1UL << b)))
+            continue;
+        word &= ~(1UL << b);
+        record_send(i * 64 + b, mctx->callback, mctx->ts);
+    }
+    return 0;
+}
+
+SEC("tp_btf/ipi_send_cpu")
+int BPF_PROG(ipi_send_cpu, unsigned int cpu, unsigned long callsite, void *callback)
+{
+    record_send(cpu, (u64)callback, bpf_ktime_get_ns());
+    return 0;
+}
+
+SEC("tp_btf/ipi_send_cpumask")
+int BPF_PROG(ipi_send_cpumask, struct cpumask *cpumask, unsigned long callsite, void *callback)
+{
+    struct mask_ctx mctx = {};
+    u32 key = 0;
+    u32 words = (nr_cpus + 63) / 64;
+
+    if (words > MASK_WORDS)
+        words = MASK_WORDS;
+    mctx.mask = bpf_map_lookup_elem(&mask_buf, &key);
+    if (!mctx.mask)
+        return 0;
+    if (bpf_probe_read_kernel(mctx.mask, words * sizeof(unsigned long), cpumask))
+        return 0;
+
+    mctx.callback = (u64)callback;
+    mctx.ts = bpf_ktime_get_ns();
+    bpf_loop(words, scan_word, &mctx, 0);
+    return 0;
+}
+
+/**
+ * recv_entry - Start timing an IPI handler on this CPU
+ * @reason: Kernel string naming the IPI type
+ */
+static int recv_entry(const char *reason)
+{
+    u32 key = 0, cpu = bpf_get_smp_processor_id();
+    struct ipi_start *st;
+    u64 *pend;
+
+    st = bpf_map_lookup_elem(&start, &key);
+    if (!st)
+        return 0;
+
+    st->ts = bpf_ktime_get_ns();
+    st->lat = 0;
+    pend = bpf_map_lookup_elem(&pending, &cpu);
+    if (pend && *pend) {
+        if (st->ts > *pend)
+            st->lat = st->ts - *pend;
+        *pend = 0;
+    }
+    bpf_probe_read_kernel_str(st->reason, sizeof(st->reason), reason);
+    return 0;
+}
+
+static int recv_exit(void)
+{
+    struct ipi_recv_key rkey = {};
+    struct ipi_recv_info *info;
+    struct ipi_start *st;
+    u64 run, lat;
+    u32 key = 0;
+
+    st = bpf_map_lookup_elem(&start, &key);
+    if (!st || !st->ts)
+        return 0;
+
+    run = bpf_ktime_get_ns() - st->ts;
+    lat = st->lat;
+    st->ts = 0;
+    if (!targ_ns) {
+        run /= 1000U;
+        lat /= 1000U;
+    }
+
+    rkey.cpu = bpf_get_smp_processor_id();
+    __builtin_memcpy(rkey.reason, st->reason, sizeof(rkey.reason));
+    info = bpf_map_lookup_or_try_init(&recvs, &rkey, &zero);
+    if (!info)
+        return 0;
+
+    __sync_fetch_and_add(&info->count, 1);
+    __sync_fetch_and_add(&info->run_total, run);
+    hist_add(info->run_slots, run);
+    if (st->lat) {
+        __sync_fetch_and_add(&info->lat_count, 1);
+        __sync_fetch_and_add(&info->lat_total, lat);
+        hist_add(info->lat_slots, lat);
+    }
+    return 0;
+}
+
+/* arm and arm64 */
+SEC("tp_btf/ipi_entry")
+int BPF_PROG(ipi_entry, const char *reason)
+{
+    return recv_entry(reason);
+}
+
+SEC("tp_btf/ipi_exit")
+int BPF_PROG(ipi_exit, const char *reason)
+{
+    return recv_exit();
+}
+
+/* x86 irq_vectors */
+static const char reschedule_reason[] = "Rescheduling interrupts";
+static const char call_function_reason[] = "Function call interrupts";
+static const char call_function_single_reason[] = "Single function call interrupts";
+
+SEC("tp_btf/reschedule_entry")
+int BPF_PROG(reschedule_entry, int vector)
+{
+    return recv_entry(reschedule_reason);
+}
+
+SEC("tp_btf/reschedule_exit")
+int BPF_PROG(reschedule_exit, int vector)
+{
+    return recv_exit();
+}
+
+SEC("tp_btf/call_function_entry")
+int BPF_PROG(call_function_entry, int vector)
+{
+    return recv_entry(call_function_reason);
+}
+
+SEC("tp_btf/call_function_exit")
+int BPF_PROG(call_function_exit, int vector)
+{
+    return recv_exit();
+}
+
+SEC("tp_btf/call_function_single_entry")
+int BPF_PROG(call_function_single_entry, int vector)
+{
+    return recv_entry(call_function_single_reason);
+}
+
+SEC("tp_btf/call_function_single_exit")
+int BPF_PROG(call_function_single_exit, int vector)
+{
+    return recv_exit();
+}
+
+char LICENSE[] SEC("license") = "GPL";
@@ -0,0 +1,354 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * @file ipis.cpp
+ * @brief Userspace front-end for ipis.bpf.c
+ *
+ * Prints every interval the IPIs handled per receiving CPU and reason with
+ * their delivery latency and handler time, and the busiest sender/receiver
+ * pairs with the callback they asked for, symbolized through
+ * /proc/kallsyms. Only the tracepoints the running kernel provides are
+ * attached, so either side may be missing on older kernels or other
+ * architectures.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "ipis.h"
+#include "ipis.skel.h"
+#include "ksyms.hpp"
+#include "trace_helpers.hpp"
+
+static struct env {
+    bool distributed;
+    bool nanoseconds;
+    bool timestamp;
+    bool verbose;
+    int top = 20;
+    int interval = 99999999;
+    int times = 99999999;
+} env;
+
+static Ksyms ksyms;
+
+static const char usage[] =
+    "Usage: ipis [OPTION...] [interval] [count]\n"
+    "Summarize inter-processor interrupts per CPU pair and reason.\n"
+    "\n"
+    "  -d, --distributed         Show latency and handler time histograms\n"
+    "                            per reason\n"
+    "  -n, --top=N               Rows shown in each table\n"
+    "  -N, --nanoseconds         Output in nanoseconds\n"
+    "  -T, --timestamp           Include timestamp on output\n"
+    "  -v, --verbose             Verbose debug output\n"
+    "  -h, --help                Show this help\n"
+    "\n"
+    "Examples:\n"
+    "    ipis 1              # IPI summary every second\n"
+    "    ipis -d -n 50 10    # 50 rows and histograms every 10s\n";
+
+static const struct option long_opts[] = {
+    { "distributed", no_argument, nullptr, 'd' },
+    { "top", required_argument, nullptr, 'n' },
+    { "nanoseconds", no_argument, nullptr, 'N' },
+    { "timestamp", no_argument, nullptr, 'T' },
+    { "verbose", no_argument, nullptr, 'v' },
+    { "help", no_argument, nullptr, 'h' },
+    {},
+};
+
+static int parse_args(int argc, char **argv)
+{
+    unsigned long long val;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "dn:NTvh", long_opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'd':
+            env.distributed = true;
+            break;
+        case 'n':
+            if (!parse_ull(optarg, &val) || !val || val > MAX_IPI_PAIRS) {
+                fprintf(stderr, "invalid row count: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.top = val;
+            break;
+        case 'N':
+            env.nanoseconds = true;
+            break;
+        case 'T':
+            env.timestamp = true;
+            break;
+        case 'v':
+            env.verbose = true;
+            break;
+        case 'h':
+            fputs(usage, stdout);
+            exit(0);
+        default:
+            fputs(usage, stderr);
+            return -EINVAL;
+        }
+    }
+
+    if (parse_interval_count(argc, argv, &env.interval, &env.times) < 0)
+        return -EINVAL;
+    return 0;
+}
+
+static const char *func_name(unsigned long long addr, char *buf, size_t size)
+{
+    const struct ksym *sym;
+
+    if (!addr) {
+        snprintf(buf, size, "[reschedule]");
+        return buf;
+    }
+    sym = ksyms.lookup(addr);
+    if (!sym)
+        snprintf(buf, size, "0x%llx", addr);
+    else
+        snprintf(buf, size, "%s", sym->name);
+    return buf;
+}
+
+struct send_entry {
+    struct ipi_send_key key;
+    unsigned long long count;
+};
+
+struct recv_entry {
+    struct ipi_recv_key key;
+    struct ipi_recv_info info;
+};
+
+/**
+ * print_sends - Print and reset the busiest sender/receiver pairs
+ * @obj: Loaded skeleton
+ */
+static int print_sends(struct ipis_bpf *obj)
+{
+    int fd = bpf_map__fd(obj->maps.sends);
+    std::vector<struct send_entry> sends;
+    struct ipi_send_key key, next_key, *prev = nullptr;
+    unsigned long long total = 0;
+    char name[128];
+    int err;
+
+    while (!bpf_map_get_next_key(fd, prev, &next_key)) {
+        struct send_entry e = { next_key, 0 };
+        __u64 count;
+
+        key = next_key;
+        prev = &key;
+        err = bpf_map_lookup_elem(fd, &next_key, &count);
+        if (err < 0) {
+            fprintf(stderr, "failed to lookup sends: %d\n", err);
+            return -1;
+        }
+        e.count = count;
+        total += count;
+        sends.push_back(e);
+    }
+    for (const auto &e : sends)
+        bpf_map_delete_elem(fd, &e.key);
+
+    std::sort(sends.begin(), sends.end(),
+              [](const send_entry &a, const send_entry &b) { return a.count > b.count; });
+    if (sends.size() > (size_t)env.top)
+        sends.resize(env.top);
+
+    printf("%llu IPIs sent\n", total);
+    printf("%-5s %-5s %-40s %10s\n", "SRC", "DST", "CALLBACK", "COUNT");
+    for (const auto &e : sends)
+        printf("%-5u %-5u %-40s %10llu\n", e.key.src, e.key.dst,
+               func_name(e.key.callback, name, sizeof(name)), e.count);
+    return 0;
+}
+
+/**
+ * print_recvs - Print and reset handler statistics per CPU and reason
+ * @obj: Loaded skeleton
+ */
+static int print_recvs(struct ipis_bpf *obj)
+{
+    const char *units = env.nanoseconds ? "nsecs" : "usecs";
+    int fd = bpf_map__fd(obj->maps.recvs);
+    std::map<std::string, struct ipi_recv_info> reasons;
+    std::vector<struct recv_entry> recvs;
+    struct ipi_recv_key key, next_key, *prev = nullptr;
+    int err;
+
+    while (!bpf_map_get_next_key(fd, prev, &next_key)) {
+        struct recv_entry e = { next_key, {} };
+
+        key = next_key;
+        prev = &key;
+        err = bpf_map_lookup_elem(fd, &next_key, &e.info);
+        if (err < 0) {
+            fprintf(stderr, "failed to lookup recvs: %d\n", err);
+            return -1;
+        }
+        recvs.push_back(e);
+    }
+    for (const auto &e : recvs)
+        bpf_map_delete_elem(fd, &e.key);
+
+    std::sort(recvs.begin(), recvs.end(), [](const recv_entry &a, const recv_entry &b) {
+        return a.info.count > b.info.count;
+    });
+
+    printf("%-5s %-32s %10s %8s%5s %8s%5s\n", "CPU", "REASON", "COUNT", "AVG_LAT_", units,
+           "AVG_RUN_", units);
+    for (size_t i = 0; i < recvs.size(); i++) {
+        const struct ipi_recv_info &r = recvs[i].info;
+
+        if (env.distributed) {
+            struct ipi_recv_info &sum = reasons[std::string(recvs[i].key.reason,
+                                                            strnlen(recvs[i].key.reason,
+                                                                    IPI_REASON_LEN))];
+
+            for (int s = 0; s < MAX_SLOTS; s++) {
+                sum.lat_slots[s] += r.lat_slots[s];
+                sum.run_slots[s] += r.run_slots[s];
+            }
+        }
+        if (i >= (size_t)env.top)
+            continue;
+        printf("%-5u %-32.*s %10llu %13llu %13llu\n", recvs[i].key.cpu, IPI_REASON_LEN,
+               recvs[i].key.reason, (unsigned long long)r.count,
+               r.lat_count ? (unsigned long long)(r.lat_total / r.lat_count) : 0ULL,
+               r.count ? (unsigned long long)(r.run_total / r.count) : 0ULL);
+    }
+
+    for (const auto &r : reasons) {
+        printf("\nreason = %s, send to handler latency\n", r.first.c_str());
+        print_log2_hist(r.second.lat_slots, MAX_SLOTS, units);
+        printf("\nreason = %s, handler time\n", r.first.c_str());
+        print_log2_hist(r.second.run_slots, MAX_SLOTS, units);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct ipis_bpf *obj;
+    int ncpus = libbpf_num_possible_cpus();
+    bool can_send = false, can_recv = false;
+    int err;
+
+    err = parse_args(argc, argv);
+    if (err)
+        return 1;
+
+    set_libbpf_print(env.verbose);
+
+    if (ncpus <= 0 || ncpus > MAX_IPI_CPUS) {
+        fprintf(stderr, "unsupported number of CPUs: %d\n", ncpus);
+        return 1;
+    }
+
+    err = ksyms.load();
+    if (err)
+        fprintf(stderr, "failed to load kallsyms, callbacks are not symbolized: %d\n", err);
+
+    obj = ipis_bpf__open();
+    if (!obj) {
+        fprintf(stderr, "failed to open BPF object\n");
+        return 1;
+    }
+
+    /* The send side and each architecture's receive side come and go as a group */
+    struct {
+        struct bpf_program *prog;
+        const char *tp;
+        bool *side;
+    } progs[] = {
+        { obj->progs.ipi_send_cpu, "ipi_send_cpu", &can_send },
+        { obj->progs.ipi_send_cpumask, "ipi_send_cpumask", &can_send },
+        { obj->progs.ipi_entry, "ipi_entry", &can_recv },
+        { obj->progs.ipi_exit, "ipi_exit", &can_recv },
+        { obj->progs.reschedule_entry, "reschedule_entry", &can_recv },
+        { obj->progs.reschedule_exit, "reschedule_exit", &can_recv },
+        { obj->progs.call_function_entry, "call_function_entry", &can_recv },
+        { obj->progs.call_function_exit, "call_function_exit", &can_recv },
+        { obj->progs.call_function_single_entry, "call_function_single_entry", &can_recv },
+        { obj->progs.call_function_single_exit, "call_function_single_exit", &can_recv },
+    };
+    for (const auto &p : progs) {
+        if (probe_tp_btf(p.tp))
+            *p.side = true;
+        else
+            bpf_program__set_autoload(p.prog, false);
+    }
+    if (!can_send && !can_recv) {
+        fprintf(stderr, "kernel has no BTF-enabled IPI tracepoints\n");
+        err = -ENOENT;
+        goto cleanup;
+    }
+    if (!can_send)
+        fprintf(stderr, "ipi_send_cpu(mask) unavailable (Linux 6.6+), no senders or latency\n");
+    if (!can_recv)
+        fprintf(stderr, "no IPI entry tracepoints on this architecture, no handler time\n");
+
+    obj->rodata->targ_ns = env.nanoseconds;
+    obj->rodata->nr_cpus = ncpus;
+    bpf_map__set_max_entries(obj->maps.pending, ncpus);
+
+    err = ipis_bpf__load(obj);
+    if (err) {
+        fprintf(stderr, "failed to load BPF object: %d\n", err);
+        goto cleanup;
+    }
+
+    err = ipis_bpf__attach(obj);
+    if (err) {
+        fprintf(stderr, "failed to attach BPF programs\n");
+        goto cleanup;
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    printf("Tracing IPIs... Hit Ctrl-C to end.\n");
+
+    /* main: poll */
+    while (!exiting) {
+        sleep(env.interval);
+        printf("\n");
+
+        if (env.timestamp)
+            print_timestamp();
+
+        if (can_send) {
+            err = print_sends(obj);
+            if (err)
+                break;
+            printf("\n");
+        }
+        if (can_recv) {
+            err = print_recvs(obj);
+            if (err)
+                break;
+        }
+
+        if (--env.times == 0)
+            break;
+    }
+
+cleanup:
+    ipis_bpf__destroy(obj);
+
+    return err != 0;
+}
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __IPIS_H
+#define __IPIS_H
+
+/**
+ * @file ipis.h
+ * @brief Definitions shared between ipis.bpf.c and its userspace front-end
+ */
+
+#define MAX_SLOTS 20
+#define IPI_REASON_LEN 32
+#define MAX_IPI_CPUS 4096 /* Largest CPU count the cpumask scan handles */
+#define MAX_IPI_PAIRS 16384 /* Distinct (callback, sender, receiver) tracked */
+#define MAX_IPI_RECV 4096 /* Distinct (receiver, reason) tracked */
+
+/**
+ * @struct ipi_send_key
+ * @brief One sender/receiver pair of IPIs asking for the same work
+ */
+struct ipi_send_key {
+    __u64 callback; /* Function run on the receiver, 0 for reschedule IPIs */
+    __u32 src; /* Sending CPU */
+    __u32 dst; /* Receiving CPU */
+};
+
+/**
+ * @struct ipi_recv_key
+ * @brief IPIs handled on one CPU for one reason
+ */
+struct ipi_recv_key {
+    __u32 cpu; /* Receiving CPU */
+    char reason[IPI_REASON_LEN]; /* IPI type as named by the receive tracepoint */
+};
+
+/**
+ * @struct ipi_recv_info
+ * @brief Delivery latency and handler time of received IPIs
+ */
+struct ipi_recv_info {
+    __u64 count; /* IPIs handled */
+    __u64 lat_count; /* Of which a send was seen for, i.e. with a latency */
+    __u64 lat_total; /* Summed send-to-handler latency in the tool's unit */
+    __u64 run_total; /* Summed handler time in the tool's unit */
+    __u32 lat_slots[MAX_SLOTS]; /* log2 histogram of send-to-handler latency */
+    __u32 run_slots[MAX_SLOTS]; /* log2 histogram of handler time */
+};
+
+#endif /* __IPIS_H */
@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file ksyms.cpp
+ * @brief Kernel symbolizer backed by a compact index of /proc/kallsyms
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <bpf/bpf.h>
+#include "ksyms.hpp"
+
+/* Eytzinger slots per cache line, how far ahead the search prefetches */
+#define EYT_PREFETCH_STRIDE (64 / sizeof(unsigned long))
+
+struct raw_sym {
+    unsigned long addr;
+    uint32_t name_off;
+    uint32_t mod_off;
+};
+
+static const uint32_t NO_MODULE = UINT32_MAX;
+
+static bool is_text(char type)
+{
+    return type == 't' || type == 'T' || type == 'w' || type == 'W';
+}
+
+static int read_file(const char *path, std::vector<char> &buf)
+{
+    size_t len = 0;
+    FILE *f;
+
+    /* /proc/kallsyms reports a size of 0, so read until EOF */
+    f = fopen(path, "r");
+    if (!f)
+        return -errno;
+    buf.resize(1 << 20);
+    for (;;) {
+        size_t n = fread(buf.data() + len, 1, buf.size() - len, f);
+
+        len += n;
+        if (len < buf.size())
+            break;
+        buf.resize(buf.size() * 2);
+    }
+    if (ferror(f)) {
+        fclose(f);
+        return -EIO;
+    }
+    fclose(f);
+    buf.resize(len);
+    buf.push_back('\0');
+    return 0;
+}
+
+static uint32_t add_string(std::vector<char> &strtab, const char *s, size_t len)
+{
+    uint32_t off = strtab.size();
+
+    strtab.insert(strtab.end(), s, s + len);
+    strtab.push_back('\0');
+    return off;
+}
+
+int Ksyms::load(const char *path)
+{
+    std::unordered_map<std::string, uint32_t> modules;
+    std::vector<struct raw_sym> raw;
+    std::vector<char> buf;
+    char *p, *end;
+    int err;
+
+    err = read_file(path, buf);
+    if (err)
+        return err;
+
+    syms_.clear();
+    eyt_.clear();
+    eyt_rank_.clear();
+    strtab_.clear();
+
+    /* "<addr> <type> <name>[\t[<module>]]\n" */
+    for (p = buf.data(); *p; p = end) {
+        unsigned long addr = strtoul(p, &end, 16);
+        const char *name, *mod = nullptr;
+        size_t name_len, mod_len = 0;
+        char type;
+
+        if (end == p || *end != ' ')
+            return -EINVAL;
+        type = end[1];
+        name = end + 3;
+        name_len = strcspn(name, " \t\n");
+        end = (char *)name + name_len;
+        if (*end == '\t' && end[1] == '[') {
+            mod = end + 2;
+            mod_len = strcspn(mod, "]\n");
+            end = (char *)mod + mod_len;
+        }
+        end += strcspn(end, "\n");
+        if (*end)
+            end++;
+
+        if (!addr || !is_text(type))
+            continue;
+
+        struct raw_sym sym = { addr, add_string(strtab_, name, name_len), NO_MODULE };
+
+        if (mod) {
+            auto ins = modules.emplace(std::string(mod, mod_len), 0);
+
+            if (ins.second)
+                ins.first->second = add_string(strtab_, mod, mod_len);
+            sym.mod_off = ins.first->second;
+        }
+        raw.push_back(sym);
+    }
+
+    std::stable_sort(raw.begin(), raw.end(),
+                     [](const raw_sym &a, const raw_sym &b) { return a.addr < b.addr; });
+
+    /* strtab_ is final, pointers into it stay valid; keep the first alias per address */
+    syms_.reserve(raw.size());
+    for (const auto &r : raw) {
+        if (!syms_.empty() && syms_.back().addr == r.addr)
+            continue;
+        syms_.push_back({ r.addr, &strtab_[r.name_off],
+                          r.mod_off == NO_MODULE ? nullptr : &strtab_[r.mod_off] });
+    }
+
+    size_t rank = 0;
+
+    eyt_.resize(syms_.size() + 1);
+    eyt_rank_.resize(syms_.size() + 1);
+    build_eytzinger(rank, 1);
+    return 0;
+}
+
+void Ksyms::build_eytzinger(size_t &rank, size_t k)
+{
+    if (k >= eyt_.size())
+        return;
+    build_eytzinger(rank, 2 * k);
+    eyt_[k] = syms_[rank].addr;
+    eyt_rank_[k] = rank++;
+    build_eytzinger(rank, 2 * k + 1);
+}
+
+const struct ksym *Ksyms::lookup(unsigned long addr) const
+{
+    const unsigned long *eyt = eyt_.data();
+    size_t n = syms_.size();
+    size_t k = 1;
+
+    if (!n)
+        return nullptr;
+
+    /* Descend to the first element greater than addr */
+    while (k <= n) {
+        __builtin_prefetch(eyt + k * EYT_PREFETCH_STRIDE);
+        k = 2 * k + (eyt[k] <= addr);
+    }
+    k >>= __builtin_ffsl(~k);
+
+    /* k == 0: every symbol starts at or below addr */
+    if (!k)
+        return &syms_[n - 1];
+    if (!eyt_rank_[k])
+        return nullptr;
+    return &syms_[eyt_rank_[k] - 1];
+}
+
+const struct ksym *Ksyms::lookup_bsearch(unsigned long addr) const
+{
+    auto it = std::upper_bound(syms_.begin(), syms_.end(), addr,
+                               [](unsigned long a, const ksym &s) { return a < s.addr; });
+
+    if (it == syms_.begin())
+        return nullptr;
+    return &*(it - 1);
+}
+
+const std::vector<std::string> *StackSymbolizer::resolve(int32_t stack_id)
+{
+    std::vector<unsigned long> ips(max_depth_);
+    std::vector<std::string> frames;
+    char buf[512];
+
+    auto it = cache_.find(stack_id);
+    if (it != cache_.end())
+        return &it->second;
+
+    if (stack_id < 0 || bpf_map_lookup_elem(stacks_fd_, &stack_id, ips.data()))
+        return nullptr;
+
+    for (unsigned long ip : ips) {
+        const struct ksym *sym;
+
+        if (!ip)
+            break;
+        sym = ksyms_.lookup(ip);
+        if (!sym)
+            snprintf(buf, sizeof(buf), "%016lx [unknown]", ip);
+        else if (sym->module)
+            snprintf(buf, sizeof(buf), "%016lx %s+0x%lx [%s]", ip, sym->name,
+                     ip - sym->addr, sym->module);
+        else
+            snprintf(buf, sizeof(buf), "%016lx %s+0x%lx", ip, sym->name, ip - sym->addr);
+        frames.emplace_back(buf);
+    }
+    return &cache_.emplace(stack_id, std::move(frames)).first->second;
+}
@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __KSYMS_HPP
+#define __KSYMS_HPP
+
+/**
+ * @file ksyms.hpp
+ * @brief Kernel symbolizer backed by a compact index of /proc/kallsyms
+ *
+ * /proc/kallsyms is parsed once into:
+ * - an array of symbol start addresses in Eytzinger (BFS) order, the only
+ *   data touched while searching, so the top levels of the implicit tree
+ *   share cache lines and the next levels can be prefetched;
+ * - an address-sorted array of (addr, name, module) entries whose strings
+ *   live in one shared string table, touched once per resolved address.
+ *
+ * Only text symbols are indexed since the index is meant for stack frames.
+ * Stacks captured into a BPF_MAP_TYPE_STACK_TRACE map are resolved once per
+ * stack id by StackSymbolizer and served from its cache afterwards.
+ */
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ksym {
+    unsigned long addr; /* Symbol start address */
+    const char *name; /* Symbol name */
+    const char *module; /* Module name, nullptr for vmlinux */
+};
+
+class Ksyms {
+public:
+    Ksyms() = default;
+    /* The ksym names point into strtab_, a copy would point into ours */
+    Ksyms(const Ksyms &) = delete;
+    Ksyms &operator=(const Ksyms &) = delete;
+
+    /**
+     * load - Read a kallsyms file and build the index
+     * @path: File in /proc/kallsyms format
+     *
+     * @return 0 on success, negative errno otherwise
+     */
+    int load(const char *path = "/proc/kallsyms");
+
+    /**
+     * lookup - Find the symbol containing an address
+     * @addr: Kernel address
+     *
+     * @return the closest symbol starting at or below addr, or nullptr
+     */
+    const struct ksym *lookup(unsigned long addr) const;
+
+    /**
+     * lookup_bsearch - Reference binary search over the sorted array
+     * @addr: Kernel address
+     *
+     * Same result as lookup(); kept to validate and benchmark the
+     * Eytzinger search against.
+     */
+    const struct ksym *lookup_bsearch(unsigned long addr) const;
+
+    size_t size() const { return syms_.size(); }
+    const std::vector<struct ksym> &symbols() const { return syms_; }
+
+private:
+    void build_eytzinger(size_t &rank, size_t k);
+
+    std::vector<struct ksym> syms_; /* Sorted by address */
+    std::vector<unsigned long> eyt_; /* Addresses in Eytzinger order, 1-based */
+    std::vector<uint32_t> eyt_rank_; /* Index into syms_ for each eyt_ slot */
+    std::vector<char> strtab_; /* NUL-separated symbol and module names */
+};
+
+/**
+ * @class StackSymbolizer
+ * @brief Resolves stack ids of a STACK_TRACE map, caching each stack
+ *
+ * Stack ids are stable as long as the map is not created with
+ * BPF_F_REUSE_STACKID and entries are not deleted, which holds for the
+ * programs in this repository.
+ */
+class StackSymbolizer {
+public:
+    StackSymbolizer(const Ksyms &ksyms, int stacks_fd, int max_depth)
+        : ksyms_(ksyms), stacks_fd_(stacks_fd), max_depth_(max_depth) {}
+
+    /**
+     * resolve - Symbolized frames of a stack, one "addr sym+off [mod]" each
+     * @stack_id: Id returned by bpf_get_stackid()
+     *
+     * @return the frames, or nullptr if the stack is not in the map
+     */
+    const std::vector<std::string> *resolve(int32_t stack_id);
+
+private:
+    const Ksyms &ksyms_;
+    int stacks_fd_;
+    int max_depth_;
+    std::unordered_map<int32_t, std::vector<std::string>> cache_;
+};
+
+#endif /* __KSYMS_HPP */
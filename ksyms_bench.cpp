@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file ksyms_bench.cpp
+ * @brief Load time and lookups/sec of the kallsyms index
+ *
+ * Usage: ksyms_bench [kallsyms path] [lookups]
+ *
+ * Random addresses inside the indexed text range are resolved with both the
+ * Eytzinger search and the reference binary search; results are checked to
+ * agree before timings are reported.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "ksyms.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+template <typename Lookup>
+static double run(const std::vector<unsigned long> &addrs, Lookup lookup, unsigned long *sink)
+{
+    auto start = bench_clock::now();
+    unsigned long acc = 0;
+
+    for (unsigned long addr : addrs) {
+        const struct ksym *sym = lookup(addr);
+
+        acc += sym ? sym->addr : 0;
+    }
+    *sink += acc;
+    return addrs.size() / seconds_since(start);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "/proc/kallsyms";
+    size_t nr_lookups = argc > 2 ? strtoul(argv[2], nullptr, 0) : 1 << 22;
+    std::mt19937_64 rng(42);
+    std::vector<unsigned long> addrs;
+    unsigned long sink = 0;
+    Ksyms ksyms;
+    int err;
+
+    auto start = bench_clock::now();
+    err = ksyms.load(path);
+    if (err) {
+        fprintf(stderr, "failed to load %s: %d\n", path, err);
+        return 1;
+    }
+    printf("load: %zu text symbols in %.1f ms\n", ksyms.size(), seconds_since(start) * 1e3);
+    if (!ksyms.size() || !nr_lookups) {
+        fprintf(stderr, "nothing to look up (kptr_restrict?)\n");
+        return 1;
+    }
+
+    const auto &syms = ksyms.symbols();
+    std::uniform_int_distribution<size_t> pick(0, syms.size() - 1);
+    std::uniform_int_distribution<unsigned long> offset(0, 0x400);
+
+    /* Addresses near symbol starts, like return addresses in a stack */
+    addrs.reserve(nr_lookups);
+    for (size_t i = 0; i < nr_lookups; i++)
+        addrs.push_back(syms[pick(rng)].addr + offset(rng));
+
+    for (unsigned long addr : addrs) {
+        if (ksyms.lookup(addr) != ksyms.lookup_bsearch(addr)) {
+            fprintf(stderr, "mismatch at %016lx\n", addr);
+            return 1;
+        }
+    }
+
+    double bsearch = run(addrs, [&](unsigned long a) { return ksyms.lookup_bsearch(a); }, &sink);
+    double eytzinger = run(addrs, [&](unsigned long a) { return ksyms.lookup(a); }, &sink);
+
+    printf("binary search: %10.0f lookups/sec\n", bsearch);
+    printf("eytzinger:     %10.0f lookups/sec (%.2fx)\n", eytzinger, eytzinger / bsearch);
+    return sink == 0;
+}
@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file map_report.cpp
+ * @brief Memory, occupancy and sizing report for loaded BPF maps
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "map_report.hpp"
+
+unsigned long long map_memlock(int fd)
+{
+    unsigned long long memlock = 0;
+    char path[64], line[128];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", fd);
+    f = fopen(path, "r");
+    if (!f)
+        return 0;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "memlock: %llu", &memlock) == 1)
+            break;
+    fclose(f);
+    return memlock;
+}
+
+/* Maps whose occupancy is their key count */
+static bool keyed(uint32_t type)
+{
+    switch (type) {
+    case BPF_MAP_TYPE_HASH:
+    case BPF_MAP_TYPE_PERCPU_HASH:
+    case BPF_MAP_TYPE_LRU_HASH:
+    case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+    case BPF_MAP_TYPE_STACK_TRACE:
+    case BPF_MAP_TYPE_LPM_TRIE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool lru(uint32_t type)
+{
+    return type == BPF_MAP_TYPE_LRU_HASH || type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+}
+
+/* Preallocated hash maps, whose memory is proportional to max_entries */
+static bool scales(const struct map_usage &u)
+{
+    switch (u.type) {
+    case BPF_MAP_TYPE_HASH:
+    case BPF_MAP_TYPE_PERCPU_HASH:
+    case BPF_MAP_TYPE_LRU_HASH:
+    case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+        return !(u.map_flags & BPF_F_NO_PREALLOC);
+    default:
+        return false;
+    }
+}
+
+static uint32_t round_pow2(uint64_t n)
+{
+    uint64_t p = 1;
+
+    while (p < n && p < (1ULL << 31))
+        p <<= 1;
+    return p;
+}
+
+uint32_t map_recommend(const struct map_usage &u)
+{
+    uint64_t need = u.peak;
+
+    if (!keyed(u.type))
+        return 0;
+    /*
+     * Failed inserts count events, not distinct keys, and a full LRU map
+     * evicts silently: either way the demand is unknown, so double.
+     */
+    if ((u.fails && u.fails != MAP_FAILS_UNKNOWN) || (lru(u.type) && u.peak >= u.max_entries))
+        need = std::max<uint64_t>(u.peak, u.max_entries) * 2;
+    return round_pow2(std::max<uint64_t>(need + need / 4, 1));
+}
+
+MapReport::~MapReport()
+{
+    for (int fd : fds_)
+        close(fd);
+}
+
+int MapReport::add(int fd)
+{
+    struct bpf_map_info info = {};
+    __u32 len = sizeof(info);
+    struct map_usage u = {};
+    int err, dup_fd;
+
+    err = bpf_map_get_info_by_fd(fd, &info, &len);
+    if (err)
+        return err;
+    dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dup_fd < 0)
+        return -errno;
+
+    u.name = info.name;
+    u.id = info.id;
+    u.type = info.type;
+    u.key_size = info.key_size;
+    u.value_size = info.value_size;
+    u.max_entries = info.max_entries;
+    u.map_flags = info.map_flags;
+    u.memlock = map_memlock(dup_fd);
+    u.entries = keyed(u.type) ? 0 : u.max_entries;
+    u.peak = u.entries;
+    u.fails = MAP_FAILS_UNKNOWN;
+    fds_.push_back(dup_fd);
+    usage_.push_back(u);
+    return 0;
+}
+
+int MapReport::add_id(uint32_t id)
+{
+    int fd, err;
+
+    fd = bpf_map_get_fd_by_id(id);
+    if (fd < 0)
+        return -errno;
+    err = add(fd);
+    close(fd);
+    return err;
+}
+
+void MapReport::sample()
+{
+    for (size_t i = 0; i < fds_.size(); i++) {
+        struct map_usage &u = usage_[i];
+        std::vector<char> key(u.key_size), next(u.key_size);
+        const void *prev = nullptr;
+        uint32_t n = 0;
+
+        if (!keyed(u.type))
+            continue;
+        /* A key deleted under us restarts the walk, so stop at max_entries */
+        while (n < u.max_entries && !bpf_map_get_next_key(fds_[i], prev, next.data())) {
+            n++;
+            key.swap(next);
+            prev = key.data();
+        }
+        u.entries = n;
+        u.peak = std::max(u.peak, n);
+    }
+}
+
+void MapReport::set_fails(const char *name, uint64_t fails)
+{
+    for (auto &u : usage_)
+        if (u.name == name)
+            u.fails = fails;
+}
+
+void MapReport::print(FILE *out) const
+{
+    unsigned long long total = 0, total_rec = 0;
+    bool approx = false;
+
+    fprintf(out, "%-16s %-16s %5s %6s %8s %8s %8s %10s %9s %10s\n", "MAP", "TYPE", "KEY",
+            "VALUE", "MAX", "PEAK", "FAILS", "MEM_KiB", "RECOMMEND", "REC_KiB");
+    for (const auto &u : usage_) {
+        const char *type = libbpf_bpf_map_type_str((enum bpf_map_type)u.type);
+        uint32_t rec = map_recommend(u);
+        unsigned long long rec_mem = rec && u.max_entries ?
+                                             u.memlock * rec / u.max_entries : u.memlock;
+        char fails[24] = "-", peak[16] = "-", recs[16] = "-", rec_kib[24];
+
+        if (u.fails != MAP_FAILS_UNKNOWN)
+            snprintf(fails, sizeof(fails), "%llu", (unsigned long long)u.fails);
+        if (keyed(u.type))
+            snprintf(peak, sizeof(peak), "%u", u.peak);
+        if (rec)
+            snprintf(recs, sizeof(recs), "%u", rec);
+        /* Resized maps that are not preallocated hashes get a rough guess */
+        if (rec && rec != u.max_entries && !scales(u)) {
+            snprintf(rec_kib, sizeof(rec_kib), "~%llu", rec_mem / 1024);
+            approx = true;
+        } else {
+            snprintf(rec_kib, sizeof(rec_kib), "%llu", rec_mem / 1024);
+        }
+        fprintf(out, "%-16s %-16s %5u %6u %8u %8s %8s %10llu %9s %10s%s\n", u.name.c_str(),
+                type ? type : "?", u.key_size, u.value_size, u.max_entries, peak, fails,
+                u.memlock / 1024, recs, rec_kib, rec > u.max_entries ? "  (grow)" : "");
+        total += u.memlock;
+        total_rec += rec_mem;
+    }
+    fprintf(out, "%zu maps, %llu KiB now, %s%llu KiB at the recommended sizes\n",
+            usage_.size(), total / 1024, approx ? "~" : "", total_rec / 1024);
+}
@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __MAP_REPORT_HPP
+#define __MAP_REPORT_HPP
+
+/**
+ * @file map_report.hpp
+ * @brief Memory, occupancy and sizing report for loaded BPF maps
+ *
+ * Map geometry comes from bpf_map_info and the memory charged to each map
+ * from the "memlock:" line of its fdinfo, which is what the kernel counts
+ * against the memcg. Occupancy is the number of keys found by walking the
+ * map; sample() is meant to be called just before a front-end drains its
+ * maps, so the peak it keeps is the most a map had to hold at once.
+ *
+ * Inserts that failed because a map was full are invisible from userspace;
+ * programs that count them (see hardirqs' init_fails) hand the totals over
+ * with set_fails(). The recommended size leaves a quarter of headroom over
+ * the peak, rounded up to a power of two; maps that lost inserts, and LRU
+ * maps that filled up and so evicted, are doubled instead, since how many
+ * keys they were short of is unknown. The memory at that size is scaled
+ * from the current one, which only holds for preallocated hash maps; the
+ * other estimates are printed with a "~".
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/* init_fails not reported by the program */
+#define MAP_FAILS_UNKNOWN UINT64_MAX
+
+struct map_usage {
+    std::string name;
+    uint32_t id;
+    uint32_t type;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t max_entries;
+    uint32_t map_flags;
+    unsigned long long memlock; /* Bytes charged to the map */
+    uint32_t entries; /* Keys at the last sample, max_entries for arrays */
+    uint32_t peak; /* Most keys seen in one sample */
+    uint64_t fails; /* Inserts lost to a full map, or MAP_FAILS_UNKNOWN */
+};
+
+/**
+ * map_memlock - Memory charged to a map, as the kernel accounts it in fdinfo
+ * @fd: Map file descriptor
+ *
+ * @return bytes, 0 if fdinfo could not be read
+ */
+unsigned long long map_memlock(int fd);
+
+/**
+ * map_recommend - Smallest power-of-two size with headroom for what was seen
+ * @u: Sampled usage
+ *
+ * @return the recommended max_entries, 0 for map types that are not
+ * sized by their key count (arrays, ring buffers)
+ */
+uint32_t map_recommend(const struct map_usage &u);
+
+class MapReport {
+public:
+    MapReport() = default;
+    MapReport(const MapReport &) = delete;
+    MapReport &operator=(const MapReport &) = delete;
+    ~MapReport();
+
+    /**
+     * add - Track a map
+     * @fd: Map file descriptor, duplicated so the caller keeps its own
+     *
+     * @return 0, or a negative errno if the map info could not be read
+     */
+    int add(int fd);
+
+    /**
+     * add_id - Track a map by its kernel id
+     *
+     * @return 0, or a negative errno if the map is gone or not accessible
+     */
+    int add_id(uint32_t id);
+
+    /**
+     * sample - Count the keys of every tracked map and update the peaks
+     */
+    void sample();
+
+    /**
+     * set_fails - Failed inserts of a tracked map, by map name
+     */
+    void set_fails(const char *name, uint64_t fails);
+
+    /**
+     * print - One line per map, then the totals now and as recommended
+     */
+    void print(FILE *out = stdout) const;
+
+    const std::vector<map_usage> &maps() const { return usage_; }
+
+private:
+    std::vector<int> fds_;
+    std::vector<map_usage> usage_;
+};
+
+#endif /* __MAP_REPORT_HPP */
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file mapstat.cpp
+ * @brief Memory, peak occupancy and recommended size of loaded BPF maps
+ *
+ * Attaches to maps other tools have loaded, by id or by name, and counts
+ * their keys every interval; at the end (count reached or Ctrl-C) prints
+ * the memory charged to each map, the most keys it held in one sample and
+ * the size that would hold that peak with headroom. Sampling cannot see
+ * keys inserted and drained between two samples, or inserts lost to a full
+ * map, so a short interval matters for maps their tool drains; hardirqs -M
+ * samples right before draining and adds its counted failed inserts.
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "map_report.hpp"
+#include "trace_helpers.hpp"
+
+static struct env {
+    std::vector<unsigned int> ids;
+    std::vector<const char *> names;
+    bool timestamp;
+    int interval = 1;
+    int times = 1;
+} env;
+
+static const char usage[] =
+    "Usage: mapstat [OPTION...] [interval] [count]\n"
+    "Report memory, peak occupancy and recommended sizes of loaded BPF maps.\n"
+    "\n"
+    "  -i, --id=ID               Map with this id (repeatable)\n"
+    "  -n, --name=NAME           Maps whose name contains NAME (repeatable)\n"
+    "  -T, --timestamp           Include timestamp on output\n"
+    "  -h, --help                Show this help\n"
+    "\n"
+    "Without -i or -n every loaded map is reported. Occupancy is sampled\n"
+    "every interval seconds, count times, and the report printed at the end.\n"
+    "\n"
+    "Examples:\n"
+    "    mapstat                 # one sample of every map\n"
+    "    mapstat -n infos 1 300  # peak of the maps named *infos* over 5 minutes\n"
+    "    mapstat -i 42 -i 43 10  # maps 42 and 43 every 10s until Ctrl-C\n";
+
+static const struct option long_opts[] = {
+    { "id", required_argument, nullptr, 'i' },
+    { "name", required_argument, nullptr, 'n' },
+    { "timestamp", no_argument, nullptr, 'T' },
+    { "help", no_argument, nullptr, 'h' },
+    {},
+};
+
+static int parse_args(int argc, char **argv)
+{
+    unsigned long long val;
+    int pos_args;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "i:n:Th", long_opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'i':
+            if (!parse_ull(optarg, &val) || !val || val > UINT32_MAX) {
+                fprintf(stderr, "invalid map id: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.ids.push_back(val);
+            break;
+        case 'n':
+            env.names.push_back(optarg);
+            break;
+        case 'T':
+            env.timestamp = true;
+            break;
+        case 'h':
+            fputs(usage, stdout);
+            exit(0);
+        default:
+            fputs(usage, stderr);
+            return -EINVAL;
+        }
+    }
+
+    pos_args = parse_interval_count(argc, argv, &env.interval, &env.times);
+    if (pos_args < 0)
+        return -EINVAL;
+    /* An interval alone samples until Ctrl-C */
+    if (pos_args == 1)
+        env.times = 99999999;
+    return 0;
+}
+
+static bool wanted(__u32 id, const char *name)
+{
+    if (env.ids.empty() && env.names.empty())
+        return true;
+    for (unsigned int i : env.ids)
+        if (i == id)
+            return true;
+    for (const char *n : env.names)
+        if (strstr(name, n))
+            return true;
+    return false;
+}
+
+/**
+ * add_maps - Track the loaded maps selected on the command line
+ *
+ * @return the number of maps tracked, or a negative errno
+ */
+static int add_maps(MapReport &report)
+{
+    __u32 id = 0;
+    int n = 0;
+
+    while (!bpf_map_get_next_id(id, &id)) {
+        struct bpf_map_info info = {};
+        __u32 len = sizeof(info);
+        int fd, err;
+
+        fd = bpf_map_get_fd_by_id(id);
+        if (fd < 0) {
+            /* Freed since bpf_map_get_next_id() returned it */
+            if (errno == ENOENT)
+                continue;
+            return -errno;
+        }
+        err = bpf_map_get_info_by_fd(fd, &info, &len);
+        if (err || !wanted(id, info.name)) {
+            close(fd);
+            continue;
+        }
+        err = report.add(fd);
+        close(fd);
+        if (err)
+            return err;
+        n++;
+    }
+    if (errno != ENOENT)
+        return -errno;
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    MapReport report;
+    int err;
+
+    err = parse_args(argc, argv);
+    if (err)
+        return 1;
+
+    err = add_maps(report);
+    if (err < 0) {
+        fprintf(stderr, "failed to list BPF maps: %s\n", strerror(-err));
+        return 1;
+    }
+    if (!err) {
+        fprintf(stderr, "no matching BPF maps\n");
+        return 1;
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    for (int i = 0; i < env.times && !exiting; i++) {
+        if (i)
+            sleep(env.interval);
+        report.sample();
+    }
+
+    if (env.timestamp)
+        print_timestamp();
+    report.print();
+    return 0;
+}
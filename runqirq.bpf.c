@@ -0,0 +1,283 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/**
+ * @file runqirq.bpf.c
+ * @brief eBPF program measuring how much of run-queue latency is interrupt time
+ *
+ * A task becomes runnable (sched_wakeup, sched_wakeup_new, or preemption in
+ * sched_switch) and then waits on its CPU's run queue until sched_switch
+ * picks it. Hardirq and softirq time is accumulated per CPU the same way
+ * hardirqs.bpf.c times handlers, from per-CPU entry timestamps. Snapshotting
+ * that total on enqueue and again when the task is picked gives the part of
+ * the wait the CPU spent in interrupt context instead of running tasks.
+ *
+ * Latency and interrupt share are histogrammed per cgroup of the woken task.
+ * A task that migrates while waiting is charged the interrupt time of the
+ * CPU it was enqueued on.
+ */
+
+#include <vmlinux.h>
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include "runqirq.h"
+#include "bits.bpf.h"
+#include "maps.bpf.h"
+
+#define TASK_RUNNING 0
+
+/* Runtime configuration flags */
+const volatile bool targ_ns = false; /* use nanoseconds (true) or microseconds (false) */
+const volatile pid_t targ_tgid = 0; /* Only trace this process, 0 = all */
+
+/**
+ * @brief Interrupt time of each CPU
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct cpu_irq);
+} cpu_irqs SEC(".maps");
+
+/**
+ * @brief Tasks currently waiting on a run queue
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_WAKEUPS);
+    __type(key, u32);
+    __type(value, struct rq_start);
+} rq_starts SEC(".maps");
+
+/**
+ * @brief Per-cgroup histograms keyed by cgroup id
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_CGROUPS);
+    __type(key, u64);
+    __type(value, struct rq_hist);
+} hists SEC(".maps");
+
+static struct rq_hist zero;
+
+/* task_struct::state was renamed to __state in 5.14 */
+struct task_struct___o {
+    volatile long int state;
+} __attribute__((preserve_access_index));
+
+struct task_struct___x {
+    unsigned int __state;
+} __attribute__((preserve_access_index));
+
+static __always_inline __s64 get_task_state(void *task)
+{
+    struct task_struct___x *t = task;
+
+    if (bpf_core_field_exists(t->__state))
+        return BPF_CORE_READ(t, __state);
+    return BPF_CORE_READ((struct task_struct___o *)task, state);
+}
+
+/**
+ * irq_snapshot - Interrupt time of a CPU up to now
+ * @cpu: CPU to read, may be a remote one
+ * @now: Current timestamp in ns
+ * @hard: Set to the hardirq time
+ * @soft: Set to the softirq time
+ *
+ * Handlers still running are included up to now. A remote CPU may update
+ * its counters while they are read; the result is then off by at most the
+ * handler in flight, and callers clamp differences at 0.
+ *
+ * @return 0 on success, -1 if the CPU has no state
+ */
+static int irq_snapshot(u32 cpu, u64 now, u64 *hard, u64 *soft)
+{
+    struct cpu_irq *c;
+    u32 key = 0;
+    u64 hs, ss;
+
+    c = bpf_map_lookup_percpu_elem(&cpu_irqs, &key, cpu);
+    if (!c)
+        return -1;
+
+    *hard = c->hard_ns;
+    *soft = c->soft_ns;
+    hs = c->hard_start;
+    ss = c->soft_start;
+    if (hs && hs < now)
+        *hard += now - hs;
+    if (ss && ss < now) {
+        u64 nested = *hard - c->soft_hard_base;
+        u64 elapsed = now - ss;
+
+        if (elapsed > nested)
+            *soft += elapsed - nested;
+    }
+    return 0;
+}
+
+/**
+ * trace_enqueue - Start timing a task that became runnable
+ * @p: Task
+ * @cpu: Run queue the task waits on
+ */
+static int trace_enqueue(struct task_struct *p, u32 cpu)
+{
+    struct rq_start rs = {};
+    u32 pid = BPF_CORE_READ(p, pid);
+
+    if (!pid)
+        return 0;
+    if (targ_tgid && targ_tgid != BPF_CORE_READ(p, tgid))
+        return 0;
+
+    rs.ts = bpf_ktime_get_ns();
+    rs.cpu = cpu;
+    if (irq_snapshot(cpu, rs.ts, &rs.hard_ns, &rs.soft_ns))
+        return 0;
+    bpf_map_update_elem(&rq_starts, &pid, &rs, BPF_ANY);
+    return 0;
+}
+
+/**
+ * trace_pick - Account the run-queue wait of the task being switched in
+ * @next: Task picked by the scheduler
+ */
+static int trace_pick(struct task_struct *next)
+{
+    u32 pid = BPF_CORE_READ(next, pid);
+    u64 now, delta, hard, soft, irq, slot;
+    struct rq_start *rs;
+    struct rq_hist *h;
+    u64 cgid;
+
+    rs = bpf_map_lookup_elem(&rq_starts, &pid);
+    if (!rs)
+        return 0;
+
+    now = bpf_ktime_get_ns();
+    if (now < rs->ts || irq_snapshot(rs->cpu, now, &hard, &soft))
+        goto cleanup;
+
+    delta = now - rs->ts;
+    hard = hard > rs->hard_ns ? hard - rs->hard_ns : 0;
+    soft = soft > rs->soft_ns ? soft - rs->soft_ns : 0;
+    if (hard > delta)
+        hard = delta;
+    if (soft > delta - hard)
+        soft = delta - hard;
+
+    cgid = BPF_CORE_READ(next, cgroups, dfl_cgrp, kn, id);
+    h = bpf_map_lookup_or_try_init(&hists, &cgid, &zero);
+    if (!h)
+        goto cleanup;
+
+    __sync_fetch_and_add(&h->count, 1);
+    __sync_fetch_and_add(&h->total_ns, delta);
+    __sync_fetch_and_add(&h->hard_ns, hard);
+    __sync_fetch_and_add(&h->soft_ns, soft);
+
+    irq = hard + soft;
+    if (!targ_ns) {
+        delta /= 1000U;
+        irq /= 1000U;
+    }
+    slot = log2l(delta);
+    if (slot >= MAX_SLOTS)
+        slot = MAX_SLOTS - 1;
+    __sync_fetch_and_add(&h->slots[slot], 1);
+    slot = log2l(irq);
+    if (slot >= MAX_SLOTS)
+        slot = MAX_SLOTS - 1;
+    __sync_fetch_and_add(&h->irq_slots[slot], 1);
+
+cleanup:
+    bpf_map_delete_elem(&rq_starts, &pid);
+    return 0;
+}
+
+SEC("tp_btf/sched_wakeup")
+int BPF_PROG(sched_wakeup, struct task_struct *p)
+{
+    return trace_enqueue(p, BPF_CORE_READ(p, wake_cpu));
+}
+
+SEC("tp_btf/sched_wakeup_new")
+int BPF_PROG(sched_wakeup_new, struct task_struct *p)
+{
+    return trace_enqueue(p, BPF_CORE_READ(p, wake_cpu));
+}
+
+SEC("tp_btf/sched_switch")
+int BPF_PROG(sched_switch, bool preempt, struct task_struct *prev, struct task_struct *next)
+{
+    /* A preempted task goes straight back to the run queue */
+    if (get_task_state(prev) == TASK_RUNNING)
+        trace_enqueue(prev, bpf_get_smp_processor_id());
+    return trace_pick(next);
+}
+
+SEC("tp_btf/irq_handler_entry")
+int BPF_PROG(irq_handler_entry, int irq, struct irqaction *action)
+{
+    struct cpu_irq *c;
+    u32 key = 0;
+
+    c = bpf_map_lookup_elem(&cpu_irqs, &key);
+    if (c)
+        c->hard_start = bpf_ktime_get_ns();
+    return 0;
+}
+
+SEC("tp_btf/irq_handler_exit")
+int BPF_PROG(irq_handler_exit, int irq, struct irqaction *action)
+{
+    struct cpu_irq *c;
+    u32 key = 0;
+
+    c = bpf_map_lookup_elem(&cpu_irqs, &key);
+    if (!c || !c->hard_start)
+        return 0;
+    c->hard_ns += bpf_ktime_get_ns() - c->hard_start;
+    c->hard_start = 0;
+    return 0;
+}
+
+SEC("tp_btf/softirq_entry")
+int BPF_PROG(softirq_entry, unsigned int vec_nr)
+{
+    struct cpu_irq *c;
+    u32 key = 0;
+
+    c = bpf_map_lookup_elem(&cpu_irqs, &key);
+    if (!c)
+        return 0;
+    c->soft_hard_base = c->hard_ns;
+    c->soft_start = bpf_ktime_get_ns();
+    return 0;
+}
+
+SEC("tp_btf/softirq_exit")
+int BPF_PROG(softirq_exit, unsigned int vec_nr)
+{
+    struct cpu_irq *c;
+    u64 elapsed, nested;
+    u32 key = 0;
+
+    c = bpf_map_lookup_elem(&cpu_irqs, &key);
+    if (!c || !c->soft_start)
+        return 0;
+
+    /* Hardirqs that interrupted the softirq were already counted */
+    elapsed = bpf_ktime_get_ns() - c->soft_start;
+    nested = c->hard_ns - c->soft_hard_base;
+    if (elapsed > nested)
+        c->soft_ns += elapsed - nested;
+    c->soft_start = 0;
+    return 0;
+}
+
+char LICENSE[] SEC("license") = "GPL";
@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * @file runqirq.cpp
+ * @brief Userspace front-end for runqirq.bpf.c
+ *
+ * Prints, per cgroup, how long woken tasks waited on a run queue and how
+ * much of that wait the CPU spent in hardirq and softirq context, every
+ * interval. With -d the latency and interrupt-share histograms follow.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "runqirq.h"
+#include "runqirq.skel.h"
+#include "trace_helpers.hpp"
+
+static struct env {
+    bool distributed;
+    bool nanoseconds;
+    bool timestamp;
+    bool verbose;
+    pid_t pid;
+    int interval = 99999999;
+    int times = 99999999;
+} env;
+
+
+static const char usage[] =
+    "Usage: runqirq [OPTION...] [interval] [count]\n"
+    "Summarize run queue latency per cgroup and the part of it lost to\n"
+    "hardirqs and softirqs.\n"
+    "\n"
+    "  -d, --distributed         Show latency and interrupt share histograms\n"
+    "  -p, --pid=PID             Trace this process only\n"
+    "  -N, --nanoseconds         Output in nanoseconds\n"
+    "  -T, --timestamp           Include timestamp on output\n"
+    "  -v, --verbose             Verbose debug output\n"
+    "  -h, --help                Show this help\n"
+    "\n"
+    "Examples:\n"
+    "    runqirq 1           # per-cgroup summary every second\n"
+    "    runqirq -d 10 3     # with histograms, every 10s, 3 times\n"
+    "    runqirq -p 185      # only threads of PID 185\n";
+
+static const struct option long_opts[] = {
+    { "distributed", no_argument, nullptr, 'd' },
+    { "pid", required_argument, nullptr, 'p' },
+    { "nanoseconds", no_argument, nullptr, 'N' },
+    { "timestamp", no_argument, nullptr, 'T' },
+    { "verbose", no_argument, nullptr, 'v' },
+    { "help", no_argument, nullptr, 'h' },
+    {},
+};
+
+static int parse_args(int argc, char **argv)
+{
+    unsigned long long val;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "dp:NTvh", long_opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'd':
+            env.distributed = true;
+            break;
+        case 'p':
+            if (!parse_ull(optarg, &val) || !val || val > INT32_MAX) {
+                fprintf(stderr, "invalid PID: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.pid = val;
+            break;
+        case 'N':
+            env.nanoseconds = true;
+            break;
+        case 'T':
+            env.timestamp = true;
+            break;
+        case 'v':
+            env.verbose = true;
+            break;
+        case 'h':
+            fputs(usage, stdout);
+            exit(0);
+        default:
+            fputs(usage, stderr);
+            return -EINVAL;
+        }
+    }
+
+    if (parse_interval_count(argc, argv, &env.interval, &env.times) < 0)
+        return -EINVAL;
+    return 0;
+}
+
+struct cg_entry {
+    unsigned long long id;
+    struct rq_hist hist;
+};
+
+/**
+ * print_hists - Print and reset the per-cgroup run-queue statistics
+ * @obj: Loaded skeleton
+ *
+ * Cgroups are sorted by the interrupt time their tasks waited through.
+ */
+static int print_hists(struct runqirq_bpf *obj)
+{
+    const char *units = env.nanoseconds ? "nsecs" : "usecs";
+    unsigned long long div = env.nanoseconds ? 1 : 1000;
+    int fd = bpf_map__fd(obj->maps.hists);
+    std::vector<struct cg_entry> cgroups;
+    __u64 key, next_key, *prev = nullptr;
+    int err;
+
+    while (!bpf_map_get_next_key(fd, prev, &next_key)) {
+        struct cg_entry e = { next_key, {} };
+
+        key = next_key;
+        prev = &key;
+        err = bpf_map_lookup_elem(fd, &next_key, &e.hist);
+        if (err < 0) {
+            fprintf(stderr, "failed to lookup hists: %d\n", err);
+            return -1;
+        }
+        cgroups.push_back(e);
+    }
+    for (const auto &e : cgroups)
+        bpf_map_delete_elem(fd, &e.id);
+
+    std::sort(cgroups.begin(), cgroups.end(), [](const cg_entry &a, const cg_entry &b) {
+        return a.hist.hard_ns + a.hist.soft_ns > b.hist.hard_ns + b.hist.soft_ns;
+    });
+
+    printf("%-40s %10s %8s%5s %7s %7s\n", "CGROUP", "WAKEUPS", "AVG_", units, "HARD%",
+           "SOFT%");
+    for (const auto &e : cgroups) {
+        const struct rq_hist &h = e.hist;
+        double total = h.total_ns ? (double)h.total_ns : 1.0;
+
+        printf("%-40s %10llu %13llu %6.2f%% %6.2f%%\n", cgroup_name(e.id).c_str(),
+               (unsigned long long)h.count,
+               h.count ? (unsigned long long)(h.total_ns / h.count / div) : 0ULL,
+               100.0 * h.hard_ns / total, 100.0 * h.soft_ns / total);
+    }
+
+    if (!env.distributed)
+        return 0;
+    for (const auto &e : cgroups) {
+        printf("\ncgroup = %s, run queue latency\n", cgroup_name(e.id).c_str());
+        print_log2_hist(e.hist.slots, MAX_SLOTS, units);
+        printf("\ncgroup = %s, interrupt time while queued\n", cgroup_name(e.id).c_str());
+        print_log2_hist(e.hist.irq_slots, MAX_SLOTS, units);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct runqirq_bpf *obj;
+    int err;
+
+    err = parse_args(argc, argv);
+    if (err)
+        return 1;
+
+    set_libbpf_print(env.verbose);
+
+    /* Remote run queues are read with bpf_map_lookup_percpu_elem, tp_btf is implied */
+    if (!probe_tp_btf("sched_switch")) {
+        fprintf(stderr, "kernel lacks BTF-enabled tracepoints\n");
+        return 1;
+    }
+
+    obj = runqirq_bpf__open();
+    if (!obj) {
+        fprintf(stderr, "failed to open BPF object\n");
+        return 1;
+    }
+
+    obj->rodata->targ_ns = env.nanoseconds;
+    obj->rodata->targ_tgid = env.pid;
+
+    err = runqirq_bpf__load(obj);
+    if (err) {
+        fprintf(stderr, "failed to load BPF object: %d\n", err);
+        goto cleanup;
+    }
+
+    err = runqirq_bpf__attach(obj);
+    if (err) {
+        fprintf(stderr, "failed to attach BPF programs\n");
+        goto cleanup;
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    printf("Tracing run queue latency and interrupt time... Hit Ctrl-C to end.\n");
+
+    /* main: poll */
+    while (!exiting) {
+        sleep(env.interval);
+        printf("\n");
+
+        if (env.timestamp)
+            print_timestamp();
+
+        err = print_hists(obj);
+        if (err)
+            break;
+
+        if (--env.times == 0)
+            break;
+    }
+
+cleanup:
+    runqirq_bpf__destroy(obj);
+
+    return err != 0;
+}
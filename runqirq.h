@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __RUNQIRQ_H
+#define __RUNQIRQ_H
+
+/**
+ * @file runqirq.h
+ * @brief Definitions shared between runqirq.bpf.c and its userspace front-end
+ */
+
+#define MAX_SLOTS 26
+#define MAX_CGROUPS 1024
+#define MAX_WAKEUPS 10240
+
+/**
+ * @struct cpu_irq
+ * @brief Interrupt time of one CPU, single entry of a per-CPU array
+ *
+ * Only the owning CPU writes it. Other CPUs read it to snapshot the
+ * interrupt time of the run queue a task is woken onto.
+ */
+struct cpu_irq {
+    __u64 hard_start; /* Entry of the running hardirq, 0 if none */
+    __u64 soft_start; /* Entry of the running softirq, 0 if none */
+    __u64 soft_hard_base; /* hard_ns when the running softirq was entered */
+    __u64 hard_ns; /* Total hardirq time so far */
+    __u64 soft_ns; /* Total softirq time so far, hardirqs nested in it excluded */
+};
+
+/**
+ * @struct rq_start
+ * @brief State of a task waiting on a run queue, keyed by thread id
+ */
+struct rq_start {
+    __u64 ts; /* Time the task was enqueued */
+    __u64 hard_ns; /* cpu_irq.hard_ns of the target CPU at enqueue */
+    __u64 soft_ns; /* cpu_irq.soft_ns of the target CPU at enqueue */
+    __u32 cpu; /* CPU the task was enqueued on */
+    __u32 pad;
+};
+
+/**
+ * @struct rq_hist
+ * @brief Run-queue latency and its interrupt share for one cgroup
+ */
+struct rq_hist {
+    __u64 count; /* Run-queue waits ended */
+    __u64 total_ns; /* Summed run-queue latency */
+    __u64 hard_ns; /* Part of it spent in hardirqs on the waiting CPU */
+    __u64 soft_ns; /* Part of it spent in softirqs on the waiting CPU */
+    __u32 slots[MAX_SLOTS]; /* log2 histogram of run-queue latency */
+    __u32 irq_slots[MAX_SLOTS]; /* log2 histogram of the interrupt share */
+};
+
+#endif /* __RUNQIRQ_H */
@@ -0,0 +1,213 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __SAMPLING_BPF_H
+#define __SAMPLING_BPF_H
+
+/**
+ * @file sampling.bpf.h
+ * @brief Adaptive 1-in-N sampler in front of a BPF ring buffer
+ *
+ * Usage:
+ *
+ *     __u32 weight;
+ *
+ *     if (!sampler_sample(&weight))
+ *         return 0;
+ *     e = sampler_reserve(&events, sizeof(*e), weight);
+ *     if (!e)
+ *         return 0;
+ *     e->weight = weight;
+ *
+ * On reserve failure the rate is doubled (at most once per hold_ns) up to
+ * max_rate; once no drop has been seen for idle_ns it is halved again down
+ * to min_rate. With SAMPLER_F_USER set only userspace writes the rate.
+ * With SAMPLER_F_TOKENS the events pass a per-CPU token bucket instead and
+ * carry the number of events they stand for as their weight.
+ *
+ * Only maps are used for state so this also works under BPF_NO_GLOBAL_DATA.
+ */
+
+#include "sampling.h"
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct sampler_ctl);
+} sampler_ctl SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct sampler_stats);
+} sampler_stats SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct sampler_bucket);
+} sampler_bucket SEC(".maps");
+
+#define SAMPLER_TOKEN 1000000000ULL
+
+/**
+ * sampler_take_token - Token bucket check of sampler_sample()
+ * @ctl: Shared control value
+ * @weight: Set to the events seen on this CPU since the last emitted one
+ *
+ * Credit is kept in tokens times 1e9 so that a refill is exactly elapsed
+ * ns times tokens_per_sec. Being per-CPU, the bucket needs no atomics; the
+ * total rate is tokens_per_sec times the busy CPUs.
+ *
+ * @return non-zero if the caller should emit the event
+ */
+static __always_inline int sampler_take_token(struct sampler_ctl *ctl, __u32 *weight)
+{
+    struct sampler_bucket *b;
+    __u64 now, cap, elapsed;
+    __u32 key = 0;
+
+    b = bpf_map_lookup_elem(&sampler_bucket, &key);
+    if (!b || !ctl->tokens_per_sec)
+        return 0;
+
+    b->pending++;
+    now = bpf_ktime_get_ns();
+    cap = (__u64)(ctl->burst ?: SAMPLER_DEF_BURST) * SAMPLER_TOKEN;
+    elapsed = now - b->last_ns;
+    b->last_ns = now;
+    /* Compare before multiplying, a long idle period would overflow */
+    if (elapsed >= cap / ctl->tokens_per_sec)
+        b->credit = cap;
+    else if (b->credit + elapsed * ctl->tokens_per_sec >= cap)
+        b->credit = cap;
+    else
+        b->credit += elapsed * ctl->tokens_per_sec;
+
+    if (b->credit < SAMPLER_TOKEN)
+        return 0;
+    b->credit -= SAMPLER_TOKEN;
+    *weight = b->pending > 0xffffffff ? 0xffffffff : b->pending;
+    b->pending = 0;
+    return 1;
+}
+
+/**
+ * sampler_sample - Decide whether the current event is emitted
+ * @weight: Set to the number of events the sample stands for
+ *
+ * @return non-zero if the caller should emit the event
+ */
+static __always_inline int sampler_sample(__u32 *weight)
+{
+    struct sampler_stats *stats;
+    struct sampler_ctl *ctl;
+    __u32 key = 0;
+    __u32 rate;
+
+    ctl = bpf_map_lookup_elem(&sampler_ctl, &key);
+    stats = bpf_map_lookup_elem(&sampler_stats, &key);
+    if (!ctl || !stats)
+        return 0;
+
+    if (ctl->flags & SAMPLER_F_TOKENS) {
+        stats->seen++;
+        if (!sampler_take_token(ctl, weight))
+            return 0;
+        stats->sampled++;
+        return 1;
+    }
+
+    /* Deterministic per-CPU 1-in-N */
+    rate = ctl->rate ?: 1;
+    if (stats->seen++ % rate)
+        return 0;
+
+    stats->sampled++;
+    *weight = rate;
+    return 1;
+}
+
+/**
+ * sampler_adjust - Move the shared rate after a reserve attempt
+ * @ctl: Shared control value
+ * @dropped: Whether the reserve failed
+ *
+ * Concurrent CPUs may race on the read-modify-write of ctl->rate, but they
+ * all compute the same new value from the same old one, so the race only
+ * collapses simultaneous adjustments into one.
+ */
+static __always_inline void sampler_adjust(struct sampler_ctl *ctl, int dropped)
+{
+    __u64 now = bpf_ktime_get_ns();
+    __u32 rate = ctl->rate ?: 1;
+    __u32 bound;
+
+    if (dropped)
+        ctl->last_drop_ns = now;
+    if (ctl->flags & (SAMPLER_F_USER | SAMPLER_F_TOKENS))
+        return;
+
+    if (dropped) {
+        bound = ctl->max_rate ?: SAMPLER_DEF_MAX_RATE;
+        if (rate >= bound ||
+            now - ctl->last_adjust_ns < (ctl->hold_ns ?: SAMPLER_DEF_HOLD_NS))
+            return;
+        rate <<= 1;
+        ctl->rate = rate > bound ? bound : rate;
+        ctl->last_adjust_ns = now;
+    } else {
+        __u64 idle_ns = ctl->idle_ns ?: SAMPLER_DEF_IDLE_NS;
+
+        bound = ctl->min_rate ?: 1;
+        if (rate <= bound || now - ctl->last_drop_ns < idle_ns ||
+            now - ctl->last_adjust_ns < idle_ns)
+            return;
+        rate >>= 1;
+        ctl->rate = rate < bound ? bound : rate;
+        ctl->last_adjust_ns = now;
+    }
+}
+
+/**
+ * sampler_drop - Account a sampled event that could not be emitted
+ * @weight: Weight the lost event was sampled with
+ */
+static __always_inline void sampler_drop(__u32 weight)
+{
+    struct sampler_stats *stats;
+    __u32 key = 0;
+
+    stats = bpf_map_lookup_elem(&sampler_stats, &key);
+    if (!stats)
+        return;
+    stats->dropped++;
+    stats->dropped_weight += weight;
+}
+
+/**
+ * sampler_reserve - bpf_ringbuf_reserve() with drop accounting and feedback
+ * @ringbuf: BPF_MAP_TYPE_RINGBUF map
+ * @size: Record size, must be a compile-time constant
+ * @weight: Weight returned by sampler_sample()
+ *
+ * @return the reserved record or NULL if the ring buffer is full
+ */
+static __always_inline void *sampler_reserve(void *ringbuf, __u64 size, __u32 weight)
+{
+    struct sampler_ctl *ctl;
+    __u32 key = 0;
+    void *rec;
+
+    rec = bpf_ringbuf_reserve(ringbuf, size, 0);
+    if (!rec)
+        sampler_drop(weight);
+
+    ctl = bpf_map_lookup_elem(&sampler_ctl, &key);
+    if (ctl)
+        sampler_adjust(ctl, !rec);
+    return rec;
+}
+
+#endif /* __SAMPLING_BPF_H */
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __SAMPLING_H
+#define __SAMPLING_H
+
+/**
+ * @file sampling.h
+ * @brief Shared layout of the adaptive ring buffer sampler
+ *
+ * Every event offered to the sampler bumps a per-CPU counter and only one
+ * in sampler_ctl.rate events is emitted. Each emitted event carries the rate
+ * it was sampled at as its weight, so summing weights (rather than counting
+ * events) gives an unbiased estimate of the true totals even while the rate
+ * moves. Events lost to a full ring buffer are accounted in sampler_stats.
+ *
+ * With SAMPLER_F_TOKENS the 1-in-N check is replaced by a per-CPU token
+ * bucket: at most tokens_per_sec events per second are emitted on each CPU,
+ * after a burst of up to burst events, and each emitted event weighs the
+ * number of events the CPU saw since its previous emitted one.
+ */
+
+/* Rate is driven by userspace (e.g. from consumer lag); the program never adjusts it */
+#define SAMPLER_F_USER (1U << 0)
+/* Rate-limit with a per-CPU token bucket instead of 1-in-N, implies SAMPLER_F_USER */
+#define SAMPLER_F_TOKENS (1U << 1)
+
+#define SAMPLER_DEF_MAX_RATE 1024
+#define SAMPLER_DEF_HOLD_NS 10000000ULL /* 10ms between two rate increases */
+#define SAMPLER_DEF_IDLE_NS 1000000000ULL /* 1s without drops halves the rate */
+#define SAMPLER_DEF_BURST 64
+
+/**
+ * @struct sampler_ctl
+ * @brief Shared control value, a single entry of the sampler_ctl array map
+ *
+ * All fields may be left zeroed, in which case every event is sampled and
+ * the SAMPLER_DEF_* bounds apply.
+ */
+struct sampler_ctl {
+    __u32 rate; /* Current 1-in-N sampling rate, 0 behaves as 1 */
+    __u32 min_rate; /* Floor the rate decays to when idle */
+    __u32 max_rate; /* Ceiling the rate grows to under pressure */
+    __u32 flags; /* SAMPLER_F_* */
+    __u64 hold_ns; /* Minimum time between two increases */
+    __u64 idle_ns; /* Drop-free time before the rate is halved */
+    __u64 last_drop_ns; /* Written by the program on reserve failure */
+    __u64 last_adjust_ns; /* Written by the program on rate change */
+    __u32 tokens_per_sec; /* SAMPLER_F_TOKENS: events emitted per second and CPU */
+    __u32 burst; /* SAMPLER_F_TOKENS: bucket size, 0 for SAMPLER_DEF_BURST */
+};
+
+/**
+ * @struct sampler_stats
+ * @brief Per-CPU sampler accounting, sum over CPUs in userspace
+ */
+struct sampler_stats {
+    __u64 seen; /* Events offered to the sampler */
+    __u64 sampled; /* Events that passed the 1-in-N check */
+    __u64 dropped; /* Sampled events lost to bpf_ringbuf_reserve failure */
+    __u64 dropped_weight; /* Sum of the weights of dropped events */
+};
+
+/**
+ * @struct sampler_bucket
+ * @brief Per-CPU token bucket state, only used with SAMPLER_F_TOKENS
+ */
+struct sampler_bucket {
+    __u64 credit; /* Tokens available, scaled by 1e9 */
+    __u64 last_ns; /* Last refill */
+    __u64 pending; /* Events skipped since the last emitted one, plus one */
+};
+
+#endif /* __SAMPLING_H */
@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+/**
+ * @file trace_helpers.cpp
+ * @brief Output, probing and command-line helpers shared by the front-ends
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <unordered_map>
+#include <ftw.h>
+#include <getopt.h>
+#include <bpf/libbpf.h>
+#include "trace_helpers.hpp"
+
+volatile sig_atomic_t exiting;
+
+void sig_handler(int sig)
+{
+    exiting = 1;
+}
+
+bool parse_ull(const char *arg, unsigned long long *val)
+{
+    char *end;
+
+    errno = 0;
+    *val = strtoull(arg, &end, 10);
+    return !errno && end != arg && !*end;
+}
+
+int parse_interval_count(int argc, char **argv, int *interval, int *times)
+{
+    unsigned long long val;
+    int pos_args = 0;
+
+    for (; optind < argc; optind++, pos_args++) {
+        if (pos_args > 1) {
+            fprintf(stderr, "unrecognized positional argument: %s\n", argv[optind]);
+            return -EINVAL;
+        }
+        if (!parse_ull(argv[optind], &val) || !val || val > 99999999) {
+            fprintf(stderr, "invalid %s: %s\n", pos_args ? "count" : "interval",
+                    argv[optind]);
+            return -EINVAL;
+        }
+        *(pos_args ? times : interval) = val;
+    }
+    return pos_args;
+}
+
+static bool libbpf_verbose;
+
+static int libbpf_print_fn(enum libbpf_print_level level, const char *format, va_list args)
+{
+    if (level == LIBBPF_DEBUG && !libbpf_verbose)
+        return 0;
+    return vfprintf(stderr, format, args);
+}
+
+void set_libbpf_print(bool verbose)
+{
+    libbpf_verbose = verbose;
+    libbpf_set_print(libbpf_print_fn);
+}
+
+static void print_stars(unsigned int val, unsigned int val_max, int width)
+{
+    int num_stars = val_max ? (int)((unsigned long long)val * width / val_max) : 0;
+    int num_spaces = width - num_stars;
+    bool need_plus = val > val_max;
+
+    if (need_plus) {
+        num_stars = width - 1;
+        num_spaces = 0;
+    }
+    for (int i = 0; i < num_stars; i++)
+        putchar('*');
+    for (int i = 0; i < num_spaces; i++)
+        putchar(' ');
+    if (need_plus)
+        putchar('+');
+}
+
+void print_log2_hist(const unsigned int *vals, int vals_size, const char *val_type)
+{
+    int stars_max = 40, idx_max = -1;
+    unsigned int val_max = 0;
+    int stars;
+
+    for (int i = 0; i < vals_size; i++) {
+        if (vals[i] > 0)
+            idx_max = i;
+        if (vals[i] > val_max)
+            val_max = vals[i];
+    }
+    if (idx_max < 0)
+        return;
+
+    printf("%*s%-*s : count    distribution\n", idx_max <= 32 ? 5 : 15, "",
+           idx_max <= 32 ? 19 : 29, val_type);
+    stars = idx_max <= 32 ? stars_max : stars_max / 2;
+
+    for (int i = 0; i <= idx_max; i++) {
+        unsigned long long low = (1ULL << (i + 1)) >> 1;
+        unsigned long long high = (1ULL << (i + 1)) - 1;
+
+        if (low == high)
+            low -= 1;
+        printf("%*llu -> %-*llu : %-8u |", idx_max <= 32 ? 10 : 20, low,
+               idx_max <= 32 ? 10 : 20, high, vals[i]);
+        print_stars(vals[i], val_max, stars);
+        printf("|\n");
+    }
+}
+
+void print_timestamp(FILE *out)
+{
+    char buf[16];
+    time_t t = time(nullptr);
+    struct tm tm;
+
+    localtime_r(&t, &tm);
+    strftime(buf, sizeof(buf), "%H:%M:%S", &tm);
+    fprintf(out, "%-8s\n", buf);
+}
+
+bool probe_tp_btf(const char *name)
+{
+    return libbpf_find_vmlinux_btf_id(name, BPF_TRACE_RAW_TP) > 0;
+}
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+static std::unordered_map<unsigned long long, std::string> cgroup_names;
+
+static int index_cgroup(const char *fpath, const struct stat *sb, int typeflag, struct FTW *)
+{
+    if (typeflag == FTW_D) {
+        const char *rel = fpath + sizeof(CGROUP_ROOT) - 1;
+
+        cgroup_names[sb->st_ino] = *rel ? rel : "/";
+    }
+    return 0;
+}
+
+std::string cgroup_name(unsigned long long id)
+{
+    auto it = cgroup_names.find(id);
+
+    if (it == cgroup_names.end()) {
+        nftw(CGROUP_ROOT, index_cgroup, 16, FTW_PHYS | FTW_MOUNT);
+        it = cgroup_names.find(id);
+        /* Remember ids of removed cgroups so they do not trigger rescans */
+        if (it == cgroup_names.end())
+            it = cgroup_names.emplace(id, std::to_string(id)).first;
+    }
+    return it->second;
+}
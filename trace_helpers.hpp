@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __TRACE_HELPERS_HPP
+#define __TRACE_HELPERS_HPP
+
+/**
+ * @file trace_helpers.hpp
+ * @brief Output, probing and command-line helpers shared by the front-ends
+ */
+
+#include <csignal>
+#include <cstdio>
+#include <string>
+
+/* Set by sig_handler(), polled by the main loops */
+extern volatile sig_atomic_t exiting;
+
+/**
+ * sig_handler - SIGINT/SIGTERM handler, sets exiting
+ */
+void sig_handler(int sig);
+
+/**
+ * parse_ull - Strict decimal parse, no sign, no trailing characters
+ * @arg: Text to parse
+ * @val: Set to the value
+ *
+ * @return true if @arg was a number that fits
+ */
+bool parse_ull(const char *arg, unsigned long long *val);
+
+/**
+ * parse_interval_count - Parse the "[interval] [count]" positional arguments
+ * @argc: Argument count, as passed to main()
+ * @argv: Arguments, the positional ones starting at optind
+ * @interval: Set when given, in 1..99999999
+ * @times: Set when given, in 1..99999999
+ *
+ * @return the number of positional arguments, or -EINVAL after printing
+ * what was wrong
+ */
+int parse_interval_count(int argc, char **argv, int *interval, int *times);
+
+/**
+ * set_libbpf_print - Route libbpf messages to stderr
+ * @verbose: Include debug messages
+ */
+void set_libbpf_print(bool verbose);
+
+/**
+ * print_log2_hist - Print a log2 histogram as produced by the BPF programs
+ * @vals: Slot counts, slot i covering [2^i, 2^(i+1))
+ * @vals_size: Number of slots
+ * @val_type: Unit label for the value column, e.g. "usecs"
+ */
+void print_log2_hist(const unsigned int *vals, int vals_size, const char *val_type);
+
+/**
+ * print_timestamp - Print the current wall-clock time as "%H:%M:%S\n"
+ */
+void print_timestamp(FILE *out = stdout);
+
+/**
+ * probe_tp_btf - Check whether a tracepoint can be attached as tp_btf
+ * @name: Tracepoint name, e.g. "irq_handler_entry"
+ *
+ * @return true if the running kernel exposes BTF for the tracepoint
+ */
+bool probe_tp_btf(const char *name);
+
+/**
+ * cgroup_name - Path of a cgroup v2 directory relative to the cgroup root
+ * @id: cgroup id as returned by bpf_get_current_cgroup_id()
+ *
+ * The hierarchy under /sys/fs/cgroup is indexed by inode (which is the
+ * cgroup id) and rescanned the first time an unknown id shows up.
+ *
+ * @return the path, or the numeric id if the cgroup is gone
+ */
+std::string cgroup_name(unsigned long long id);
+
+#endif /* __TRACE_HELPERS_HPP */
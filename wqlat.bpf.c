@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/**
+ * @file wqlat.bpf.c
+ * @brief eBPF program measuring workqueue queueing delay and execution time
+ *
+ * Per work function this program histograms:
+ * - Queueing delay, from workqueue_queue_work to workqueue_execute_start
+ * - Execution time, from workqueue_execute_start to workqueue_execute_end
+ *
+ * Statistics live in a per-CPU hash, so the handlers never contend on a
+ * shared counter; userspace sums the CPUs and drains the map in batches.
+ */
+
+#include <vmlinux.h>
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include "wqlat.h"
+#include "bits.bpf.h"
+#include "maps.bpf.h"
+
+/* Runtime configuration flags */
+const volatile bool targ_ns = false; /* use nanoseconds (true) or microseconds (false) */
+
+/**
+ * @brief Queue timestamp of pending work items keyed by work_struct address
+ * Work cancelled or freed before it runs never reaches execute_start; the
+ * LRU evicts those leftovers instead of failing new inserts once full
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, MAX_PENDING);
+    __type(key, u64);
+    __type(value, u64);
+} queued SEC(".maps");
+
+/**
+ * @brief Work item a kworker is executing
+ */
+struct wq_start {
+    u64 ts; /* workqueue_execute_start timestamp */
+    u64 delay; /* Queueing delay in ns, (u64)-1 if the queueing was not seen */
+};
+
+/**
+ * @brief Running work items keyed by kworker thread id
+ * Unbound kworkers may migrate while executing, so a per-CPU slot would
+ * not find the start again
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_RUNNING);
+    __type(key, u32);
+    __type(value, struct wq_start);
+} running SEC(".maps");
+
+/**
+ * @brief Per-function statistics keyed by work function address
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, MAX_FUNCS);
+    __type(key, u64);
+    __type(value, struct wq_info);
+} infos SEC(".maps");
+
+static struct wq_info zero;
+
+static __always_inline void hist_add(u32 *slots, u64 val)
+{
+    u64 slot = log2l(val);
+
+    if (slot >= MAX_SLOTS)
+        slot = MAX_SLOTS - 1;
+    slots[slot]++;
+}
+
+SEC("tp_btf/workqueue_queue_work")
+int BPF_PROG(workqueue_queue_work, unsigned int req_cpu, struct pool_workqueue *pwq,
+             struct work_struct *work)
+{
+    u64 key = (u64)work;
+    u64 ts = bpf_ktime_get_ns();
+
+    bpf_map_update_elem(&queued, &key, &ts, BPF_ANY);
+    return 0;
+}
+
+SEC("tp_btf/workqueue_execute_start")
+int BPF_PROG(workqueue_execute_start, struct work_struct *work)
+{
+    u32 pid = (u32)bpf_get_current_pid_tgid();
+    struct wq_start ws = { .delay = (u64)-1 };
+    u64 key = (u64)work;
+    u64 *qts;
+
+    ws.ts = bpf_ktime_get_ns();
+    qts = bpf_map_lookup_elem(&queued, &key);
+    if (qts) {
+        if (ws.ts > *qts)
+            ws.delay = ws.ts - *qts;
+        bpf_map_delete_elem(&queued, &key);
+    }
+    bpf_map_update_elem(&running, &pid, &ws, BPF_ANY);
+    return 0;
+}
+
+/**
+ * workqueue_execute_end - Account a finished work item
+ * @work: Work item, possibly freed by its function already, never read
+ * @function: Function that ran
+ */
+SEC("tp_btf/workqueue_execute_end")
+int BPF_PROG(workqueue_execute_end, struct work_struct *work, work_func_t function)
+{
+    u32 pid = (u32)bpf_get_current_pid_tgid();
+    u64 func = (u64)function;
+    struct wq_start *ws;
+    struct wq_info *info;
+    u64 exec, delay;
+
+    ws = bpf_map_lookup_elem(&running, &pid);
+    if (!ws)
+        return 0;
+    exec = bpf_ktime_get_ns() - ws->ts;
+    delay = ws->delay;
+    bpf_map_delete_elem(&running, &pid);
+
+    info = bpf_map_lookup_or_try_init(&infos, &func, &zero);
+    if (!info)
+        return 0;
+
+    if (!targ_ns)
+        exec /= 1000U;
+    info->count++;
+    info->exec_total += exec;
+    if (exec > info->exec_max)
+        info->exec_max = exec;
+    hist_add(info->exec_slots, exec);
+
+    if (delay != (u64)-1) {
+        if (!targ_ns)
+            delay /= 1000U;
+        info->queued++;
+        info->queue_total += delay;
+        hist_add(info->queue_slots, delay);
+    }
+    return 0;
+}
+
+char LICENSE[] SEC("license") = "GPL";
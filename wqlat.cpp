@@ -0,0 +1,321 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * @file wqlat.cpp
+ * @brief Userspace front-end for wqlat.bpf.c
+ *
+ * Drains the per-CPU statistics every interval with one
+ * bpf_map_lookup_and_delete_batch() call per chunk of functions, sums the
+ * CPUs and prints queueing delay and execution time per work function,
+ * symbolized through /proc/kallsyms. With -d the histograms follow.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "wqlat.h"
+#include "wqlat.skel.h"
+#include "ksyms.hpp"
+#include "trace_helpers.hpp"
+
+/* Keys fetched per batch call */
+#define BATCH_SIZE 256
+
+static struct env {
+    bool distributed;
+    bool nanoseconds;
+    bool timestamp;
+    bool verbose;
+    int top = 20;
+    int interval = 99999999;
+    int times = 99999999;
+} env;
+
+static Ksyms ksyms;
+
+static const char usage[] =
+    "Usage: wqlat [OPTION...] [interval] [count]\n"
+    "Summarize workqueue queueing delay and execution time per work function.\n"
+    "\n"
+    "  -d, --distributed         Show queueing and execution histograms\n"
+    "  -n, --top=N               Functions shown, by total execution time\n"
+    "  -N, --nanoseconds         Output in nanoseconds\n"
+    "  -T, --timestamp           Include timestamp on output\n"
+    "  -v, --verbose             Verbose debug output\n"
+    "  -h, --help                Show this help\n"
+    "\n"
+    "Examples:\n"
+    "    wqlat 1             # per-function summary every second\n"
+    "    wqlat -d -n 5 10    # histograms of the top 5 functions every 10s\n";
+
+static const struct option long_opts[] = {
+    { "distributed", no_argument, nullptr, 'd' },
+    { "top", required_argument, nullptr, 'n' },
+    { "nanoseconds", no_argument, nullptr, 'N' },
+    { "timestamp", no_argument, nullptr, 'T' },
+    { "verbose", no_argument, nullptr, 'v' },
+    { "help", no_argument, nullptr, 'h' },
+    {},
+};
+
+static int parse_args(int argc, char **argv)
+{
+    unsigned long long val;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "dn:NTvh", long_opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'd':
+            env.distributed = true;
+            break;
+        case 'n':
+            if (!parse_ull(optarg, &val) || !val || val > MAX_FUNCS) {
+                fprintf(stderr, "invalid function count: %s\n", optarg);
+                return -EINVAL;
+            }
+            env.top = val;
+            break;
+        case 'N':
+            env.nanoseconds = true;
+            break;
+        case 'T':
+            env.timestamp = true;
+            break;
+        case 'v':
+            env.verbose = true;
+            break;
+        case 'h':
+            fputs(usage, stdout);
+            exit(0);
+        default:
+            fputs(usage, stderr);
+            return -EINVAL;
+        }
+    }
+
+    if (parse_interval_count(argc, argv, &env.interval, &env.times) < 0)
+        return -EINVAL;
+    return 0;
+}
+
+static const char *func_name(unsigned long long addr, char *buf, size_t size)
+{
+    const struct ksym *sym = ksyms.lookup(addr);
+
+    if (!sym)
+        snprintf(buf, size, "0x%llx", addr);
+    else if (sym->module)
+        snprintf(buf, size, "%s [%s]", sym->name, sym->module);
+    else
+        snprintf(buf, size, "%s", sym->name);
+    return buf;
+}
+
+struct func_entry {
+    unsigned long long func;
+    struct wq_info info;
+};
+
+static void add_info(struct wq_info *sum, const struct wq_info *v)
+{
+    sum->count += v->count;
+    sum->queued += v->queued;
+    sum->queue_total += v->queue_total;
+    sum->exec_total += v->exec_total;
+    sum->exec_max = std::max(sum->exec_max, v->exec_max);
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        sum->queue_slots[i] += v->queue_slots[i];
+        sum->exec_slots[i] += v->exec_slots[i];
+    }
+}
+
+/**
+ * drain_infos - Read and delete all entries of the per-CPU infos map
+ * @fd: infos map
+ * @ncpus: Possible CPUs
+ * @funcs: Filled with one CPU-summed entry per function
+ *
+ * Falls back to one lookup and delete per key on kernels without batch
+ * operations, and for what is left if a batch call fails midway.
+ *
+ * @return 0; entries that vanish while being read are skipped
+ */
+static int drain_infos(int fd, int ncpus, std::vector<struct func_entry> &funcs)
+{
+    __u32 batch = BATCH_SIZE;
+    std::vector<__u64> keys(batch);
+    std::vector<struct wq_info> values((size_t)batch * ncpus);
+    __u64 out_batch, *in_batch = nullptr;
+    size_t batched;
+    int err;
+
+    for (;;) {
+        __u32 count = batch;
+
+        err = bpf_map_lookup_and_delete_batch(fd, in_batch, &out_batch, keys.data(),
+                                              values.data(), &count, nullptr);
+        if (err == -ENOSPC && batch < MAX_FUNCS) {
+            /* A hash bucket holds more keys than fit, nothing was returned */
+            batch *= 2;
+            keys.resize(batch);
+            values.resize((size_t)batch * ncpus);
+            continue;
+        }
+        /* Entries returned by a failing call are deleted all the same */
+        for (__u32 i = 0; i < count; i++) {
+            struct func_entry e = { keys[i], {} };
+
+            for (int cpu = 0; cpu < ncpus; cpu++)
+                add_info(&e.info, &values[(size_t)i * ncpus + cpu]);
+            funcs.push_back(e);
+        }
+        if (err)
+            break;
+        in_batch = &out_batch;
+    }
+    if (err == -ENOENT)
+        return 0; /* The whole map was walked */
+
+    /* No batch support, or the walk broke off: read what is left per key */
+    __u64 key, next_key, *prev = nullptr;
+
+    batched = funcs.size();
+    while (!bpf_map_get_next_key(fd, prev, &next_key)) {
+        struct func_entry e = { next_key, {} };
+
+        key = next_key;
+        prev = &key;
+        if (bpf_map_lookup_elem(fd, &next_key, values.data()))
+            continue;
+        for (int cpu = 0; cpu < ncpus; cpu++)
+            add_info(&e.info, &values[cpu]);
+        funcs.push_back(e);
+    }
+    for (size_t i = batched; i < funcs.size(); i++)
+        bpf_map_delete_elem(fd, &funcs[i].func);
+    return 0;
+}
+
+/**
+ * print_infos - Print and reset the per-function statistics
+ * @obj: Loaded skeleton
+ */
+static int print_infos(struct wqlat_bpf *obj)
+{
+    const char *units = env.nanoseconds ? "nsecs" : "usecs";
+    int ncpus = libbpf_num_possible_cpus();
+    std::vector<struct func_entry> funcs;
+    char name[128];
+    int err;
+
+    if (ncpus <= 0)
+        return ncpus;
+    err = drain_infos(bpf_map__fd(obj->maps.infos), ncpus, funcs);
+    if (err) {
+        fprintf(stderr, "failed to read infos: %d\n", err);
+        return err;
+    }
+
+    std::sort(funcs.begin(), funcs.end(), [](const func_entry &a, const func_entry &b) {
+        return a.info.exec_total > b.info.exec_total;
+    });
+    if (funcs.size() > (size_t)env.top)
+        funcs.resize(env.top);
+
+    printf("%-40s %10s %10s%5s %9s%5s %9s%5s\n", "FUNCTION", "COUNT", "AVG_QUEUE_", units,
+           "AVG_EXEC_", units, "MAX_EXEC_", units);
+    for (const auto &e : funcs) {
+        const struct wq_info &w = e.info;
+
+        printf("%-40s %10llu %15llu %14llu %14llu\n", func_name(e.func, name, sizeof(name)),
+               (unsigned long long)w.count,
+               w.queued ? (unsigned long long)(w.queue_total / w.queued) : 0ULL,
+               w.count ? (unsigned long long)(w.exec_total / w.count) : 0ULL,
+               (unsigned long long)w.exec_max);
+    }
+
+    if (!env.distributed)
+        return 0;
+    for (const auto &e : funcs) {
+        func_name(e.func, name, sizeof(name));
+        printf("\nfunction = %s, queueing delay\n", name);
+        print_log2_hist(e.info.queue_slots, MAX_SLOTS, units);
+        printf("\nfunction = %s, execution time\n", name);
+        print_log2_hist(e.info.exec_slots, MAX_SLOTS, units);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct wqlat_bpf *obj;
+    int err;
+
+    err = parse_args(argc, argv);
+    if (err)
+        return 1;
+
+    set_libbpf_print(env.verbose);
+
+    if (!probe_tp_btf("workqueue_execute_start")) {
+        fprintf(stderr, "kernel lacks BTF-enabled tracepoints\n");
+        return 1;
+    }
+
+    err = ksyms.load();
+    if (err)
+        fprintf(stderr, "failed to load kallsyms, functions are not symbolized: %d\n", err);
+
+    obj = wqlat_bpf__open();
+    if (!obj) {
+        fprintf(stderr, "failed to open BPF object\n");
+        return 1;
+    }
+
+    obj->rodata->targ_ns = env.nanoseconds;
+
+    err = wqlat_bpf__load(obj);
+    if (err) {
+        fprintf(stderr, "failed to load BPF object: %d\n", err);
+        goto cleanup;
+    }
+
+    err = wqlat_bpf__attach(obj);
+    if (err) {
+        fprintf(stderr, "failed to attach BPF programs\n");
+        goto cleanup;
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    printf("Tracing workqueue latency... Hit Ctrl-C to end.\n");
+
+    /* main: poll */
+    while (!exiting) {
+        sleep(env.interval);
+        printf("\n");
+
+        if (env.timestamp)
+            print_timestamp();
+
+        err = print_infos(obj);
+        if (err)
+            break;
+
+        if (--env.times == 0)
+            break;
+    }
+
+cleanup:
+    wqlat_bpf__destroy(obj);
+
+    return err != 0;
+}
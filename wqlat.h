@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+#ifndef __WQLAT_H
+#define __WQLAT_H
+
+/**
+ * @file wqlat.h
+ * @brief Definitions shared between wqlat.bpf.c and its userspace front-end
+ */
+
+#define MAX_SLOTS 24
+#define MAX_FUNCS 1024
+#define MAX_PENDING 16384 /* Work items queued but not started */
+#define MAX_RUNNING 4096 /* Work items running at once, one per kworker */
+
+/**
+ * @struct wq_info
+ * @brief Per-CPU statistics of one work function, summed in userspace
+ */
+struct wq_info {
+    __u64 count; /* Work items executed */
+    __u64 queued; /* Executions with a queue timestamp, i.e. with a queue delay */
+    __u64 queue_total; /* Summed queueing delay in the tool's unit */
+    __u64 exec_total; /* Summed execution time in the tool's unit */
+    __u64 exec_max; /* Longest execution in the tool's unit */
+    __u32 queue_slots[MAX_SLOTS]; /* log2 histogram of queueing delay */
+    __u32 exec_slots[MAX_SLOTS]; /* log2 histogram of execution time */
+};
+
+#endif /* __WQLAT_H */